@@ -35,7 +35,9 @@ use IEEE.numeric_std.all;
 
 -- The layout looks like this:
 -- 0x0000-0x3999 - Static ROM bank. Mapped to 0x0000-0x3999 in the rom
--- 0x4000-0x7999 - Switchable ROM bank. Initially mapped to 0x4000-0x7999
+-- 0x4000-0x7999 - Switchable ROM bank. Initially mapped to 0x4000-0x7999,
+--                 bank 1. Switched like the MBC1 or MBC5 does, depending on
+--                 the cartridge type (0x0147) in the uploaded rom.
 -- 0x8000-0x9FFF - Read BG, Sprite data from the GPU
 -- 0xA000-0xBFFF - External expansion working ram (8K)
 -- 0xC000-0xDFFF - Internal working ram (8K)
@@ -47,6 +49,14 @@ use IEEE.numeric_std.all;
 -- 0xFFFE-0xFFFF - Undefined. Implemented as extension of working stack and RAM.
 
 entity Bus_Controller is
+  -- Size of the rom in 16K banks, a power of two. Real cartridges have
+  -- up to 512 (8MB), but that does not fit in the block ram of the FPGA.
+  -- Sim_Memory keeps the rom and the rams in shared variables instead of
+  -- signals. ghdl is a lot faster that way, since a write no longer
+  -- schedules an event on a whole array. Only for simulation, the FPGA
+  -- needs the signals to infer block ram.
+  generic (Rom_Banks : integer := 2;
+           Sim_Memory : boolean := false);
   port (Clk, Reset : in std_logic;
         Mem_Write : in std_logic_vector(7 downto 0);
         Mem_Read : out std_logic_vector(7 downto 0);
@@ -57,9 +67,10 @@ entity Bus_Controller is
         Gpu_Read : in std_logic_vector(7 downto 0);
         Gpu_Addr : out std_logic_vector(15 downto 0);
         Gpu_Write_Enable : out std_logic;
-        -- These three signals writes to the large rom.
+        -- These three signals writes to the large rom. The address is
+        -- bank * 0x4000 + offset, that is, the offset in the rom file.
         Rom_Write_Enable : in std_logic;
-        Rom_Addr : in std_logic_vector(15 downto 0);
+        Rom_Addr : in std_logic_vector(22 downto 0);
         Rom_Write : in std_logic_vector(7 downto 0);
         -- Timer interrupts
         Timer_Interrupt : out std_logic;
@@ -78,16 +89,80 @@ architecture Bus_Controller_Behaviour of Bus_Controller is
          Data : in std_logic);
   end component;
   
-  type Ram_8KType is array (0 to 8191) of std_logic_vector(7 downto 0);
-  type Ram_128Type is array (0 to 127) of std_logic_vector(7 downto 0);
-  type Rom_32KType is array (0 to 32767) of std_logic_vector(7 downto 0);
+  --Only the memories of one kind are used, depending on Sim_Memory. The
+  --others are left empty, the rom alone would be millions of signals in
+  --the simulation with a large Rom_Banks.
+  function Memory_Size(Size : integer; Sim : boolean) return integer is
+  begin
+    if Sim = Sim_Memory then
+      return Size;
+    end if;
+    return 0;
+  end Memory_Size;
+
+  type Memory_Type is array (integer range <>) of std_logic_vector(7 downto 0);
+
+  signal External_Ram : Memory_Type(0 to Memory_Size(8192, false) - 1) := (others => X"00");
+  signal Internal_Ram : Memory_Type(0 to Memory_Size(8192, false) - 1) := (others => X"00");
+  signal Stack_Ram : Memory_Type(0 to Memory_Size(128, false) - 1) := (others => X"00");
+
+  signal Rom_Memory : Memory_Type(0 to Memory_Size(Rom_Banks * 16384, false) - 1)
+    := (others => X"76");  --filled with HALT to begin with
+
+  --The same memories when Sim_Memory is set, a byte in an integer. Reads
+  --and writes never happen on the same cycle (see Mem_Write_Enable), so
+  --the order the processes run in does not matter.
+  type Sim_Memory_Type is array (integer range <>) of integer range 0 to 255;
+  shared variable External_Ram_Sim : Sim_Memory_Type(0 to Memory_Size(8192, true) - 1) := (others => 0);
+  shared variable Internal_Ram_Sim : Sim_Memory_Type(0 to Memory_Size(8192, true) - 1) := (others => 0);
+  shared variable Stack_Ram_Sim : Sim_Memory_Type(0 to Memory_Size(128, true) - 1) := (others => 0);
+  shared variable Rom_Memory_Sim : Sim_Memory_Type(0 to Memory_Size(Rom_Banks * 16384, true) - 1)
+    := (others => 16#76#);
+
+  impure function Read_Rom(Addr : integer) return std_logic_vector is
+  begin
+    if Sim_Memory then
+      return std_logic_vector(to_unsigned(Rom_Memory_Sim(Addr), 8));
+    end if;
+    return Rom_Memory(Addr);
+  end Read_Rom;
+
+  impure function Read_External_Ram(Addr : std_logic_vector) return std_logic_vector is
+  begin
+    if Sim_Memory then
+      return std_logic_vector(to_unsigned(External_Ram_Sim(to_integer(unsigned(Addr))), 8));
+    end if;
+    return External_Ram(to_integer(unsigned(Addr)));
+  end Read_External_Ram;
 
-  signal External_Ram : Ram_8KType := (others => X"00");
-  signal Internal_Ram : Ram_8KType := (others => X"00");
-  signal Stack_Ram : Ram_128Type := (others => X"00");
+  impure function Read_Internal_Ram(Addr : std_logic_vector) return std_logic_vector is
+  begin
+    if Sim_Memory then
+      return std_logic_vector(to_unsigned(Internal_Ram_Sim(to_integer(unsigned(Addr))), 8));
+    end if;
+    return Internal_Ram(to_integer(unsigned(Addr)));
+  end Read_Internal_Ram;
+
+  impure function Read_Stack_Ram(Addr : std_logic_vector) return std_logic_vector is
+  begin
+    if Sim_Memory then
+      return std_logic_vector(to_unsigned(Stack_Ram_Sim(to_integer(unsigned(Addr))), 8));
+    end if;
+    return Stack_Ram(to_integer(unsigned(Addr)));
+  end Read_Stack_Ram;
 
-  signal Rom_Memory : Rom_32KType := (others => X"76");  --filled with HALT to
-                                                         --begin with
+  --Memory bank controller signals
+  type Mbc_Type is (No_Mbc, Mbc1, Mbc5);
+  signal Mbc : Mbc_Type := No_Mbc;
+  --MBC1: 5 bits, 0 means 1. MBC5: 9 bits.
+  signal Rom_Bank_Low : std_logic_vector(8 downto 0) := '0' & X"01";
+  --MBC1: 2 bits, bit 5-6 of the rom bank (or the ram bank, which is not
+  --implemented, there is only one 8K bank of external ram).
+  signal Rom_Bank_High : std_logic_vector(1 downto 0) := "00";
+  --MBC1: in mode 1 Rom_Bank_High applies to 0x0000-0x3FFF as well.
+  signal Mbc1_Mode : std_logic := '0';
+  --The banks mapped to 0x0000-0x3FFF and 0x4000-0x7FFF, modulo Rom_Banks
+  signal Low_Bank, High_Bank : integer range 0 to Rom_Banks - 1;
 
   --Timer signals
   --Always increases at specific rate, 16384Hz, reg: 0xFF04
@@ -100,6 +175,14 @@ architecture Bus_Controller_Behaviour of Bus_Controller is
   signal Timer_Modulo : std_logic_vector(7 downto 0) := X"00";
   --Register for controlling various settings in the timer, reg: 0xFF07
   signal Timer_Control : std_logic_vector(7 downto 0) := X"00";
+
+  --Serial signals
+  --Data to transfer, reg: 0xFF01
+  signal Serial_Data : std_logic_vector(7 downto 0) := X"00";
+  --Bit 7 starts a transfer, bit 0 selects the internal clock, reg: 0xFF02.
+  --Nothing is connected to the link port, so a transfer is done the
+  --cycle after it is started.
+  signal Serial_Control : std_logic_vector(7 downto 0) := X"00";
   --4 different modes, 00 4096Hz, 01, 262144Hz, 10, 65536Hz, 11 16384Hz
   alias Timer_Speed : std_logic_vector(1 downto 0) is Timer_Control(1 downto 0);
   alias Timer_Running : std_logic is Timer_Control(2);  --1 to run, 0 to stop
@@ -118,6 +201,13 @@ architecture Bus_Controller_Behaviour of Bus_Controller is
   
   
 begin
+  Low_Bank <= to_integer(unsigned(Rom_Bank_High & "00000")) mod Rom_Banks
+              when Mbc = Mbc1 and Mbc1_Mode = '1' else 0;
+  High_Bank <= to_integer(unsigned(Rom_Bank_High & Rom_Bank_Low(4 downto 0))) mod Rom_Banks
+               when Mbc = Mbc1 else
+               to_integer(unsigned(Rom_Bank_Low)) mod Rom_Banks
+               when Mbc = Mbc5 else 1;
+
   Input_Port : Input port map (
     Clk => Clk,
     Reset => Reset,
@@ -167,12 +257,29 @@ begin
     end if;
   end process;
   
-  -- Writing to the rom
+  -- Writing to the rom. The cartridge type in the header tells us which
+  -- bank controller to behave like.
   process (Clk)
   begin
     if rising_edge(Clk) then
       if Rom_Write_Enable = '1' then
-        Rom_Memory(to_integer(unsigned(Rom_Addr))) <= Rom_Write;
+        if to_integer(unsigned(Rom_Addr)) < Rom_Banks * 16384 then
+          if Sim_Memory then
+            Rom_Memory_Sim(to_integer(unsigned(Rom_Addr))) := to_integer(unsigned(Rom_Write));
+          else
+            Rom_Memory(to_integer(unsigned(Rom_Addr))) <= Rom_Write;
+          end if;
+        end if;
+        if Rom_Addr = "000" & X"00147" then
+          case to_integer(unsigned(Rom_Write)) is
+            when 16#01# to 16#03# =>
+              Mbc <= Mbc1;
+            when 16#19# to 16#1E# =>
+              Mbc <= Mbc5;
+            when others =>
+              Mbc <= No_Mbc;
+          end case;
+        end if;
       end if;
     end if;
   end process;
@@ -185,6 +292,7 @@ begin
     if rising_edge(Clk) then
       Hz_Reset_Divider <= '0';           
       Timer_Counter_Reset <= '0';      
+      Serial_Control(7) <= '0';
       if Mem_Write_Enable = '1' then
         if Mem_Addr(15 downto 14) = "00" then  -- 0x0000-0x3900
           -- Addresses 0-100 contains interrupt vectors.
@@ -193,10 +301,30 @@ begin
           -- since it is only three bytes before some data required
           -- by the boot-loader, it usually only contains the instruction
           -- JMP 0x150, which is where the predefined things end.
-          -- No writing allowed here!
+          -- Writes go to the bank controller.
+          if Mem_Addr(13) = '1' then  -- 0x2000-0x3FFF
+            if Mbc = Mbc5 then
+              if Mem_Addr(12) = '0' then
+                Rom_Bank_Low(7 downto 0) <= Mem_Write;
+              else
+                Rom_Bank_Low(8) <= Mem_Write(0);
+              end if;
+            elsif Mem_Write(4 downto 0) = "00000" then
+              Rom_Bank_Low <= '0' & X"01";  -- Bank 0 can not be selected here
+            else
+              Rom_Bank_Low <= "0000" & Mem_Write(4 downto 0);
+            end if;
+          end if;
         elsif Mem_Addr(15 downto 14) = "01" then  -- 0x4000-0x7FFF
-          -- The addresses 4000-7FFF is switchable in som ROMS, implement!
-          -- No writing allowed here!
+          -- The addresses 4000-7FFF is switchable in som ROMS, writes here
+          -- go to the bank controller too.
+          if Mbc = Mbc1 then
+            if Mem_Addr(13) = '0' then  -- 0x4000-0x5FFF
+              Rom_Bank_High <= Mem_Write(1 downto 0);
+            else  -- 0x6000-0x7FFF
+              Mbc1_Mode <= Mem_Write(0);
+            end if;
+          end if;
         elsif Mem_Addr(15 downto 13) = "100" then -- 0x8000-0x9FFF
           -- Character data. Send to GPU.
           -- Character codes (BG data 1). Send to GPU.
@@ -204,16 +332,28 @@ begin
           -- Writes are handled below.
         elsif Mem_Addr(15 downto 13) = "101" then -- 0xA000-0xBFFF
           -- External expansion working RAM 8KB.
-          External_Ram(to_integer(unsigned(Mem_Addr(12 downto 0)))) <= Mem_Write;
+          if Sim_Memory then
+            External_Ram_Sim(to_integer(unsigned(Mem_Addr(12 downto 0)))) := to_integer(unsigned(Mem_Write));
+          else
+            External_Ram(to_integer(unsigned(Mem_Addr(12 downto 0)))) <= Mem_Write;
+          end if;
         elsif Mem_Addr(15 downto 13) = "110" then  -- 0xC000-0xDFFF
           -- Unit working ram 8KB.
-          Internal_Ram(to_integer(unsigned(Mem_Addr(12 downto 0)))) <= Mem_Write;
+          if Sim_Memory then
+            Internal_Ram_Sim(to_integer(unsigned(Mem_Addr(12 downto 0)))) := to_integer(unsigned(Mem_Write));
+          else
+            Internal_Ram(to_integer(unsigned(Mem_Addr(12 downto 0)))) <= Mem_Write;
+          end if;
           -- Addresses 0xE000-0xFDFF are handled by the "else" case.
         elsif Mem_Addr(15 downto 8) = "11111110" then  -- 0xFE00-0xFE9F
           -- OAM memory, send to GPU.
           -- Writes are handled below.
         elsif Mem_Addr(15 downto 0) = X"FF00" then
           Controller_Data_Select <= Mem_Write(5 downto 4);
+        elsif Mem_Addr(15 downto 0) = X"FF01" then
+          Serial_Data <= Mem_Write;
+        elsif Mem_Addr(15 downto 0) = X"FF02" then
+          Serial_Control <= Mem_Write;
         elsif Mem_Addr(15 downto 0) = X"FF04" then
           --Timer writes
           Hz_Reset_Divider <= '1';
@@ -230,11 +370,21 @@ begin
           -- Sound register.
         elsif Mem_Addr(15 downto 7) = "111111111" then  -- 0xFF80-0xFFFF
           -- Working stack and RAM.
-          Stack_Ram(to_integer(unsigned(Mem_Addr(6 downto 0)))) <= Mem_Write;
+          if Sim_Memory then
+            Stack_Ram_Sim(to_integer(unsigned(Mem_Addr(6 downto 0)))) := to_integer(unsigned(Mem_Write));
+          else
+            Stack_Ram(to_integer(unsigned(Mem_Addr(6 downto 0)))) <= Mem_Write;
+          end if;
         else
           -- Undefined.
         end if;
       end if;
+      -- A new rom starts in bank 1, like after power on
+      if Reset = '1' then
+        Rom_Bank_Low <= '0' & X"01";
+        Rom_Bank_High <= "00";
+        Mbc1_Mode <= '0';
+      end if;
     end if;
   end process;
 
@@ -268,12 +418,10 @@ begin
           -- since it is only three bytes before some data required
           -- by the boot-loader, it usually only contains the instruction
           -- JMP 0x150, which is where the predefined things end.
-          -- No writing allowed here!
-          Mem_Read <= Rom_Memory(to_integer(unsigned(Mem_Addr(14 downto 0))));
+          Mem_Read <= Read_Rom(Low_Bank * 16384 + to_integer(unsigned(Mem_Addr(13 downto 0))));
         elsif Mem_Addr(15 downto 14) = "01" then  -- 0x4000-0x7FFF
-          -- The addresses 4000-7FFF is switchable in som ROMS, implement!
-          -- No writing allowed here!
-          Mem_Read <= Rom_Memory(to_integer(unsigned(Mem_Addr(14 downto 0))));
+          -- The addresses 4000-7FFF is switchable in som ROMS.
+          Mem_Read <= Read_Rom(High_Bank * 16384 + to_integer(unsigned(Mem_Addr(13 downto 0))));
         elsif Mem_Addr(15 downto 13) = "100" then -- 0x8000-0x9FFF
           -- Character data. Send to GPU.
           -- Character codes (BG data 1). Send to GPU.
@@ -283,10 +431,10 @@ begin
           Mem_Read <= X"00";
         elsif Mem_Addr(15 downto 13) = "101" then -- 0xA000-0xBFFF
           -- External expansion working RAM 8KB.
-          Mem_Read <= External_Ram(to_integer(unsigned(Mem_Addr(12 downto 0))));
+          Mem_Read <= Read_External_Ram(Mem_Addr(12 downto 0));
         elsif Mem_Addr(15 downto 13) = "110" then  -- 0xC000-0xDFFF
           -- Unit working ram 8KB.
-          Mem_Read <= Internal_Ram(to_integer(unsigned(Mem_Addr(12 downto 0))));
+          Mem_Read <= Read_Internal_Ram(Mem_Addr(12 downto 0));
           -- Addresses 0xE000-0xFDFF are handled by the "else" case.
         elsif Mem_Addr(15 downto 8) = "11111110" then  -- 0xFE00-0xFE9F
           -- OAM memory, send to GPU.
@@ -295,6 +443,10 @@ begin
           Mem_Read <= X"00";
         elsif Mem_Addr(15 downto 0) = X"FF00" then
           Mem_Read <= "00" & Controller_Data_Select & Controller_Input;
+        elsif Mem_Addr(15 downto 0) = X"FF01" then
+          Mem_Read <= Serial_Data;
+        elsif Mem_Addr(15 downto 0) = X"FF02" then
+          Mem_Read <= Serial_Control(7) & "111111" & Serial_Control(0);
         elsif Mem_Addr(15 downto 0) = X"FF04" then
           --Timer reads
           Mem_Read <= Timer_Divider;
@@ -316,10 +468,10 @@ begin
           Mem_Read <= X"00";
         elsif Mem_Addr(15 downto 7) = "111111111" then  -- 0xFF80-0xFFFF
           -- Working stack and RAM.
-          Mem_Read <= Stack_Ram(to_integer(unsigned(Mem_Addr(6 downto 0))));
+          Mem_Read <= Read_Stack_Ram(Mem_Addr(6 downto 0));
         else
           -- Undefined value (mirror of internal ram).
-          Mem_Read <= Internal_Ram(to_integer(unsigned(Mem_Addr(12 downto 0))));
+          Mem_Read <= Read_Internal_Ram(Mem_Addr(12 downto 0));
         end if;
       end if;
     end if;
@@ -37,7 +37,7 @@ architecture Behavior_Bus_Cpu of Bus_Cpu_Test is
        Mem_Addr : in std_logic_vector(15 downto 0);
        Mem_Write_Enable : in std_logic;
        Rom_Write_Enable : in std_logic;
-       Rom_Addr : in std_logic_vector(15 downto 0);
+       Rom_Addr : in std_logic_vector(22 downto 0);
        Rom_Write : in std_logic_vector(7 downto 0));
   end component;
 
@@ -56,7 +56,7 @@ architecture Behavior_Bus_Cpu of Bus_Cpu_Test is
   signal Mem_Addr : std_logic_vector(15 downto 0) := X"0000";
   signal Mem_Write_Enable : std_logic := '0';
   signal Rom_Write_Enable : std_logic := '0';
-  signal Rom_Addr : std_logic_vector(15 downto 0);
+  signal Rom_Addr : std_logic_vector(22 downto 0);
   signal Rom_Write : std_logic_vector(7 downto 0);
 
   
@@ -102,18 +102,18 @@ begin
 
     Rom_Write <= X"3E";
     Rom_Write_Enable <= '1';
-    Rom_Addr <= X"0150";
+    Rom_Addr <= "000" & X"00150";
     wait until rising_edge(Clk);
 
-    Rom_Addr <= X"0151";
+    Rom_Addr <= "000" & X"00151";
     Rom_Write <= X"A0";
     wait until rising_edge(Clk);
 
-    Rom_Addr <= X"0152";
+    Rom_Addr <= "000" & X"00152";
     Rom_Write <= X"77";
     wait until rising_edge(Clk);
 
-    Rom_Addr <= X"0153";
+    Rom_Addr <= "000" & X"00153";
     Rom_Write <= X"3E";
     wait until rising_edge(Clk);
 
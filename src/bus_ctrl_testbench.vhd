@@ -37,7 +37,7 @@ architecture Behavior_Bus of Bus_Test is
        Mem_Addr : in std_logic_vector(15 downto 0);
        Mem_Write_Enable : in std_logic;
        Rom_Write_Enable : in std_logic;
-       Rom_Addr : in std_logic_vector(15 downto 0);
+       Rom_Addr : in std_logic_vector(22 downto 0);
        Rom_Write : in std_logic_vector(7 downto 0));
 
   end component;
@@ -47,7 +47,7 @@ architecture Behavior_Bus of Bus_Test is
   signal Mem_Addr : std_logic_vector(15 downto 0) := X"0000";
   signal Mem_Write_Enable : std_logic := '0';
   signal Rom_Write_Enable : std_logic := '0';
-  signal Rom_Addr : std_logic_vector(15 downto 0);
+  signal Rom_Addr : std_logic_vector(22 downto 0);
   signal Rom_Write : std_logic_vector(7 downto 0);
 
   
@@ -86,7 +86,7 @@ begin
 
     Rom_Write <= X"FF";
     Rom_Write_Enable <= '1';
-    Rom_Addr <= X"0150";
+    Rom_Addr <= "000" & X"00150";
     Mem_Addr <= X"0150";
     wait until rising_edge(Clk);
 
@@ -20,22 +20,19 @@ function run_test {
     dir=$2
     test_nr=$3
 
-    echo "Compiling ${dir}/${test_name}_test.vhd..."
-    ghdl -a --ieee=synopsys ${dir}/${name}_test.vhd || exit
-
     echo "Running test ${name}..."
 
     if [ ! -d ${dir}/stimulus ]
     then
 	echo Creating ${dir}/stimulus
 	mkdir ${dir}/stimulus
-	echo "feed.txt" > ${dir}/stimulus/.gitignore
+	echo "feed*.txt" > ${dir}/stimulus/.gitignore
     fi
     if [ ! -d ${dir}/results ]
     then
 	echo Creating ${dir}/results
 	mkdir ${dir}/results
-	echo "results.txt" > ${dir}/results/.gitignore
+	echo "results*.txt" > ${dir}/results/.gitignore
     fi
     
     if [ $# -gt 2 ]; then
@@ -25,8 +25,17 @@
 library ieee;
 use ieee.std_logic_1164.all;
 use IEEE.numeric_std.all;
+-- synthesis translate_off
+use ieee.std_logic_textio.all;
+use std.textio.all;
+-- synthesis translate_on
 
 entity Cpu is
+  --Only for the simulation: every opcode that gets to Exec or Mb_Exec is
+  --written to this file, one per line in hex with CB xx as CBxx and the
+  --clock it started on. Empty to not write anything, see
+  --tester/coverage.hpp.
+  generic (Trace_File : string := "");
   port(Clk, Reset : in std_logic;
        Mem_Write_External : out std_logic_vector(7 downto 0);
        Mem_Read : in std_logic_vector(7 downto 0);
@@ -37,7 +46,16 @@ entity Cpu is
        --joypad press
        --They have the same priority, ie: Vblank is handled first, LCD second etc.
        Interrupt_Requests : in std_logic_vector(7 downto 0);
-       Current_Interrupts : out std_logic_vector(7 downto 0));
+       Current_Interrupts : out std_logic_vector(7 downto 0);
+       --For the debug monitor in serial.vhd. While Stall is set the CPU
+       --does not start any new instructions (or interrupts). Idle is set
+       --between instructions when nothing else uses the bus, Current_PC is
+       --then the address of the next instruction.
+       Stall : in std_logic := '0';
+       Idle : out std_logic;
+       Current_PC : out std_logic_vector(15 downto 0);
+       --Set while the CPU waits for an interrupt after HALT
+       Is_Halted : out std_logic);
 end Cpu;
 
 architecture Cpu_Implementation of Cpu is
@@ -130,6 +148,11 @@ begin
   Mem_Write_External <= Mem_Write;
   Mem_Addr_External <= Mem_Addr;
   Mem_Write_Enable_External <= Mem_Write_Enable;
+
+  Idle <= '1' when (State = Waiting or State = Halted) and Mem_Write_Enable = '0'
+          and DMA_Addr = X"0000" and New_DMA_Addr = X"0000" else '0';
+  Current_PC <= PC;
+  Is_Halted <= '1' when State = Halted else '0';
   
   Alu_Ports : Alu port map(
     A => Alu_A,
@@ -237,13 +260,13 @@ begin
         case (State) is
           --interrupts are mainly handled here
           when Waiting | Halted =>
-            if State = Waiting then
+            if State = Waiting and Stall = '0' then
               if (unsigned(Waited_Clks) > 20) then
                 State <= Fetch;
                 Waited_Clks <= X"0000";
               end if;
             end if;
-            if Interrupts_Enabled = '1' then
+            if Interrupts_Enabled = '1' and Stall = '0' then
               Tmp(7 downto 0) := Interrupts_Queue and Interrupts_Enabled_Mask;
               Rst_Add_40 <= '1';
               if Tmp(0) = '1' then
@@ -3624,6 +3647,68 @@ begin
       end if;
     end if;
   end process;
-  
+
+  -- synthesis translate_off
+  -- Writes the opcodes to Trace_File on the same clock edges as the CPU
+  -- process executes them. IR is only overwritten in Exec, so it still
+  -- holds the opcode there. Each line also has the clock (counted from
+  -- when Reset is released) the instruction was fetched on, so that the
+  -- tester can tell how long it took. Interrupts have no fetch, they
+  -- start on the clock they are taken and the line ends with " irq".
+  Opcode_Trace : process (Clk)
+    variable Opened : boolean := false;
+    variable Status : file_open_status;
+    variable Trace_Line : line;
+    file Trace_Out : text;
+    variable Clocks, Start : natural := 0;
+    variable From_Irq, Executed : boolean := false;
+    variable Last_State : State_Type := Waiting;
+  begin
+    if rising_edge(Clk) and Trace_File /= "" then
+      --Open it at once, so that a test that executes nothing doesn't
+      --leave the trace of the last one
+      if not Opened then
+        file_open(Status, Trace_Out, Trace_File, write_mode);
+        assert Status = open_ok report "Couldn't open " & Trace_File severity failure;
+        Opened := true;
+      end if;
+
+      if Reset = '1' then
+        Clocks := 0;
+        Last_State := Waiting;
+      else
+        if Wait_Mode = '1' then
+          if State = Fetch then
+            Start := Clocks;
+            From_Irq := false;
+          elsif State = Exec and Last_State /= Fetch2 then
+            Start := Clocks;
+            From_Irq := true;
+          end if;
+
+          --10 and CB only get to Mb_Exec with the second byte
+          Executed := true;
+          if State = Exec and IR /= X"10" and IR /= X"CB" then
+            hwrite(Trace_Line, IR);
+          elsif State = Mb_Exec then
+            hwrite(Trace_Line, IR & MB_IR);
+          else
+            Executed := false;
+          end if;
+          if Executed then
+            write(Trace_Line, ' ');
+            write(Trace_Line, Start);
+            if From_Irq then
+              write(Trace_Line, string'(" irq"));
+            end if;
+            writeline(Trace_Out, Trace_Line);
+          end if;
+          Last_State := State;
+        end if;
+        Clocks := Clocks + 1;
+      end if;
+    end if;
+  end process;
+  -- synthesis translate_on
 
 end Cpu_Implementation;
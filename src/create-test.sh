@@ -13,13 +13,15 @@ if [ $# -lt 1 ]; then
 fi
 
 mkdir tests/${1}_test
-cp tests/sample_test/sample_test.vhd tests/${1}_test/${1}_test.vhd
-sed -i "s/HOWDAREYOUCALLMEFAT/${1}_Test/g" tests/${1}_test/${1}_test.vhd
-sed -i "s/YOUWONTGETTHEHORSE/${1}_test/g" tests/${1}_test/${1}_test.vhd
+# Every suite runs on suite_test.vhd, only the settings are per suite
+cp tests/sample_test/suite.txt tests/${1}_test/suite.txt
 mkdir tests/${1}_test/{results,stimulus}
 touch tests/${1}_test/{results,stimulus}/.gitignore
-echo "feed.txt" > tests/${1}_test/stimulus/.gitignore
-echo "results.txt" > tests/${1}_test/results/.gitignore
+echo "feed*.txt" > tests/${1}_test/stimulus/.gitignore
+echo "results*.txt" > tests/${1}_test/results/.gitignore
+echo "serial*.txt" >> tests/${1}_test/results/.gitignore
+echo "trace*.txt" >> tests/${1}_test/results/.gitignore
+echo "clocks*.txt" >> tests/${1}_test/results/.gitignore
 touch tests/${1}_test/${1}_test.stim
 echo "#This is where your code goes, dont forget:" >> tests/${1}_test/${1}_test.stim
 echo "#@prepare, @test { @check } for it to work:" >> tests/${1}_test/${1}_test.stim
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Runs every suite, measures how many clocks each opcode took and compares
+# that with the M-cycles of the real cpu (see instruction-listing/instructions -cy).
+# Run it from src/ after compile.sh, with tester/ built. The table is named
+# after the last commit that changed the cpu or the tests, so the workflow is:
+# commit the change, run this, then commit cycles/COMMIT.txt on its own.
+# With uncommitted .vhd or .stim changes the table is cycles/COMMIT-dirty.txt,
+# which isn't committed, to see what the change does before committing it.
+# Fails if an opcode has become slower than in the table of the commit before
+# that has one, and writes no table if any suite fails.
+
+function print_usage {
+    echo "Usage:"
+    echo "$0 [flags for instructions -cy, like -tol 20]"
+    exit
+}
+
+if [ "$1" = "-h" ]; then
+    print_usage
+fi
+
+table_dir=cycles
+commit=$(git rev-list --max-count=1 HEAD -- '*.vhd' '*.stim' | cut -c1-12)
+if [ -z "$commit" ]; then
+    echo "Error: No commit has changed the cpu or the tests"
+    exit 1
+fi
+first=${commit}~1
+#A table of uncommitted changes is compared with the one of the commit itself
+if ! git diff --quiet HEAD -- '*.vhd' '*.stim'; then
+    commit=${commit}-dirty
+    first=${commit%-dirty}
+fi
+
+mkdir -p build $table_dir
+coverage=build/cycle-coverage.txt
+rm -f $coverage
+for dir in tests/*_test; do
+    name=$(basename $dir)
+    #sample_test is only the template of create-test.sh
+    if [ -f $dir/$name.stim ] && [ $name != sample_test ]; then
+	echo "Running ${name}..."
+	#Clocks from a suite that fails, or never ran, mean nothing
+	if ! tester/tester -d $dir --coverage=$coverage > build/cycle-$name.txt; then
+	    echo "Error: $name failed, see build/cycle-$name.txt. No table written."
+	    exit 1
+	fi
+    fi
+done
+
+lister=instruction-listing/instructions
+if [ ! -x $lister ]; then
+    g++ -O2 -o $lister instruction-listing/instructions.cpp || exit 1
+fi
+
+previous=""
+for c in $(git rev-list --max-count=500 $first 2>/dev/null | cut -c1-12); do
+    if [ -f $table_dir/$c.txt ]; then
+	previous="-r $table_dir/$c.txt"
+	break
+    fi
+done
+
+$lister -i cpu.vhd -c $coverage -cy -so -o $table_dir/$commit.txt $previous "$@"
+status=$?
+grep "^# Total\|^# Slower\|^# [0-9a-f]* [0-9]* ->" $table_dir/$commit.txt
+echo "Table in: $table_dir/$commit.txt"
+exit $status
@@ -33,6 +33,9 @@ use IEEE.numeric_std.all;
 
 
 entity Gpu_Logic is
+    -- Keeps the video ram in a shared variable, see bus_controller.vhd.
+    -- Only for simulation.
+    Generic ( Sim_Memory : boolean := false);
     Port ( Clk,Rst : in  std_logic;
            vgaRed, vgaGreen : out  std_logic_vector (2 downto 0);
            vgaBlue : out  std_logic_vector (2 downto 1);
@@ -43,7 +46,11 @@ entity Gpu_Logic is
            Gpu_Addr : in std_logic_vector(15 downto 0);
            Gpu_Write_Enable : in std_logic;
            VBlank_Interrupt : out std_logic;
-           Stat_Interrupt : out std_logic);
+           Stat_Interrupt : out std_logic;
+           -- The row currently shown and its pixels, only used by the
+           -- testbenches to capture frames.
+           Frame_Row : out std_logic_vector(7 downto 0);
+           Frame_Row_High, Frame_Row_Low : out std_logic_vector(159 downto 0));
 end Gpu_Logic;
 
 architecture Behavioral of Gpu_Logic is
@@ -72,6 +79,9 @@ architecture Behavioral of Gpu_Logic is
   type Video_Ram_Type is array(8191 downto 0) of std_logic_vector(7 downto 0);
   signal Video_Ram : Video_Ram_Type := (others => X"00");  -- was F0
 
+  -- The video ram when Sim_Memory is set, see the drawing process
+  type Sim_Video_Ram_Type is array(0 to 8191) of integer range 0 to 255;
+
   -- 160 byte ram for OBJ, sprites
   type Obj_Ram_Type is array(79 downto 0) of std_logic_vector(7 downto 0);
   signal Obj_Ram_Even, Obj_Ram_Odd : Obj_Ram_Type := (others => X"00");  --was 15
@@ -157,6 +167,10 @@ begin
   
   Hsync <= Internal_Hsync;
   Vsync <= Internal_Vsync;
+
+  Frame_Row <= Current_Row;
+  Frame_Row_High <= Current_Row_Buffer_High;
+  Frame_Row_Low <= Current_Row_Buffer_Low;
   
   -- Process for outputting next scanline
   process (Clk)
@@ -243,6 +257,19 @@ begin
   process (Clk) is
     variable Sprite_Tmp_X : integer range 0 to 255;
     variable Sprite_Colour : std_logic_vector(1 downto 0) := B"00";
+    -- Only this process reads and writes it, and the write comes last on
+    -- the edge. So a byte written on the cycle it is read isn't seen until
+    -- the next one, like with the signal, whatever order the simulator
+    -- runs the processes in.
+    variable Video_Ram_Sim : Sim_Video_Ram_Type := (others => 0);
+
+    impure function Read_Video_Ram(Addr : std_logic_vector) return std_logic_vector is
+    begin
+      if Sim_Memory then
+        return std_logic_vector(to_unsigned(Video_Ram_Sim(to_integer(unsigned(Addr))), 8));
+      end if;
+      return Video_Ram(to_integer(unsigned(Addr)));
+    end Read_Video_Ram;
   begin
     if rising_edge(Clk) then
       -- Next_Screen also works as a reset for this process. See process above.
@@ -285,10 +312,10 @@ begin
             --and the sprite id, ie: sprite_id*16 + sprite_row
             --Select BG Char
             if LCD(4) = '0' then
-              Sprite_Row_Addr <= std_logic_vector(signed(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))))
+              Sprite_Row_Addr <= std_logic_vector(signed(Read_Video_Ram(Sprite_Row_Addr))
                                                   * 16 + signed(Bg_Sprite_Line_Offset) * 2 + 4096); 
             else
-              Sprite_Row_Addr <= std_logic_vector(unsigned(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))))
+              Sprite_Row_Addr <= std_logic_vector(unsigned(Read_Video_Ram(Sprite_Row_Addr))
                                                   * 16 + unsigned(Bg_Sprite_Line_Offset) * 2); 
             end if;
             state <= Read_Bg_C;
@@ -302,14 +329,14 @@ begin
               Next_Row_Buffer_Low(167 - to_integer(unsigned(Scroll_X) mod 8) downto 0) <= Next_Row_Buffer_Low(167 downto to_integer(unsigned(Scroll_X) mod 8));
             else
               --Flip the bits and shift right
-              Next_Row_Buffer_High(167 downto 160) <= reverse_any_vector(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))));
+              Next_Row_Buffer_High(167 downto 160) <= reverse_any_vector(Read_Video_Ram(Sprite_Row_Addr));
               Next_Row_Buffer_High(159 downto 0) <= Next_Row_Buffer_High(167 downto 8);
               State <= Read_Bg_D;
               Sprite_Row_Addr <= std_logic_vector(unsigned(Sprite_Row_Addr) + 1);
             end if;
           when Read_Bg_D =>
             --Flip the bits and shift right
-            Next_Row_Buffer_Low(167 downto 160) <= reverse_any_vector(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))));
+            Next_Row_Buffer_Low(167 downto 160) <= reverse_any_vector(Read_Video_Ram(Sprite_Row_Addr));
             Next_Row_Buffer_Low(159 downto 0) <= Next_Row_Buffer_Low(167 downto 8);
             Bg_Added <= std_logic_vector(unsigned(Bg_Added) + 1);
             State <= Read_Bg;
@@ -372,9 +399,9 @@ begin
             --Read the high data from vram and increase the sprite row addr
             --HFlip bit
             if Sprite_Options(5) = '0' then
-              Sprite_High_Data <= reverse_any_vector(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))));
+              Sprite_High_Data <= reverse_any_vector(Read_Video_Ram(Sprite_Row_Addr));
             else
-              Sprite_High_Data <= Video_Ram(to_integer(unsigned(Sprite_Row_Addr)));
+              Sprite_High_Data <= Read_Video_Ram(Sprite_Row_Addr);
             end if; 
             Sprite_Row_Addr <= std_logic_vector(unsigned(Sprite_Row_Addr) + 1);
             State <= Sprites_F;
@@ -382,9 +409,9 @@ begin
             --Read the low data from vram
             --HFlip bit
             if Sprite_Options(5) = '0' then
-              Sprite_Low_Data <= reverse_any_vector(Video_Ram(to_integer(unsigned(Sprite_Row_Addr))));
+              Sprite_Low_Data <= reverse_any_vector(Read_Video_Ram(Sprite_Row_Addr));
             else
-              Sprite_Low_Data <= Video_Ram(to_integer(unsigned(Sprite_Row_Addr)));
+              Sprite_Low_Data <= Read_Video_Ram(Sprite_Row_Addr);
             end if; 
             State <= Sprites_G;
             Sprite_Pixel_Counter <= X"00";
@@ -424,6 +451,11 @@ begin
             end if;
         end case;
       end if;
+
+      -- The writes of the process below, after the reads above
+      if Sim_Memory and Rst = '0' and Gpu_Write_Enable = '1' and Gpu_Addr < X"A000" then
+        Video_Ram_Sim(to_integer(unsigned(Gpu_Addr(13 downto 0)))) := to_integer(unsigned(Gpu_Write));
+      end if;
     end if;
   end process;
   
@@ -442,8 +474,10 @@ begin
         Obj_Palette_1 <= X"FF";
       elsif Gpu_Write_Enable = '1' then
         if Gpu_Addr < X"A000" then
-          -- Starts at 0x8000
-          Video_Ram(to_integer(unsigned(Gpu_Addr(13 downto 0)))) <= Gpu_Write;
+          -- Starts at 0x8000. With Sim_Memory the drawing process writes it.
+          if not Sim_Memory then
+            Video_Ram(to_integer(unsigned(Gpu_Addr(13 downto 0)))) <= Gpu_Write;
+          end if;
         elsif Gpu_Addr < X"FEA0" then
           -- Starts at 0xFE00.
           if Gpu_Addr(0) = '0' then
@@ -5,6 +5,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <sstream>
+#include <map>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,7 +17,7 @@ string trim(const string &s);
 
 class Instr {
 public:
-  Instr() {}
+  Instr() : opcode(0), tested(false), hits(-1), minClocks(0), maxClocks(0) {}
   Instr(const string &opcode, const string &comment) {
     this->opcode = strtol(opcode.c_str(), 0, 16);
     if (comment.substr(comment.size() - 2) == "-t") {
@@ -26,10 +27,16 @@ public:
       tested = false;
       mnemonic = comment;
     }
+    hits = -1;
+    minClocks = maxClocks = 0;
   }
   string mnemonic;
   int opcode;
   bool tested;
+  // How often the tests executed it, -1 if we don't know.
+  int hits;
+  // The fewest and most clocks it took, 0 if it wasn't timed.
+  int minClocks, maxClocks;
 };
 
 typedef std::vector<Instr> Instructions;
@@ -116,6 +123,43 @@ Instructions parseFile(const string &filename) {
   return r;
 }
 
+// Reads what tester --coverage recorded, lines of "suite test opcode hits
+// min max". The tested flag then says whether any test executed the opcode
+// instead of what the comments in cpu.vhd say.
+bool applyCoverage(const string &filename, Instructions &instr) {
+  ifstream read(filename.c_str());
+  if (!read) return false;
+
+  map<int, Instr> found;
+  string line;
+  while (getline(read, line)) {
+    istringstream ss(line.substr(0, line.find('#')));
+    string suite;
+    int test, opcode, count, minClocks = 0, maxClocks = 0;
+    if (!(ss >> suite >> test >> hex >> opcode >> dec >> count)) continue;
+    ss >> minClocks >> maxClocks;
+
+    Instr &f = found[opcode];
+    f.hits = (f.hits < 0 ? 0 : f.hits) + count;
+    if (maxClocks > 0) {
+      if (f.maxClocks == 0 || minClocks < f.minClocks) f.minClocks = minClocks;
+      f.maxClocks = max(f.maxClocks, maxClocks);
+    }
+  }
+
+  for (Instructions::iterator i = instr.begin(); i != instr.end(); i++) {
+    map<int, Instr>::const_iterator f = found.find(i->opcode);
+    i->hits = 0;
+    if (f != found.end()) {
+      i->hits = f->second.hits;
+      i->minClocks = f->second.minClocks;
+      i->maxClocks = f->second.maxClocks;
+    }
+    i->tested = i->hits > 0;
+  }
+  return true;
+}
+
 void fill(ostringstream &s, int width) {
   int toInsert = width - s.str().size();
   while (toInsert > 0) {
@@ -124,8 +168,150 @@ void fill(ostringstream &s, int width) {
   }
 }
 
+// M-cycles of the SM83 (the Game Boy CPU), from the opcode tables in
+// manuals/. Conditional jumps, calls and returns take fewer when the
+// condition doesn't hold, that is in notTaken. 0 is no such opcode.
+const int mCycles[256] = {
+  1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1,
+  1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+  3, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+  3, 3, 2, 2, 3, 3, 3, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+  5, 3, 4, 4, 6, 4, 2, 4, 5, 4, 4, 0, 6, 6, 2, 4,
+  5, 3, 4, 0, 6, 4, 2, 4, 5, 4, 4, 0, 6, 0, 2, 4,
+  3, 3, 2, 0, 0, 4, 2, 4, 4, 1, 4, 0, 0, 0, 2, 4,
+  3, 3, 2, 1, 0, 4, 2, 4, 3, 2, 4, 1, 0, 0, 2, 4,
+};
+
+int notTaken(int opcode) {
+  switch (opcode) {
+  case 0x20: case 0x28: case 0x30: case 0x38: // JR cc
+  case 0xC0: case 0xC8: case 0xD0: case 0xD8: // RET cc
+    return 2;
+  case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP cc
+  case 0xC4: case 0xCC: case 0xD4: case 0xDC: // CALL cc
+    return 3;
+  }
+  return mCycles[opcode];
+}
+
+// The M-cycles of opcode (like in the trace, CB xx is 0xCBxx), false if it
+// has no time of its own. The prefixes are counted in the opcode after them.
+bool sm83Cycles(int opcode, int &least, int &most) {
+  if (opcode == 0x10 || opcode == 0xCB) return false;
+  if (opcode < 0x100) {
+    most = mCycles[opcode];
+    least = notTaken(opcode);
+  } else if (opcode == 0x1000) {
+    // STOP
+    least = most = 1;
+  } else if ((opcode >> 8) == 0xCB) {
+    // (HL) takes two more to read and write it back, BIT only reads it
+    int reg = opcode & 0x07;
+    bool bit = (opcode & 0xC0) == 0x40;
+    least = most = reg != 6 ? 2 : (bit ? 3 : 4);
+  } else {
+    return false;
+  }
+  return most > 0;
+}
+
+// "12" or "12-15"
+string range(int least, int most) {
+  ostringstream s;
+  s << least;
+  if (most != least) s << "-" << most;
+  return s.str();
+}
+
+// Reads a table written by outputCycles, the most clocks of each opcode.
+map<int, int> readCycles(const string &filename) {
+  ifstream read(filename.c_str());
+  map<int, int> r;
+  string line;
+  while (getline(read, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    istringstream ss(line);
+    int opcode;
+    string mCycles, expected, measured;
+    if (!(ss >> hex >> opcode >> mCycles >> expected >> measured)) continue;
+    if (measured == "-") continue;
+    string::size_type dash = measured.find('-');
+    r[opcode] = atoi(dash == string::npos ? measured.c_str() : measured.c_str() + dash + 1);
+  }
+  return r;
+}
+
+// Compares the clocks from applyCoverage with the M-cycles of the SM83,
+// clocksPerCycle clocks of ours to one of those. FAST and SLOW are those
+// more than tolerance off. Opcodes that take more clocks than in previous
+// (if there is one) are listed after the table, returns how many did.
+int outputCycles(const Instructions &instr, double clocksPerCycle, double tolerance,
+		 const map<int, int> &previous, ostream &to) {
+  const int cols[] = { 6, 16, 28, 40, 48 };
+  to << "# Clocks from one fetch to the next, " << clocksPerCycle << " clocks per M-cycle, ";
+  to << tolerance * 100 << "% tolerance" << endl;
+  to << "# opcode m-cycles expected measured verdict mnemonic" << endl;
+
+  int counts[4] = { 0, 0, 0, 0 };
+  const char *verdicts[] = { "ok", "FAST", "SLOW", "untimed" };
+  vector<string> slower;
+  for (Instructions::const_iterator i = instr.begin(); i != instr.end(); i++) {
+    int least, most;
+    if (!sm83Cycles(i->opcode, least, most)) continue;
+
+    ostringstream line;
+    line << setw(2) << setfill('0') << hex << i->opcode << dec;
+    fill(line, cols[0]);
+    line << range(least, most);
+    fill(line, cols[1]);
+    int low = int(least * clocksPerCycle + 0.5), high = int(most * clocksPerCycle + 0.5);
+    line << range(low, high);
+    fill(line, cols[2]);
+
+    int verdict = 3;
+    if (i->maxClocks > 0) {
+      line << range(i->minClocks, i->maxClocks);
+      if (i->maxClocks > high * (1 + tolerance)) verdict = 2;
+      else if (i->minClocks < low * (1 - tolerance)) verdict = 1;
+      else verdict = 0;
+    } else {
+      line << "-";
+    }
+    counts[verdict]++;
+    fill(line, cols[3]);
+    line << verdicts[verdict];
+    fill(line, cols[4]);
+    line << i->mnemonic;
+    to << line.str() << endl;
+
+    map<int, int>::const_iterator p = previous.find(i->opcode);
+    if (p != previous.end() && i->maxClocks > p->second) {
+      ostringstream s;
+      s << hex << i->opcode << dec << " " << p->second << " -> " << i->maxClocks << " " << i->mnemonic;
+      slower.push_back(s.str());
+    }
+  }
+  to << "# Total: " << counts[0] << " ok, " << counts[1] << " too fast, " << counts[2] << " too slow, ";
+  to << counts[3] << " not timed." << endl;
+
+  for (size_t i = 0; i < slower.size(); i++) {
+    if (i == 0) to << "# Slower than before:" << endl;
+    to << "# " << slower[i] << endl;
+  }
+  return slower.size();
+}
+
 void outputList(const Instructions &instr, ostream &to) {
-  const int cols[] = { 5, 13 };
+  const int cols[] = { 5, 13, 23 };
+  bool withHits = !instr.empty() && instr.front().hits >= 0;
   int testedOpCodes = 0;
   for (Instructions::const_iterator i = instr.begin(); i != instr.end(); i++) {
     ostringstream line;
@@ -136,10 +322,16 @@ void outputList(const Instructions &instr, ostream &to) {
       testedOpCodes++;
     }
     fill(line, cols[1]);
+    if (withHits) {
+      line << dec << i->hits;
+      fill(line, cols[2]);
+    }
     line << i->mnemonic;
     to << line.str() << endl;
   }
-  to << "Total: " << testedOpCodes << " of " << instr.size() << " opcodes tested." << endl;
+  to << "Total: " << testedOpCodes << " of " << instr.size() << " opcodes tested";
+  if (withHits) to << " (executed by a test)";
+  to << "." << endl;
 }
 
 bool opcodeComp(const Instr &a, const Instr &b) {
@@ -157,6 +349,11 @@ bool testComp(const Instr &a, const Instr &b) {
 int main(int argc, char *argv[]) {
   string file = "cpu.vhd";
   string outputFile = "implemented_op_codes.txt";
+  string coverageFile = "";
+  string previousFile = "";
+  bool cycles = false;
+  double clocksPerCycle = 100.0 / 4.194304 * 4;
+  double tolerance = 0.1;
   //  string outputFile = "";
 
   enum Sort {
@@ -171,6 +368,16 @@ int main(int argc, char *argv[]) {
       file = argv[++i];
     } else if (strcmp(argv[i], "-o") == 0) {
       outputFile = argv[++i];
+    } else if (strcmp(argv[i], "-c") == 0) {
+      coverageFile = argv[++i];
+    } else if (strcmp(argv[i], "-cy") == 0) {
+      cycles = true;
+    } else if (strcmp(argv[i], "-mc") == 0) {
+      clocksPerCycle = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-tol") == 0) {
+      tolerance = atof(argv[++i]) / 100;
+    } else if (strcmp(argv[i], "-r") == 0) {
+      previousFile = argv[++i];
     } else if (strcmp(argv[i], "-so") == 0) {
       sort = sOpcode;
     } else if (strcmp(argv[i], "-st") == 0) {
@@ -181,11 +388,23 @@ int main(int argc, char *argv[]) {
       cout << "-o  - specifies output file (default is stdout)" << endl;
       cout << "-so - sort output by op-codes" << endl;
       cout << "-st - sort output by tested status" << endl;
+      cout << "-c  - coverage file from tester --coverage, marks the opcodes the" << endl;
+      cout << "      tests executed as tested and shows how often they did" << endl;
+      cout << "-cy - with -c, list the clocks each opcode took next to the M-cycles of" << endl;
+      cout << "      the SM83 instead, and mark those that are too FAST or too SLOW" << endl;
+      cout << "-mc - clocks per M-cycle for -cy, 95.37 (100 MHz for 4.19 MHz) by default" << endl;
+      cout << "-tol - how many percent off -cy lets an opcode be, 10 by default" << endl;
+      cout << "-r  - an earlier -cy table, opcodes that got slower since then are listed" << endl;
+      cout << "      and the exit code is 1" << endl;
       return 0;
     }
   }
   
   Instructions i = parseFile(file);
+  if (coverageFile != "" && !applyCoverage(coverageFile, i)) {
+    cout << "Couldn't read " << coverageFile << endl;
+    return 1;
+  }
 
   switch (sort) {
   case sNone:
@@ -201,6 +420,24 @@ int main(int argc, char *argv[]) {
   }
     //    cout << iNrOfTests << " out of " << iImplementedOps << " are being tested"
    //	 << endl;
+  if (cycles) {
+    if (coverageFile == "") {
+      cout << "-cy needs the clocks from -c" << endl;
+      return 1;
+    }
+    map<int, int> previous;
+    if (previousFile != "") previous = readCycles(previousFile);
+    int slower;
+    if (outputFile == "") {
+      slower = outputCycles(i, clocksPerCycle, tolerance, previous, cout);
+    } else {
+      ofstream f(outputFile.c_str());
+      slower = outputCycles(i, clocksPerCycle, tolerance, previous, f);
+    }
+    if (slower > 0) cout << slower << " opcodes are slower than in " << previousFile << endl;
+    return slower > 0 ? 1 : 0;
+  }
+
   if (outputFile == "") {
     outputList(i, cout);
   } else {
@@ -21,7 +21,6 @@
 --INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
 --STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
 --OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
 library ieee;
 use ieee.std_logic_1164.all;
 use ieee.std_logic_textio.all;
@@ -30,29 +29,82 @@ use ieee.numeric_std.all;
 library std;
 use std.textio.all;
 
+-- Runs a rom, see test_rom.sh and the romrunner in tester/.
+-- The generics can be set from ghdl with -gName=Value, this way
+-- several roms can be simulated at the same time.
 entity Rom_Test  is
+  generic (Rom_File : string := "roms/rom.txt";
+           Result_File : string := "roms/result.txt";
+           -- Stop after this many frames (VBlank interrupts), 0 means
+           -- that Cycles is used instead.
+           Frames : integer := 0;
+           Cycles : integer := 1850000;
+           -- Every frame drawn is appended here, 160x144 pixels with
+           -- 2 bits each, four pixels per byte with the leftmost pixel in
+           -- the high bits. Empty to not capture anything.
+           Framebuffer_File : string := "";
+           -- Bytes sent through the serial port (written to 0xFF01 and
+           -- then started with 0x81 to 0xFF02) are appended here as text,
+           -- this is how test roms like Blargg's report their results.
+           -- Empty to not capture anything.
+           Serial_File : string := "";
+           -- Size of the rom in 16K banks, see bus_controller.vhd. The
+           -- romrunner sets it from the size of the rom file.
+           Rom_Banks : integer := 2;
+           -- Keep the rom and the rams in shared variables, see
+           -- bus_controller.vhd. False simulates the memories exactly as
+           -- they are synthesized, which is a lot slower.
+           Sim_Memory : boolean := true);
 end Rom_Test;
 
 architecture Behavior of Rom_Test is
 -- Component Decalaration
 
   component Bus_Controller
+    generic (Rom_Banks : integer;
+             Sim_Memory : boolean);
     port(Clk, Reset : in std_logic;
          Mem_Write : in std_logic_vector(7 downto 0);
          Mem_Read : out std_logic_vector(7 downto 0);
          Mem_Addr : in std_logic_vector(15 downto 0);
          Mem_Write_Enable : in std_logic;
+         Gpu_Write : out std_logic_vector(7 downto 0);
+         Gpu_Read : in std_logic_vector(7 downto 0);
+         Gpu_Addr : out std_logic_vector(15 downto 0);
+         Gpu_Write_Enable : out std_logic;
          Rom_Write_Enable : in std_logic;
-         Rom_Addr : in std_logic_vector(15 downto 0);
-         Rom_Write : in std_logic_vector(7 downto 0));
+         Rom_Addr : in std_logic_vector(22 downto 0);
+         Rom_Write : in std_logic_vector(7 downto 0);
+         Timer_Interrupt : out std_logic;
+         Pulse, Latch  : out std_logic;
+         Data : in std_logic;
+         Current_Interrupts : in std_logic_vector(7 downto 0));
   end component;
 
   component Cpu
     port(Clk, Reset : in std_logic;
-         Mem_Write : out std_logic_vector(7 downto 0);
+         Mem_Write_External : out std_logic_vector(7 downto 0);
          Mem_Read : in std_logic_vector(7 downto 0);
-         Mem_Addr : out std_logic_vector(15 downto 0);
-         Mem_Write_Enable : out std_logic);
+         Mem_Addr_External : out std_logic_vector(15 downto 0);
+         Mem_Write_Enable_External : out std_logic;
+         Interrupt_Requests : in std_logic_vector(7 downto 0);
+         Current_Interrupts : out std_logic_vector(7 downto 0));
+  end component;
+
+  component Gpu_Logic
+    generic (Sim_Memory : boolean);
+    port ( Clk,Rst : in  std_logic;
+           vgaRed, vgaGreen : out  std_logic_vector (2 downto 0);
+           vgaBlue : out  std_logic_vector (2 downto 1);
+           Hsync,Vsync : out  std_logic;
+           Gpu_Write : in std_logic_vector(7 downto 0);
+           Gpu_Read : out std_logic_vector(7 downto 0);
+           Gpu_Addr : in std_logic_vector(15 downto 0);
+           Gpu_Write_Enable : in std_logic;
+           VBlank_Interrupt : out std_logic;
+           Stat_Interrupt : out std_logic;
+           Frame_Row : out std_logic_vector(7 downto 0);
+           Frame_Row_High, Frame_Row_Low : out std_logic_vector(159 downto 0));
   end component;
   
   signal Clk, Reset, Bus_Reset : std_logic;
@@ -61,45 +113,185 @@ architecture Behavior of Rom_Test is
   signal Mem_Addr, Cpu_Mem_Addr : std_logic_vector(15 downto 0) := X"0000";
   signal Mem_Write_Enable, Cpu_Mem_Write_Enable : std_logic := '0';
   signal Rom_Write_Enable : std_logic := '0';
-  signal Rom_Addr : std_logic_vector(15 downto 0);
+  signal Rom_Addr : std_logic_vector(22 downto 0);
   signal Rom_Write : std_logic_vector(7 downto 0);
   
   signal Cpu_Allowed : std_logic;
   signal Internal_Mem_Addr : std_logic_vector(15 downto 0);
   signal Internal_Mem_Write : std_logic_vector(7 downto 0);
   signal Internal_Mem_Write_Enable : std_logic := '0';
+
+  signal Gpu_Write : std_logic_vector(7 downto 0);
+  signal Gpu_Read : std_logic_vector(7 downto 0);
+  signal Gpu_Addr : std_logic_vector(15 downto 0);
+  signal Gpu_Write_Enable : std_logic;
+  signal Interrupt_Requests : std_logic_vector(7 downto 0) := X"00";
+  signal Current_Interrupts : std_logic_vector(7 downto 0);
+
+  --Dummy signals, these arent used
+  signal vgaRed, vgaGreen : std_logic_vector(2 downto 0);
+  signal vgaBlue : std_logic_vector(2 downto 1);
+  signal Hsync, Vsync : std_logic;
+  signal Pulse, Latch : std_logic;
+
+  signal Frame_Row : std_logic_vector(7 downto 0);
+  signal Frame_Row_High, Frame_Row_Low : std_logic_vector(159 downto 0);
+  type Char_File is file of character;
+
+  -- Number of VBlanks seen since the cpu was started
+  signal Frame_Count : integer := 0;
+  -- Stops the clock, and with it the simulation, when the ram is dumped
+  signal Sim_Done : std_logic := '0';
   
 begin
 -- compnent instantiation
-  Bus_Ports : Bus_Controller port map(
+  Bus_Ports : Bus_Controller generic map (Rom_Banks => Rom_Banks, Sim_Memory => Sim_Memory) port map(
     Clk => Clk,
     Reset => Bus_Reset,
     Mem_Write => Mem_Write,
     Mem_Read => Mem_Read,
     Mem_Addr => Mem_Addr,
     Mem_Write_Enable => Mem_Write_Enable,
+    Gpu_Write => Gpu_Write,
+    Gpu_Read => Gpu_Read,
+    Gpu_Addr => Gpu_Addr,
+    Gpu_Write_Enable => Gpu_Write_Enable,
     Rom_Write_Enable => Rom_Write_Enable,
     Rom_Addr => Rom_Addr,
-    Rom_Write => Rom_Write);
+    Rom_Write => Rom_Write,
+    Timer_Interrupt => Interrupt_Requests(2),
+    Pulse => Pulse,
+    Latch => Latch,
+    Data => '1',
+    Current_Interrupts => Current_Interrupts);
 
   Cpu_Ports : Cpu port map(
     Clk => Clk,
     Reset => Reset,
-    Mem_Write => Cpu_Mem_Write,
-    --Mem_Write => Mem_Write,
+    Mem_Write_External => Cpu_Mem_Write,
     Mem_Read => Mem_Read,
-    Mem_Addr => Cpu_Mem_Addr,
-    Mem_Write_Enable => Cpu_Mem_Write_Enable);
-    --Mem_Write_Enable => Mem_Write_Enable);
+    Mem_Addr_External => Cpu_Mem_Addr,
+    Mem_Write_Enable_External => Cpu_Mem_Write_Enable,
+    Interrupt_Requests => Interrupt_Requests,
+    Current_Interrupts => Current_Interrupts);
+
+  Gpu_Ports : Gpu_Logic generic map (Sim_Memory => Sim_Memory) port map(
+    Clk => Clk,
+    Rst => Reset,
+    vgaRed => vgaRed,
+    vgaGreen => vgaGreen,
+    vgaBlue => vgaBlue,
+    Hsync => Hsync,
+    Vsync => Vsync,
+    Gpu_Write => Gpu_Write,
+    Gpu_Read => Gpu_Read,
+    Gpu_Addr => Gpu_Addr,
+    Gpu_Write_Enable => Gpu_Write_Enable,
+    VBlank_Interrupt => Interrupt_Requests(0),
+    Stat_Interrupt => Interrupt_Requests(1),
+    Frame_Row => Frame_Row,
+    Frame_Row_High => Frame_Row_High,
+    Frame_Row_Low => Frame_Row_Low);
   
   Clk_Gen : process
   begin
-    while (true) loop
+    while Sim_Done = '0' loop
       Clk <= '0';
       wait for 5 ns;
       Clk <= '1';
       wait for 5 ns;
     end loop;
+    wait;
+  end process;
+
+  -- Counts frames while the cpu is running
+  Frame_Counter : process (Clk)
+  begin
+    if rising_edge(Clk) then
+      if Reset = '1' then
+        Frame_Count <= 0;
+      elsif Interrupt_Requests(0) = '1' then
+        Frame_Count <= Frame_Count + 1;
+      end if;
+    end if;
+  end process;
+  
+  -- Saves the rows as they are shown on the screen. A row is saved when
+  -- the gpu moves on to the next one, so that we get what was actually
+  -- displayed, and the frame is written when the last row is done.
+  Frame_Capture : process (Clk)
+    type Frame_Type is array(0 to 143) of std_logic_vector(159 downto 0);
+    variable Frame_High, Frame_Low : Frame_Type;
+    variable Last_Row : integer range 0 to 255 := 0;
+    variable Opened : boolean := false;
+    variable Status : file_open_status;
+    variable Packed : integer range 0 to 255;
+    variable Shade : integer range 0 to 3;
+    file Fb_File : Char_File;
+  begin
+    if rising_edge(Clk) and Framebuffer_File /= "" and Reset = '0' then
+      if not Opened then
+        file_open(Status, Fb_File, Framebuffer_File, write_mode);
+        assert Status = open_ok report "Couldn't open " & Framebuffer_File severity failure;
+        Opened := true;
+      end if;
+
+      if to_integer(unsigned(Frame_Row)) /= Last_Row then
+        if Last_Row < 144 then
+          Frame_High(Last_Row) := Frame_Row_High;
+          Frame_Low(Last_Row) := Frame_Row_Low;
+        end if;
+
+        if Last_Row = 143 then
+          for Y in 0 to 143 loop
+            for X in 0 to 39 loop
+              Packed := 0;
+              for P in 0 to 3 loop
+                Shade := 0;
+                if Frame_High(Y)(X * 4 + P) = '1' then
+                  Shade := 2;
+                end if;
+                if Frame_Low(Y)(X * 4 + P) = '1' then
+                  Shade := Shade + 1;
+                end if;
+                Packed := Packed * 4 + Shade;
+              end loop;
+              write(Fb_File, character'val(Packed));
+            end loop;
+          end loop;
+        end if;
+        Last_Row := to_integer(unsigned(Frame_Row));
+      end if;
+    end if;
+  end process;
+  
+  -- Writes every byte the cpu sends through the serial port. The file is
+  -- opened and closed for each byte so that it can be read while the
+  -- simulation is still running.
+  Serial_Capture : process (Clk)
+    variable Cleared : boolean := false;
+    variable Status : file_open_status;
+    variable Serial_Data : std_logic_vector(7 downto 0) := X"00";
+    file Serial_Out : Char_File;
+  begin
+    if rising_edge(Clk) and Serial_File /= "" then
+      if not Cleared then
+        file_open(Status, Serial_Out, Serial_File, write_mode);
+        assert Status = open_ok report "Couldn't open " & Serial_File severity failure;
+        file_close(Serial_Out);
+        Cleared := true;
+      end if;
+
+      if Reset = '0' and Cpu_Allowed = '1' and Mem_Write_Enable = '1' then
+        if Mem_Addr = X"FF01" then
+          Serial_Data := Mem_Write;
+        elsif Mem_Addr = X"FF02" and Mem_Write = X"81" then
+          file_open(Status, Serial_Out, Serial_File, append_mode);
+          write(Serial_Out, character'val(to_integer(unsigned(Serial_Data))));
+          file_close(Serial_Out);
+        end if;
+      end if;
+    end if;
   end process;
   
   Mem_Addr <= Cpu_Mem_Addr when Cpu_Allowed = '1' else
@@ -115,9 +307,10 @@ begin
   Stimuli_Generator : process
     variable In_Line, Out_Line : line;
     variable Curr_Addr : std_logic_vector(15 downto 0) := X"0000";
+    variable Rom_Index : integer := 0;
     variable Data_Byte : std_logic_vector(7 downto 0);
-    file In_File : text open read_mode is "roms/rom.txt";
-    file Out_File : text open write_mode is "roms/result.txt";
+    file In_File : text open read_mode is Rom_File;
+    file Out_File : text open write_mode is Result_File;
   begin
     Cpu_Allowed <= '1';
   --writes one byte at a time to the memory
@@ -139,9 +332,10 @@ begin
       
       wait until rising_edge(Clk);
 
-      if Curr_Addr < X"8000" then
+      if Rom_Index < Rom_Banks * 16384 then
         Rom_Write <= std_logic_vector(Data_Byte(7 downto 0));
-        Rom_Addr <= Curr_Addr;
+        Rom_Addr <= std_logic_vector(to_unsigned(Rom_Index, 23));
+        Rom_Index := Rom_Index + 1;
         Curr_Addr := std_logic_vector(unsigned(Curr_Addr) + 1);
         Rom_Write_Enable <= '1';
       else
@@ -161,10 +355,17 @@ begin
     Reset <= '0';
     Cpu_Allowed <= '1';
     wait until rising_edge(Clk);
-    
-    for I in 1 to 1850000 loop
-      wait until rising_edge(Clk);
-    end loop; 
+
+    if Frames > 0 then
+      -- Stop as soon as the rom has drawn what it should
+      while Frame_Count < Frames loop
+        wait until rising_edge(Clk);
+      end loop;
+    else
+      for I in 1 to Cycles loop
+        wait until rising_edge(Clk);
+      end loop;
+    end if;
     
     Cpu_Allowed <= '0';
     wait until rising_edge(Clk);
@@ -176,7 +377,7 @@ begin
       Internal_Mem_Addr <= std_logic_vector(Curr_Addr);
       
       wait until rising_edge(Clk);
-      --wait until rising_edge(Clk);
+      wait until rising_edge(Clk);
       
       Data_Byte(7 downto 0) := Mem_Read(7 downto 0);
       Curr_Addr := std_logic_vector(unsigned(Curr_Addr) + 1);
@@ -185,7 +386,8 @@ begin
       
       write(Out_Line, Data_Byte);
       writeline(Out_File, Out_Line);
-    end  loop;        
+    end  loop;
+    Sim_Done <= '1';
     wait;      
   end process;
   
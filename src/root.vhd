@@ -32,7 +32,8 @@ entity Root is
         vgaRed, vgaGreen : out std_logic_vector(2 downto 0);
         vgaBlue : out std_logic_vector(2 downto 1);
         Hsync, Vsync : out std_logic;
-        RxD, TxD : in  std_logic;
+        RxD : in  std_logic;
+        TxD : out std_logic;
         Led : out std_logic_vector(7 downto 0);
         Timer_Interrupt : out std_logic;
         Pulse, Latch  : out std_logic;
@@ -50,7 +51,9 @@ architecture Behavioural of Root is
            Gpu_Addr : in std_logic_vector(15 downto 0);
            Gpu_Write_Enable : in std_logic;
            VBlank_Interrupt : out std_logic;
-           Stat_Interrupt : out std_logic);
+           Stat_Interrupt : out std_logic;
+           Frame_Row : out std_logic_vector(7 downto 0);
+           Frame_Row_High, Frame_Row_Low : out std_logic_vector(159 downto 0));
   end component;
 
   component Cpu
@@ -60,7 +63,10 @@ architecture Behavioural of Root is
          Mem_Addr_External : out std_logic_vector(15 downto 0);
          Mem_Write_Enable_External : out std_logic;
          Interrupt_Requests : in std_logic_vector(7 downto 0);
-         Current_Interrupts : out std_logic_vector(7 downto 0));
+         Current_Interrupts : out std_logic_vector(7 downto 0);
+         Stall : in std_logic;
+         Idle : out std_logic;
+         Current_PC : out std_logic_vector(15 downto 0));
   end component;
 
   component Bus_Controller
@@ -76,7 +82,7 @@ architecture Behavioural of Root is
           Gpu_Write_Enable : out std_logic;
           -- These three signals writes to the large rom.
           Rom_Write_Enable : in std_logic;
-          Rom_Addr : in std_logic_vector(15 downto 0);
+          Rom_Addr : in std_logic_vector(22 downto 0);
           Rom_Write : in std_logic_vector(7 downto 0);
           -- Timer Interrupts
           Timer_Interrupt : out std_logic;
@@ -86,12 +92,21 @@ architecture Behavioural of Root is
   end component;
 
   component Serial
-    Port ( Clk , Rst, RxD, TxD : in  std_logic;
+    Port ( Clk , Rst, RxD : in  std_logic;
+           TxD : out std_logic;
            Led : out std_logic_vector(7 downto 0);
            Rom_Write_Enable : out std_logic;
-           Rom_Addr : out std_logic_vector(15 downto 0);
+           Rom_Addr : out std_logic_vector(22 downto 0);
            Rom_Write : out std_logic_vector(7 downto 0);
-           Rst_Cpu : out std_logic);
+           Rst_Cpu : out std_logic;
+           Cpu_Stall : out std_logic;
+           Cpu_Idle : in std_logic;
+           Cpu_PC : in std_logic_vector(15 downto 0);
+           Mon_Bus : out std_logic;
+           Mon_Addr : out std_logic_vector(15 downto 0);
+           Mon_Write : out std_logic_vector(7 downto 0);
+           Mon_Write_Enable : out std_logic;
+           Mon_Read : in std_logic_vector(7 downto 0));
   end component;
   
   --Local signals
@@ -99,8 +114,19 @@ architecture Behavioural of Root is
   signal Mem_Read : std_logic_vector(7 downto 0);
   signal Mem_Addr : std_logic_vector(15 downto 0);
   signal Mem_Write_Enable : std_logic;
+  --What the cpu wants on the bus, the debug monitor takes over when
+  --Mon_Bus is set
+  signal Cpu_Mem_Write : std_logic_vector(7 downto 0);
+  signal Cpu_Mem_Addr : std_logic_vector(15 downto 0);
+  signal Cpu_Mem_Write_Enable : std_logic;
+  signal Mon_Bus : std_logic := '0';
+  signal Mon_Write : std_logic_vector(7 downto 0);
+  signal Mon_Addr : std_logic_vector(15 downto 0);
+  signal Mon_Write_Enable : std_logic := '0';
+  signal Cpu_Stall, Cpu_Idle : std_logic;
+  signal Cpu_PC : std_logic_vector(15 downto 0);
   signal Rom_Write_Enable : std_logic := '0';
-  signal Rom_Addr : std_logic_vector(15 downto 0) := X"0000";
+  signal Rom_Addr : std_logic_vector(22 downto 0) := (others => '0');
   signal Rom_Write : std_logic_vector(7 downto 0) := X"00";
 
   signal Gpu_Write : std_logic_vector(7 downto 0);
@@ -128,17 +154,27 @@ begin
     Gpu_Addr => Gpu_Addr,
     Gpu_Write_Enable => Gpu_Write_Enable,
     VBlank_Interrupt => Interrupt_Requests(0),
-    Stat_Interrupt => Interrupt_Requests(1));
+    Stat_Interrupt => Interrupt_Requests(1),
+    Frame_Row => open,
+    Frame_Row_High => open,
+    Frame_Row_Low => open);
 
   Cpu_Port : Cpu port map (
     Clk => Clk,
     Reset => Cpu_Reset,
-    Mem_Write_External => Mem_Write,
+    Mem_Write_External => Cpu_Mem_Write,
     Mem_Read => Mem_Read,
-    Mem_Addr_External => Mem_Addr,
+    Mem_Addr_External => Cpu_Mem_Addr,
     Interrupt_Requests => Interrupt_Requests,
-    Mem_Write_Enable_External => Mem_Write_Enable,
-    Current_Interrupts => Current_Interrupts);
+    Mem_Write_Enable_External => Cpu_Mem_Write_Enable,
+    Current_Interrupts => Current_Interrupts,
+    Stall => Cpu_Stall,
+    Idle => Cpu_Idle,
+    Current_PC => Cpu_PC);
+
+  Mem_Write <= Mon_Write when Mon_Bus = '1' else Cpu_Mem_Write;
+  Mem_Addr <= Mon_Addr when Mon_Bus = '1' else Cpu_Mem_Addr;
+  Mem_Write_Enable <= Mon_Write_Enable when Mon_Bus = '1' else Cpu_Mem_Write_Enable;
 
   Bus_Port : Bus_Controller port map (
     Clk => Clk,
@@ -169,7 +205,15 @@ begin
     Rom_Write_Enable => Rom_Write_Enable,
     Rom_Addr => Rom_Addr,
     Rom_Write => Rom_Write,
-    Rst_Cpu => Rst_Cpu);
+    Rst_Cpu => Rst_Cpu,
+    Cpu_Stall => Cpu_Stall,
+    Cpu_Idle => Cpu_Idle,
+    Cpu_PC => Cpu_PC,
+    Mon_Bus => Mon_Bus,
+    Mon_Addr => Mon_Addr,
+    Mon_Write => Mon_Write,
+    Mon_Write_Enable => Mon_Write_Enable,
+    Mon_Read => Mem_Read);
 
   Cpu_Reset <= Rst or Rst_Cpu;
 
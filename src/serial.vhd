@@ -4,12 +4,29 @@ use ieee.std_logic_textio.all;
 use ieee.numeric_std.all;
 
 entity Serial is
-    Port ( Clk , Rst, RxD, TxD : in  std_logic;
+    generic (-- Clock cycles per bit, 868 is 115200 baud at 100 MHz.
+             Baud_Divisor : integer := 868;
+             -- Measure the bit time from a 0x55 sync byte that the host
+             -- sends before each upload, so that it may pick the baud rate.
+             -- Baud_Divisor is then only used until the first sync.
+             Auto_Baud : boolean := true);
+    Port ( Clk , Rst, RxD : in  std_logic;
+           TxD : out std_logic;
            Led : out std_logic_vector(7 downto 0);
            Rom_Write_Enable : out std_logic;
-           Rom_Addr : out std_logic_vector(15 downto 0);
+           Rom_Addr : out std_logic_vector(22 downto 0);
            Rom_Write : out std_logic_vector(7 downto 0);
-           Rst_Cpu : out std_logic);
+           Rst_Cpu : out std_logic;
+           -- The debug monitor. It stalls the cpu, waits for it to be
+           -- idle and then takes over the bus with Mon_Bus.
+           Cpu_Stall : out std_logic;
+           Cpu_Idle : in std_logic;
+           Cpu_PC : in std_logic_vector(15 downto 0);
+           Mon_Bus : out std_logic;
+           Mon_Addr : out std_logic_vector(15 downto 0);
+           Mon_Write : out std_logic_vector(7 downto 0);
+           Mon_Write_Enable : out std_logic;
+           Mon_Read : in std_logic_vector(7 downto 0));
            
 end Serial;
 
@@ -21,16 +38,129 @@ architecture Behavioral of Serial is
     signal lp : std_logic; -- loadpulse
     signal pos : std_logic_vector(1 downto 0) := "00";
     
-    signal counter : std_logic_vector(9 downto 0) := B"00_0000_0000";  -- Internal counter in the
-                                                                       -- controller unit
+    signal counter : std_logic_vector(15 downto 0) := X"0000";  -- Internal counter in the
+                                                               -- controller unit
+    signal Bit_Time : unsigned(15 downto 0) := to_unsigned(Baud_Divisor, 16);  -- Clock cycles per bit
     signal rcving : std_logic_vector(4 downto 0) := B"0_0000";  -- How many bits are left?
 
-    type State_Type is (Size1, Size2, Data_State, Checksum_State);
-    signal State : State_Type := Size1;
-    signal Size : std_logic_vector(15 downto 0);
-    signal Checksum : std_logic_vector(7 downto 0);
+    -- The upload is sent in frames, see serial/protocol.h:
+    -- SOF, type, sequence number, length, address (3 bytes, LSB first),
+    -- length bytes of data and a CRC-16 of everything after SOF (LSB first).
+    -- Every frame is answered with ACK or NAK followed by its sequence number.
+    -- The monitor frames add a payload and a CRC-16 of it to the ACK.
+    constant SOF : std_logic_vector(7 downto 0) := X"A5";
+    constant ACK : std_logic_vector(7 downto 0) := X"06";
+    constant NAK : std_logic_vector(7 downto 0) := X"15";
+    constant Frame_Data : std_logic_vector(7 downto 0) := X"01";  -- Write the data at the address
+    constant Frame_Start : std_logic_vector(7 downto 0) := X"02";  -- Hold the cpu in reset
+    constant Frame_End : std_logic_vector(7 downto 0) := X"03";  -- Start the cpu
+    constant Frame_Packed : std_logic_vector(7 downto 0) := X"04";  -- Unpack the data to the address
+    constant Frame_Halt : std_logic_vector(7 downto 0) := X"05";  -- Stall the cpu, answers the PC
+    constant Frame_Resume : std_logic_vector(7 downto 0) := X"06";  -- Let it run again
+    constant Frame_Step : std_logic_vector(7 downto 0) := X"07";  -- Run one instruction, answers the PC
+    constant Frame_Read : std_logic_vector(7 downto 0) := X"08";  -- Answers (data + 1) bytes from the bus
+    constant Frame_Write : std_logic_vector(7 downto 0) := X"09";  -- Write the data to the bus
+    constant Frame_Fill : std_logic_vector(7 downto 0) := X"0A";  -- Write (data + 1) bytes of one value
+
+    type State_Type is (Sync, Hunt, Type_State, Seq_State, Length_State,
+                        Addr1, Addr2, Addr3, Data_State, Crc1, Crc2);
+
+    -- Where an upload starts
+    function First_State(Auto : boolean) return State_Type is
+    begin
+      if Auto then
+        return Sync;
+      else
+        return Hunt;
+      end if;
+    end function;
+
+    -- CRC-16-CCITT (polynomial 0x1021, starts at 0xFFFF), one byte at a time
+    function Crc16(Crc : std_logic_vector(15 downto 0);
+                   Data : std_logic_vector(7 downto 0)) return std_logic_vector is
+      variable C : std_logic_vector(15 downto 0);
+    begin
+      C := Crc xor (Data & X"00");
+      for I in 0 to 7 loop
+        if C(15) = '1' then
+          C := (C(14 downto 0) & '0') xor X"1021";
+        else
+          C := C(14 downto 0) & '0';
+        end if;
+      end loop;
+      return C;
+    end function;
+    
+    signal State : State_Type := First_State(Auto_Baud);
     signal Data : std_logic_vector(7 downto 0);
-    signal Current_Addr : std_logic_vector(15 downto 0) := X"0000";
+
+    -- The frames. There are two buffers, one is written to the rom while
+    -- the next frame is received into the other.
+    type Buffer_Type is array(0 to 511) of std_logic_vector(7 downto 0);
+    signal Frame_Buffer : Buffer_Type;
+    signal Rx_Bank : std_logic := '0';
+    signal Frame_Type, Frame_Seq : std_logic_vector(7 downto 0);
+    signal Frame_Length, Frame_Index : unsigned(7 downto 0);
+    signal Frame_Addr : std_logic_vector(23 downto 0);
+    signal Frame_Crc : std_logic_vector(15 downto 0);
+    signal Crc_Low : std_logic_vector(7 downto 0);
+    -- Clock cycles since the last byte, to give up on half a frame
+    signal Idle_Count : unsigned(23 downto 0) := (others => '0');
+
+    -- Writes a received frame to the rom, unpacking it if needed
+    type Unpack_State_Type is (Unpack_Idle, Unpack_Control, Unpack_Literal,
+                               Unpack_Run_Length, Unpack_Run_Value, Unpack_Run,
+                               Unpack_Match_Offset, Unpack_Match);
+    signal Unpack_State : Unpack_State_Type := Unpack_Idle;
+    signal Copy_Start : std_logic := '0';
+    signal Copy_Bank : std_logic;
+    signal Out_Addr : unsigned(23 downto 0);
+    signal In_Index, In_End : unsigned(9 downto 0);  -- In Frame_Buffer
+    signal Unpack_Count : unsigned(14 downto 0);  -- Bytes left of the token
+    signal Run_Value : std_logic_vector(7 downto 0);
+    signal Distance : unsigned(8 downto 0);
+    -- The last 256 bytes written, for the matches
+    type History_Type is array(0 to 255) of std_logic_vector(7 downto 0);
+    signal History : History_Type;
+
+    -- Replies
+    signal Reply_Send : std_logic := '0';
+    signal Reply_Kind, Reply_Seq : std_logic_vector(7 downto 0);
+    signal Tx_Reg : std_logic_vector(9 downto 0) := (others => '1');
+    signal Tx_Bits_Left : integer range 0 to 10 := 0;
+    signal Tx_Counter : unsigned(15 downto 0);
+    -- The next byte to send, loaded by the monitor when Tx_Ready is set
+    signal Tx_Load : std_logic := '0';
+    signal Tx_Byte, Tx_Hold : std_logic_vector(7 downto 0);
+    signal Tx_Full : std_logic := '0';
+    signal Tx_Ready : std_logic;
+
+    -- The debug monitor, it also sends the replies to the other frames
+    type Mon_State_Type is (Mon_Idle, Mon_Halt, Mon_Step, Mon_Access,
+                            Mon_Write_Bus, Mon_Kind, Mon_Seq, Mon_Payload, Mon_Read_Bus,
+                            Mon_Push, Mon_Crc1, Mon_Crc2, Mon_Done);
+    signal Mon_State : Mon_State_Type := Mon_Idle;
+    signal Mon_Type, Mon_Kind_Byte, Mon_Seq_Byte : std_logic_vector(7 downto 0);
+    signal Mon_Value : std_logic_vector(7 downto 0);
+    signal Mon_Bank : std_logic;
+    signal Mon_Index, Mon_Length : unsigned(7 downto 0);
+    signal Mon_Count : unsigned(16 downto 0);  -- Payload bytes left
+    signal Mon_Address : unsigned(15 downto 0);
+    signal Mon_PC : std_logic_vector(15 downto 0);
+    signal Mon_Crc : std_logic_vector(15 downto 0);
+    signal Mon_Wait : unsigned(7 downto 0);
+    signal Mon_Stall : std_logic := '0';
+    -- The host has halted the cpu, it stays stalled between the commands
+    signal Host_Halt : std_logic := '0';
+
+    -- Auto baud
+    signal Sync_Edges : integer range 0 to 5 := 0;  -- Falling edges seen in the sync byte
+    signal Sync_Count : unsigned(18 downto 0) := (others => '0');  -- Clock cycles since the first one
+    signal Synced : std_logic := '0';
+    -- The host holds the line low (a break) before the sync byte, so that
+    -- we start over even if we were in the middle of something.
+    signal Break_Count : unsigned(20 downto 0) := (others => '0');
+    signal Break_Seen : std_logic := '0';
 begin
   
   -- A simple enpulsare :)
@@ -55,20 +185,20 @@ begin
       sp <= '0';
       lp <= '0';
       if rst = '1' then
-        counter <= B"00_0000_0000";
+        counter <= X"0000";
         rcving <= B"00000";
-      elsif rx1 = '0' and rx2 = '1' and counter = B"0_00000000_0" then
+      elsif rx1 = '0' and rx2 = '1' and counter = X"0000" and State /= Sync then
         rcving <= B"01011"; --11
-        counter <= B"0110110010"; --434;                 -- 868 / 2
-      elsif unsigned(rcving) > 1 and counter = B"0_00000000_0" then
+        counter <= std_logic_vector('0' & Bit_Time(15 downto 1));  -- Half a bit
+      elsif unsigned(rcving) > 1 and counter = X"0000" then
         sp <= '1';
         rcving <= std_logic_vector(unsigned(rcving) - 1);
-        counter <= B"1101100100"; --868;
-      elsif unsigned(rcving) = 1 and unsigned(counter) = 860 then
+        counter <= std_logic_vector(Bit_Time);
+      elsif unsigned(rcving) = 1 and unsigned(counter) = Bit_Time - 8 then
         if sreg(9) = '1' and sreg(0) = '0' then
           lp <= '1';
         end if;
-        counter <= B"00_0000_0000";
+        counter <= X"0000";
         rcving <= B"00000";--0;
       elsif unsigned(rcving) /= 0 then
         counter <= std_logic_vector(unsigned(counter) - 1);
@@ -78,6 +208,56 @@ begin
 
   Data <= sreg(8 downto 1);
 
+  -- Auto baud. 0x55 is sent LSB first, so on the line it is the start bit
+  -- followed by alternating bits. The falling edges of the start bit and
+  -- of bit 7 are then exactly 8 bit times apart, and the line goes high
+  -- for the stop bit right after that.
+  process (Clk)
+  begin
+    if rising_edge(Clk) then
+      Synced <= '0';
+      if Rst = '1' then
+        Bit_Time <= to_unsigned(Baud_Divisor, 16);
+        Sync_Edges <= 0;
+      elsif State /= Sync then
+        Sync_Edges <= 0;
+      elsif Sync_Edges = 0 then
+        if rx1 = '0' and rx2 = '1' then
+          Sync_Edges <= 1;
+          Sync_Count <= (others => '0');
+        end if;
+      elsif Sync_Edges < 5 then
+        Sync_Count <= Sync_Count + 1;
+        if rx1 = '0' and rx2 = '1' then
+          if Sync_Edges = 4 then
+            Bit_Time <= Sync_Count(18 downto 3) + 1;  -- Divided by 8, rounded up
+          end if;
+          Sync_Edges <= Sync_Edges + 1;
+        end if;
+      elsif rx1 = '1' and rx2 = '0' then
+        -- The stop bit, the next falling edge is the first frame
+        Synced <= '1';
+        Sync_Edges <= 0;
+      end if;
+    end if;
+  end process;
+
+  -- Break detection, about 10 ms of low line at 100 MHz
+  process (Clk)
+  begin
+    if rising_edge(Clk) then
+      Break_Seen <= '0';
+      if Rst = '1' or rx2 = '1' then
+        Break_Count <= (others => '0');
+      elsif Break_Count(20) = '0' then
+        Break_Count <= Break_Count + 1;
+        if Break_Count = 2**20 - 1 then
+          Break_Seen <= '1';
+        end if;
+      end if;
+    end if;
+  end process;
+
   -- 10 bit shiftregister
   process (Clk)
   begin
@@ -90,51 +270,414 @@ begin
     end if;
   end process;
   
-  -- Simple state machine to read from the UART, first it reads the size in
-  -- bytes of the data coming (16 bit value). After that that much data is read
-  -- and a simple checksum is calculated to check that everything is okay.
-  -- If everything is okay we light all the LEDs as a visual presentation for the
-  -- user to debug.
+  -- State machine that reads the frames. A frame is only acted on when its
+  -- CRC is correct, otherwise it is NAKed and we look for the next SOF.
+  -- Data frames are collected in Frame_Buffer and written to the rom after
+  -- the check, while the host sends the next frame. If everything is
+  -- okay we light all the LEDs as a visual presentation for the user to debug.
   process(Clk)
   begin
     if rising_edge(Clk) then
+      Reply_Send <= '0';
+      Copy_Start <= '0';
+      if lp = '1' then
+        Idle_Count <= (others => '0');
+      elsif Idle_Count(23) = '0' then
+        Idle_Count <= Idle_Count + 1;
+      end if;
+      
       if Rst = '1' then
-        State <= Size1;
+        State <= First_State(Auto_Baud);
+      elsif Break_Seen = '1' then
+        State <= First_State(Auto_Baud);
+      elsif Synced = '1' then
+        State <= Hunt;
+      elsif State /= Sync and State /= Hunt and Idle_Count(23 downto 6) > Bit_Time then
+        -- Nothing for 64 bit times, the rest of the frame is lost. The
+        -- host resends it when it doesn't get an answer.
+        State <= Hunt;
       elsif lp = '1' then
         case (State) is
-          when Size1 =>
-            Size(7 downto 0) <= Data;
-            Rst_Cpu <= '1';
-            State <= Size2;
-          when Size2 =>
-            Checksum <= X"00";
-            Size(15 downto 8) <= Data;
-            Current_Addr <= X"0000";
-            State <= Data_State;
+          when Sync =>
+            -- Handled by the auto baud process
+            null;
+          when Hunt =>
+            if Data = SOF then
+              Frame_Crc <= X"FFFF";
+              State <= Type_State;
+            end if;
+          when Type_State =>
+            Frame_Type <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            State <= Seq_State;
+          when Seq_State =>
+            Frame_Seq <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            State <= Length_State;
+          when Length_State =>
+            Frame_Length <= unsigned(Data);
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            State <= Addr1;
+          when Addr1 =>
+            Frame_Addr(7 downto 0) <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            State <= Addr2;
+          when Addr2 =>
+            Frame_Addr(15 downto 8) <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            State <= Addr3;
+          when Addr3 =>
+            Frame_Addr(23 downto 16) <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            Frame_Index <= X"00";
+            if Frame_Length = 0 then
+              State <= Crc1;
+            else
+              State <= Data_State;
+            end if;
           when Data_State =>
-            Led(7 downto 0) <= B"0" & Size(15 downto 9);
-            Checksum <= std_logic_vector(unsigned(Checksum) + unsigned(Data));
-            Current_Addr <= std_logic_vector(unsigned(Current_Addr) + 1);
-            Rom_Addr <= Current_Addr;
-            Rom_Write <= Data;
-            Rom_Write_Enable <= '1';
-            if Size = X"0001" then
-              State <= Checksum_State;
+            Frame_Buffer(to_integer(Rx_Bank & Frame_Index)) <= Data;
+            Frame_Crc <= Crc16(Frame_Crc, Data);
+            Frame_Index <= Frame_Index + 1;
+            if Frame_Index + 1 = Frame_Length then
+              State <= Crc1;
+            end if;
+          when Crc1 =>
+            Crc_Low <= Data;
+            State <= Crc2;
+          when Crc2 =>
+            Reply_Send <= '1';
+            Reply_Seq <= Frame_Seq;
+            State <= Hunt;
+            if Frame_Crc /= Data & Crc_Low then
+              Reply_Kind <= NAK;
+            else
+              Reply_Kind <= ACK;
+              if Frame_Type = Frame_Data or Frame_Type = Frame_Packed then
+                Led(7 downto 0) <= B"0" & Frame_Addr(15 downto 9);
+                Copy_Start <= '1';
+                Copy_Bank <= Rx_Bank;
+                Rx_Bank <= not Rx_Bank;
+              elsif Frame_Type = Frame_Start then
+                Rst_Cpu <= '1';
+              elsif Frame_Type = Frame_End then
+                Led(7 downto 0) <= B"11111111";
+                Rst_Cpu <= '0';
+              end if;
+            end if;
+        end case;
+      end if;
+    end if;     
+  end process;
+
+  -- Writes a checked frame to the rom, one byte per clock cycle. Packed
+  -- frames are a list of tokens, see serial/protocol.h:
+  --   0xxxxxxx                  x + 1 literal bytes follow
+  --   10xxxxxx yyyyyyyy v       x & y + 3 bytes of v
+  --   11xxxxxx d                x + 3 bytes copied from d + 1 bytes back
+  -- The host makes sure that a frame unpacks to at most 2048 bytes, so that
+  -- it is done before the next frame has been received.
+  process(Clk)
+    variable Value : std_logic_vector(7 downto 0);
+    variable Output : boolean;
+  begin
+    if rising_edge(Clk) then
+      Rom_Write_Enable <= '0';
+      Output := false;
+      if Rst = '1' then
+        Unpack_State <= Unpack_Idle;
+      else
+        case Unpack_State is
+          when Unpack_Idle =>
+            if Copy_Start = '1' and Frame_Length /= 0 then
+              Out_Addr <= unsigned(Frame_Addr);
+              In_Index <= unsigned('0' & Copy_Bank & X"00");
+              In_End <= unsigned('0' & Copy_Bank & X"00") + Frame_Length;
+              if Frame_Type = Frame_Packed then
+                Unpack_State <= Unpack_Control;
+              else
+                -- Plain data is one long literal
+                Unpack_Count <= resize(Frame_Length, 15);
+                Unpack_State <= Unpack_Literal;
+              end if;
+            end if;
+          when Unpack_Control =>
+            if In_Index = In_End then
+              Unpack_State <= Unpack_Idle;
             else
-              Size <= std_logic_vector(unsigned(Size) - 1);
+              Value := Frame_Buffer(to_integer(In_Index(8 downto 0)));
+              In_Index <= In_Index + 1;
+              if Value(7) = '0' then
+                Unpack_Count <= resize(unsigned(Value(6 downto 0)), 15) + 1;
+                Unpack_State <= Unpack_Literal;
+              elsif Value(6) = '0' then
+                Unpack_Count <= resize(unsigned(Value(5 downto 0)), 15);
+                Unpack_State <= Unpack_Run_Length;
+              else
+                Unpack_Count <= resize(unsigned(Value(5 downto 0)), 15) + 3;
+                Unpack_State <= Unpack_Match_Offset;
+              end if;
             end if;
-          when Checksum_State =>
-            if Checksum = Data then
-              Led(7 downto 0) <= B"11111111";
-              Rst_Cpu <= '0';
+          when Unpack_Literal =>
+            Value := Frame_Buffer(to_integer(In_Index(8 downto 0)));
+            In_Index <= In_Index + 1;
+            Output := true;
+          when Unpack_Run_Length =>
+            Unpack_Count <= (Unpack_Count(6 downto 0) & unsigned(Frame_Buffer(to_integer(In_Index(8 downto 0))))) + 3;
+            In_Index <= In_Index + 1;
+            Unpack_State <= Unpack_Run_Value;
+          when Unpack_Run_Value =>
+            Run_Value <= Frame_Buffer(to_integer(In_Index(8 downto 0)));
+            In_Index <= In_Index + 1;
+            Unpack_State <= Unpack_Run;
+          when Unpack_Run =>
+            Value := Run_Value;
+            Output := true;
+          when Unpack_Match_Offset =>
+            Distance <= resize(unsigned(Frame_Buffer(to_integer(In_Index(8 downto 0)))), 9) + 1;
+            In_Index <= In_Index + 1;
+            Unpack_State <= Unpack_Match;
+          when Unpack_Match =>
+            Value := History(to_integer(Out_Addr(7 downto 0) - Distance(7 downto 0)));
+            Output := true;
+        end case;
+
+        if Output then
+          Rom_Addr <= std_logic_vector(Out_Addr(22 downto 0));
+          Rom_Write <= Value;
+          Rom_Write_Enable <= '1';
+          History(to_integer(Out_Addr(7 downto 0))) <= Value;
+          Out_Addr <= Out_Addr + 1;
+          Unpack_Count <= Unpack_Count - 1;
+          if Unpack_Count = 1 then
+            Unpack_State <= Unpack_Control;
+          end if;
+        end if;
+      end if;
+    end if;
+  end process;
+
+  -- The debug monitor. It sends the answer to every checked frame, the
+  -- monitor frames get a payload:
+  --   Halt     stalls the cpu before the next instruction, answers the PC
+  --   Resume   lets it run again
+  --   Step     runs one instruction, answers the PC of the next one
+  --   Read     answers (data + 1) bytes from the bus, starting at the
+  --            address. The data is 16 bits, LSB first.
+  --   Write    writes the data to the bus, starting at the address
+  --   Fill     writes (data + 1) bytes of the value after the 16 bits of
+  --            data, starting at the address
+  -- Read, Write and Fill stall the cpu while they run, so they work on a
+  -- running game as well. A reply to a normal frame is two bytes and a
+  -- frame is at least nine, so those never have to wait. The host waits for
+  -- the answer to a monitor frame before it sends anything else.
+  process(Clk)
+  begin
+    if rising_edge(Clk) then
+      Tx_Load <= '0';
+      Mon_Write_Enable <= '0';
+      if Rst = '1' then
+        Mon_State <= Mon_Idle;
+        Mon_Bus <= '0';
+        Mon_Stall <= '0';
+        Host_Halt <= '0';
+      else
+        case Mon_State is
+          when Mon_Idle =>
+            if Reply_Send = '1' then
+              Mon_Kind_Byte <= Reply_Kind;
+              Mon_Seq_Byte <= Reply_Seq;
+              Mon_Type <= Frame_Type;
+              Mon_Address <= unsigned(Frame_Addr(15 downto 0));
+              Mon_Bank <= Rx_Bank;
+              Mon_Length <= Frame_Length;
+              Mon_Index <= X"00";
+              Mon_Count <= (others => '0');
+              Mon_State <= Mon_Kind;
+              if Reply_Kind = ACK then
+                case Frame_Type is
+                  when Frame_Halt =>
+                    Host_Halt <= '1';
+                    Mon_Stall <= '1';
+                    Mon_State <= Mon_Halt;
+                  when Frame_Resume =>
+                    Host_Halt <= '0';
+                    Mon_Stall <= '0';
+                  when Frame_Step =>
+                    Host_Halt <= '1';
+                    if Host_Halt = '1' then
+                      Mon_Stall <= '0';
+                      Mon_Wait <= X"FF";
+                      Mon_State <= Mon_Step;
+                    else
+                      -- It was running, only halt it
+                      Mon_Stall <= '1';
+                      Mon_State <= Mon_Halt;
+                    end if;
+                  when Frame_Read =>
+                    Mon_Count <= ('0' & unsigned(Frame_Buffer(to_integer(unsigned'(Rx_Bank & X"01"))))
+                                  & unsigned(Frame_Buffer(to_integer(unsigned'(Rx_Bank & X"00"))))) + 1;
+                    Mon_Stall <= '1';
+                    Mon_State <= Mon_Access;
+                  when Frame_Write =>
+                    Mon_Stall <= '1';
+                    Mon_State <= Mon_Access;
+                  when Frame_Fill =>
+                    Mon_Count <= ('0' & unsigned(Frame_Buffer(to_integer(unsigned'(Rx_Bank & X"01"))))
+                                  & unsigned(Frame_Buffer(to_integer(unsigned'(Rx_Bank & X"00"))))) + 1;
+                    Mon_Value <= Frame_Buffer(to_integer(unsigned'(Rx_Bank & X"02")));
+                    Mon_Stall <= '1';
+                    Mon_State <= Mon_Access;
+                  when others =>
+                    null;
+                end case;
+              end if;
+            end if;
+          when Mon_Halt =>
+            if Cpu_Idle = '1' then
+              Mon_PC <= Cpu_PC;
+              Mon_Count <= to_unsigned(2, 17);
+              Mon_State <= Mon_Kind;
+            end if;
+          when Mon_Step =>
+            -- Stall it again as soon as it has started the instruction.
+            -- The HALT instruction never does, then we give up.
+            Mon_Wait <= Mon_Wait - 1;
+            if Cpu_Idle = '0' or Mon_Wait = 0 then
+              Mon_Stall <= '1';
+              Mon_State <= Mon_Halt;
+            end if;
+          when Mon_Access =>
+            if Cpu_Idle = '1' then
+              Mon_Bus <= '1';
+              if Mon_Type = Frame_Write or Mon_Type = Frame_Fill then
+                Mon_State <= Mon_Write_Bus;
+              else
+                Mon_State <= Mon_Kind;
+              end if;
             end if;
-            State <= Size1;
+          when Mon_Write_Bus =>
+            if Mon_Type = Frame_Fill then
+              -- Counts down to 0, so there is no payload after the ACK
+              if Mon_Count = 0 then
+                Mon_State <= Mon_Kind;
+              else
+                Mon_Addr <= std_logic_vector(Mon_Address);
+                Mon_Write <= Mon_Value;
+                Mon_Write_Enable <= '1';
+                Mon_Address <= Mon_Address + 1;
+                Mon_Count <= Mon_Count - 1;
+              end if;
+            elsif Mon_Index = Mon_Length then
+              Mon_State <= Mon_Kind;
+            else
+              Mon_Addr <= std_logic_vector(Mon_Address);
+              Mon_Write <= Frame_Buffer(to_integer(Mon_Bank & Mon_Index));
+              Mon_Write_Enable <= '1';
+              Mon_Address <= Mon_Address + 1;
+              Mon_Index <= Mon_Index + 1;
+            end if;
+          when Mon_Kind =>
+            if Tx_Ready = '1' then
+              Tx_Byte <= Mon_Kind_Byte;
+              Tx_Load <= '1';
+              Mon_State <= Mon_Seq;
+            end if;
+          when Mon_Seq =>
+            if Tx_Ready = '1' then
+              Tx_Byte <= Mon_Seq_Byte;
+              Tx_Load <= '1';
+              Mon_Crc <= X"FFFF";
+              if Mon_Count = 0 then
+                Mon_State <= Mon_Done;
+              else
+                Mon_State <= Mon_Payload;
+              end if;
+            end if;
+          when Mon_Payload =>
+            if Mon_Count = 0 then
+              Mon_State <= Mon_Crc1;
+            elsif Mon_Type = Frame_Read then
+              Mon_Addr <= std_logic_vector(Mon_Address);
+              Mon_Address <= Mon_Address + 1;
+              Mon_Wait <= X"04";
+              Mon_State <= Mon_Read_Bus;
+            else
+              Mon_Value <= Mon_PC(7 downto 0);
+              Mon_PC <= X"00" & Mon_PC(15 downto 8);
+              Mon_State <= Mon_Push;
+            end if;
+          when Mon_Read_Bus =>
+            -- The bus controller answers on the next clock cycle, and
+            -- one cycle later for what it gets from the gpu
+            Mon_Wait <= Mon_Wait - 1;
+            if Mon_Wait = 0 then
+              Mon_Value <= Mon_Read;
+              Mon_State <= Mon_Push;
+            end if;
+          when Mon_Push =>
+            if Tx_Ready = '1' then
+              Tx_Byte <= Mon_Value;
+              Tx_Load <= '1';
+              Mon_Crc <= Crc16(Mon_Crc, Mon_Value);
+              Mon_Count <= Mon_Count - 1;
+              Mon_State <= Mon_Payload;
+            end if;
+          when Mon_Crc1 =>
+            if Tx_Ready = '1' then
+              Tx_Byte <= Mon_Crc(7 downto 0);
+              Tx_Load <= '1';
+              Mon_State <= Mon_Crc2;
+            end if;
+          when Mon_Crc2 =>
+            if Tx_Ready = '1' then
+              Tx_Byte <= Mon_Crc(15 downto 8);
+              Tx_Load <= '1';
+              Mon_State <= Mon_Done;
+            end if;
+          when Mon_Done =>
+            Mon_Bus <= '0';
+            Mon_Stall <= Host_Halt;
+            Mon_State <= Mon_Idle;
         end case;
+      end if;
+    end if;
+  end process;
+
+  Cpu_Stall <= Mon_Stall;
+
+  -- Sends the bytes from the monitor, Tx_Hold is the next one
+  process(Clk)
+  begin
+    if rising_edge(Clk) then
+      if Rst = '1' then
+        Tx_Bits_Left <= 0;
+        Tx_Full <= '0';
       else
-          Rom_Write_Enable <= '0';
+        if Tx_Bits_Left = 0 then
+          if Tx_Full = '1' then
+            Tx_Reg <= '1' & Tx_Hold & '0';
+            Tx_Bits_Left <= 10;
+            Tx_Counter <= Bit_Time;
+            Tx_Full <= '0';
+          end if;
+        elsif Tx_Counter = 1 then
+          Tx_Reg <= '1' & Tx_Reg(9 downto 1);
+          Tx_Bits_Left <= Tx_Bits_Left - 1;
+          Tx_Counter <= Bit_Time;
+        else
+          Tx_Counter <= Tx_Counter - 1;
+        end if;
+        if Tx_Load = '1' then
+          Tx_Hold <= Tx_Byte;
+          Tx_Full <= '1';
+        end if;
       end if;
-    end if;     
-  end process;       
+    end if;
+  end process;
+
+  Tx_Ready <= not Tx_Full and not Tx_Load;
+
+  TxD <= Tx_Reg(0) when Tx_Bits_Left /= 0 else '1';
   
 end Behavioral;
-
@@ -0,0 +1,173 @@
+//A stand-in for the FPGA, to test and time the uploader without a board.
+//It opens a pseudo terminal, prints the name of it and answers like
+//serial.vhd (see FpgaModel) until it is stopped. Linux only, build with
+//  g++ -o fakeboard fakeboard.cpp fpgamodel.cpp protocol.cpp
+#include "stdafx.h"
+#include "fpgamodel.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopped = 0;
+
+void onSignal(int) {
+  stopped = 1;
+}
+
+void printHelp(char *name) {
+  DEBUG(name << " [-b baud] [-e rate] [-d rate] [-s seed] [-n] [-x] [-o file]");
+  DEBUG("  -b baud  Take as long as the real line for every byte, both ways");
+  DEBUG("  -e rate  Flip a bit in this fraction of the received bytes, like 0.001");
+  DEBUG("  -d rate  Lose this fraction of the received bytes");
+  DEBUG("  -s seed  Seed for the errors");
+  DEBUG("  -n       Do not wait for the sync byte, like Serial with Auto_Baud = false");
+  DEBUG("  -x       Stop when an upload is done and the host is quiet");
+  DEBUG("  -o file  Write the rom to file when stopping");
+}
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+//Waits until the line is free at time, in ms.
+void waitUntil(double time) {
+  double left = time - now();
+  if (left > 0) usleep(useconds_t(left * 1000));
+}
+
+bool chance(double rate) {
+  return rate > 0 && rand() < rate * RAND_MAX;
+}
+
+int main(int argc, char **argv) {
+  int baud = 0;
+  double errorRate = 0, dropRate = 0;
+  unsigned int seed = 1;
+  bool autoBaud = true;
+  bool exitAfterUpload = false;
+  String romFile;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      baud = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      errorRate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      dropRate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      autoBaud = false;
+    } else if (strcmp(argv[i], "-x") == 0) {
+      exitAfterUpload = true;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      romFile = argv[++i];
+    } else {
+      printHelp(argv[0]);
+      return 2;
+    }
+  }
+  srand(seed);
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    DEBUG("Error: Failed to open a pseudo terminal: " << strerror(errno));
+    return 3;
+  }
+  struct termios tio;
+  tcgetattr(master, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(master, TCSANOW, &tio);
+  String name = ptsname(master);
+  //Keep the other end open, otherwise we get EIO each time the uploader
+  //closes it
+  int slave = open(name.c_str(), O_RDWR | O_NOCTTY);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  DEBUG(name);
+
+  FpgaModel model(autoBaud);
+  //Milliseconds per byte on the line, 10 bits with start and stop
+  double byteTime = baud > 0 ? 10000.0 / baud : 0;
+  //Serial gives up on a frame after 64 bit times, without pacing we use
+  //the slowest rate. The pty itself never pauses inside a frame.
+  double idleTime = 64000.0 / (baud > 0 ? baud : 115200);
+  //When the last byte received is done on the line. The answers are short
+  //and written right away.
+  double rxFree = now();
+  double lastByte = now();
+  nat received = 0, flipped = 0, dropped = 0, sent = 0;
+
+  while (!stopped) {
+    //The host may still be waiting for the last answers
+    if (exitAfterUpload && model.framesOfType(FRAME_END) > 0 && now() - lastByte > 500) break;
+
+    struct pollfd fd;
+    fd.fd = master;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    int timeout = model.inFrame() ? std::max(1, int(idleTime)) : 100;
+    if (poll(&fd, 1, timeout) <= 0) {
+      if (model.inFrame() && now() - lastByte > idleTime) model.idle();
+      continue;
+    }
+
+    byte buffer[4096];
+    ssize_t r = read(master, buffer, sizeof(buffer));
+    if (r <= 0) {
+      usleep(10000);
+      continue;
+    }
+
+    //The bytes were all there when read returned, so sleeping too long
+    //for one of them does not slow down the rest
+    double arrived = now();
+    for (ssize_t i = 0; i < r; i++) {
+      if (byteTime > 0) {
+	rxFree = std::max(rxFree, arrived) + byteTime;
+	waitUntil(rxFree);
+      }
+      received++;
+      byte data = buffer[i];
+      if (chance(dropRate)) {
+	dropped++;
+	continue;
+      }
+      if (chance(errorRate)) {
+	data ^= byte(1 << (rand() % 8));
+	flipped++;
+      }
+      std::vector<byte> reply;
+      model.receive(data, reply);
+      //The answer goes out while the next frame comes in
+      for (nat j = 0; j < reply.size(); j++) {
+	if (write(master, &reply[j], 1) == 1) sent++;
+      }
+    }
+    lastByte = now();
+  }
+
+  DEBUG("Received " << received << " bytes, " << flipped << " garbled, " << dropped << " lost, sent " << sent);
+  DEBUG(model.framesAcked() << " frames acked, " << model.framesNaked() << " naked, "
+	<< model.framesOfType(FRAME_END) << " uploads");
+  if (!romFile.empty()) {
+    std::ofstream f(romFile.c_str(), std::ios::binary);
+    if (!model.rom().empty()) f.write((const char *)&model.rom()[0], model.rom().size());
+  }
+  close(slave);
+  close(master);
+  return 0;
+}
@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "fpgamodel.h"
+
+#include <cstring>
+
+FpgaModel::FpgaModel(bool autoBaud) :
+  autoBaud(autoBaud), state(autoBaud ? Sync : Hunt), ram(0x8000),
+  resetCpu(false), halted(false), pc(0x0100), acked(0), naked(0) {
+  memset(history, 0, sizeof(history));
+  memset(typeCount, 0, sizeof(typeCount));
+}
+
+void FpgaModel::lineBreak() {
+  state = autoBaud ? Sync : Hunt;
+}
+
+void FpgaModel::idle() {
+  if (inFrame()) state = Hunt;
+}
+
+void FpgaModel::receive(byte data, std::vector<byte> &reply) {
+  switch (state) {
+  case Sync:
+    //The auto baud process only looks at the edges, any byte does
+    state = Hunt;
+    break;
+  case Hunt:
+    if (data == FRAME_SOF) {
+      frameCrc = 0xFFFF;
+      state = TypeState;
+    }
+    break;
+  case TypeState:
+    frameType = data;
+    frameCrc = crc16(frameCrc, data);
+    state = SeqState;
+    break;
+  case SeqState:
+    frameSeq = data;
+    frameCrc = crc16(frameCrc, data);
+    state = LengthState;
+    break;
+  case LengthState:
+    frameLength = data;
+    frameCrc = crc16(frameCrc, data);
+    state = Addr1;
+    break;
+  case Addr1:
+    frameAddr = data;
+    frameCrc = crc16(frameCrc, data);
+    state = Addr2;
+    break;
+  case Addr2:
+    frameAddr |= nat(data) << 8;
+    frameCrc = crc16(frameCrc, data);
+    state = Addr3;
+    break;
+  case Addr3:
+    frameAddr |= nat(data) << 16;
+    frameCrc = crc16(frameCrc, data);
+    frameData.clear();
+    state = frameLength == 0 ? Crc1 : DataState;
+    break;
+  case DataState:
+    frameData.push_back(data);
+    frameCrc = crc16(frameCrc, data);
+    if (frameData.size() == frameLength) state = Crc1;
+    break;
+  case Crc1:
+    crcLow = data;
+    state = Crc2;
+    break;
+  case Crc2:
+    state = Hunt;
+    if (frameCrc != (nat(data) << 8 | crcLow)) {
+      naked++;
+      reply.push_back(FRAME_NAK);
+      reply.push_back(frameSeq);
+      break;
+    }
+    acked++;
+    typeCount[frameType]++;
+    if (frameType == FRAME_DATA || frameType == FRAME_PACKED) {
+      unpack();
+    } else if (frameType == FRAME_START) {
+      resetCpu = true;
+    } else if (frameType == FRAME_END) {
+      resetCpu = false;
+      pc = 0x0100;
+    }
+    answer(reply);
+    break;
+  }
+}
+
+void FpgaModel::writeRom(nat addr, byte value) {
+  addr &= MAX_ROM_SIZE - 1;
+  if (addr >= romData.size()) romData.resize(addr + 1, 0);
+  romData[addr] = value;
+  history[addr & 0xFF] = value;
+}
+
+void FpgaModel::unpack() {
+  nat out = frameAddr;
+  if (frameType == FRAME_DATA) {
+    for (nat i = 0; i < frameData.size(); i++) writeRom(out++, frameData[i]);
+    return;
+  }
+
+  //A token cut short by the end of the frame reads whatever is in the
+  //other half of Frame_Buffer, the host never sends one.
+  nat i = 0;
+  while (i < frameData.size()) {
+    byte control = frameData[i++];
+    if ((control & 0x80) == 0) {
+      for (nat n = nat(control) + 1; n > 0 && i < frameData.size(); n--) writeRom(out++, frameData[i++]);
+    } else if ((control & 0x40) == 0) {
+      if (i + 2 > frameData.size()) break;
+      nat n = (nat(control & 0x3F) << 8 | frameData[i]) + 3;
+      byte value = frameData[i + 1];
+      i += 2;
+      while (n-- > 0) writeRom(out++, value);
+    } else {
+      if (i + 1 > frameData.size()) break;
+      nat n = nat(control & 0x3F) + 3;
+      nat distance = nat(frameData[i++]) + 1;
+      while (n-- > 0) {
+	writeRom(out, history[(out - distance) & 0xFF]);
+	out++;
+      }
+    }
+  }
+}
+
+byte FpgaModel::busRead(nat addr) const {
+  addr &= 0xFFFF;
+  if (addr >= 0x8000) return ram[addr - 0x8000];
+  //Bank 0 and 1 without any MBC
+  return addr < romData.size() ? romData[addr] : 0;
+}
+
+void FpgaModel::busWrite(nat addr, byte value) {
+  addr &= 0xFFFF;
+  //Writes to the rom area only switch banks
+  if (addr >= 0x8000) ram[addr - 0x8000] = value;
+}
+
+void FpgaModel::runToHalt() {
+  if (resetCpu || halted) return;
+  for (nat i = 0; i < 0x10000; i++) {
+    byte op = busRead(pc);
+    pc = (pc + 1) & 0xFFFF;
+    if (op == 0x76) return;
+  }
+}
+
+void FpgaModel::answer(std::vector<byte> &reply) {
+  std::vector<byte> payload;
+  switch (frameType) {
+  case FRAME_HALT:
+    runToHalt();
+    halted = true;
+    payload.push_back(byte(pc & 0xFF));
+    payload.push_back(byte(pc >> 8));
+    break;
+  case FRAME_RESUME:
+    halted = false;
+    break;
+  case FRAME_STEP:
+    //A running cpu is only halted, like Mon_Step
+    if (halted) pc = (pc + 1) & 0xFFFF;
+    else runToHalt();
+    halted = true;
+    payload.push_back(byte(pc & 0xFF));
+    payload.push_back(byte(pc >> 8));
+    break;
+  case FRAME_READ: {
+    nat count = (frameData.size() >= 2 ? (nat(frameData[1]) << 8 | frameData[0]) : 0) + 1;
+    for (nat i = 0; i < count; i++) payload.push_back(busRead(frameAddr + i));
+    break;
+  }
+  case FRAME_WRITE:
+    for (nat i = 0; i < frameData.size(); i++) busWrite(frameAddr + i, frameData[i]);
+    break;
+  case FRAME_FILL: {
+    nat count = (frameData.size() >= 3 ? (nat(frameData[1]) << 8 | frameData[0]) + 1 : 0);
+    for (nat i = 0; i < count; i++) busWrite(frameAddr + i, frameData[2]);
+    break;
+  }
+  }
+
+  reply.push_back(FRAME_ACK);
+  reply.push_back(frameSeq);
+  if (payload.empty()) return;
+  nat crc = 0xFFFF;
+  for (nat i = 0; i < payload.size(); i++) crc = crc16(crc, payload[i]);
+  reply.insert(reply.end(), payload.begin(), payload.end());
+  reply.push_back(byte(crc & 0xFF));
+  reply.push_back(byte(crc >> 8));
+}
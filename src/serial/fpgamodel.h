@@ -0,0 +1,72 @@
+#pragma once
+
+#include "protocol.h"
+
+#include <vector>
+
+//Follows serial.vhd one received byte at a time: the frame state machine,
+//the unpacking to the rom and the debug monitor. It is what fakeboard
+//answers with, and what the VHDL should do when the two disagree.
+//
+//There is no cpu. Resuming runs it to just after the next HALT (0x76) in
+//the rom, which is where a test ends, and a step moves the PC one byte.
+class FpgaModel {
+public:
+  //autoBaud is the generic of Serial, it waits for the sync byte first.
+  FpgaModel(bool autoBaud = true);
+
+  //A byte from the host. The answers are appended to reply.
+  void receive(byte data, std::vector<byte> &reply);
+  //The line was held low, like Break_Seen.
+  void lineBreak();
+  //Nothing arrived for 64 bit times, half a frame is dropped.
+  void idle();
+  //In the middle of a frame, so idle() matters.
+  bool inFrame() const { return state != Sync && state != Hunt; }
+
+  //The rom as uploaded, up to the highest address written.
+  const std::vector<byte> &rom() const { return romData; }
+  bool cpuReset() const { return resetCpu; }
+  bool cpuHalted() const { return halted; }
+
+  nat framesAcked() const { return acked; }
+  nat framesNaked() const { return naked; }
+  //Frame types that were acked, FRAME_END is the end of an upload.
+  nat framesOfType(byte type) const { return typeCount[type]; }
+
+private:
+  enum State { Sync, Hunt, TypeState, SeqState, LengthState,
+	       Addr1, Addr2, Addr3, DataState, Crc1, Crc2 };
+
+  bool autoBaud;
+  State state;
+  byte frameType, frameSeq, frameLength;
+  nat frameAddr;
+  nat frameCrc;
+  byte crcLow;
+  std::vector<byte> frameData;
+
+  std::vector<byte> romData;
+  //0x8000 and up on the bus, the rom is below
+  std::vector<byte> ram;
+  //The last 256 bytes unpacked, for the matches
+  byte history[256];
+
+  bool resetCpu;
+  bool halted;
+  nat pc;
+
+  nat acked;
+  nat naked;
+  nat typeCount[256];
+
+  //Writes a checked frame to the rom, like the unpack process.
+  void unpack();
+  void writeRom(nat addr, byte value);
+  //Answers a checked frame, like the monitor process.
+  void answer(std::vector<byte> &reply);
+  byte busRead(nat addr) const;
+  void busWrite(nat addr, byte value);
+  //Runs the cpu until it has executed a HALT.
+  void runToHalt();
+};
@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "monitor.h"
+
+#include <algorithm>
+#include <sstream>
+
+Monitor::Monitor(Port &port) : port(port), seq(0), maxTries(5) {}
+
+bool Monitor::halt(nat &pc) {
+  std::vector<byte> payload;
+  if (!transact(FRAME_HALT, 0, 0, 0, 2, payload)) return false;
+  pc = payload[0] | (payload[1] << 8);
+  return true;
+}
+
+bool Monitor::resume() {
+  std::vector<byte> payload;
+  return transact(FRAME_RESUME, 0, 0, 0, 0, payload);
+}
+
+bool Monitor::step(nat &pc) {
+  std::vector<byte> payload;
+  if (!transact(FRAME_STEP, 0, 0, 0, 2, payload)) return false;
+  pc = payload[0] | (payload[1] << 8);
+  return true;
+}
+
+bool Monitor::peek(nat addr, byte &value) {
+  std::vector<byte> data;
+  if (!read(addr, 1, data)) return false;
+  value = data[0];
+  return true;
+}
+
+bool Monitor::poke(nat addr, byte value) {
+  return write(addr, &value, 1);
+}
+
+bool Monitor::read(nat addr, nat size, std::vector<byte> &to) {
+  to.clear();
+  to.reserve(size);
+  std::vector<byte> payload;
+  while (to.size() < size) {
+    nat chunk = std::min(size - nat(to.size()), MONITOR_READ_CHUNK);
+    byte count[2] = { byte((chunk - 1) & 0xFF), byte((chunk - 1) >> 8) };
+    if (!transact(FRAME_READ, (addr + to.size()) & 0xFFFF, count, 2, chunk, payload)) return false;
+    to.insert(to.end(), payload.begin(), payload.end());
+  }
+  return true;
+}
+
+bool Monitor::write(nat addr, const byte *data, nat size) {
+  std::vector<byte> payload;
+  for (nat done = 0; done < size; ) {
+    nat chunk = std::min(size - done, FRAME_MAX_DATA);
+    if (!transact(FRAME_WRITE, (addr + done) & 0xFFFF, data + done, chunk, 0, payload)) return false;
+    done += chunk;
+  }
+  return true;
+}
+
+bool Monitor::fill(nat addr, nat size, byte value) {
+  std::vector<byte> payload;
+  for (nat done = 0; done < size; ) {
+    nat chunk = std::min(size - done, nat(0x10000));
+    byte data[3] = { byte((chunk - 1) & 0xFF), byte((chunk - 1) >> 8), value };
+    if (!transact(FRAME_FILL, (addr + done) & 0xFFFF, data, 3, 0, payload)) return false;
+    done += chunk;
+  }
+  return true;
+}
+
+int Monitor::negotiateBaud() {
+  nat tries = maxTries;
+  maxTries = BAUD_CONFIRM_TRIES;
+  int found = 0;
+  for (nat i = 0; i < BAUD_RATES_COUNT && found == 0; i++) {
+    if (!port.setBaud(BAUD_RATES[i])) continue;
+    //Reading stalls the cpu for a moment, nothing else
+    byte value;
+    if (port.sendBreak() && port.write(&SYNC_BYTE, 1) && peek(0, value)) found = BAUD_RATES[i];
+  }
+  maxTries = tries;
+  return found;
+}
+
+bool Monitor::transact(byte type, nat addr, const byte *data, nat size,
+		       nat payloadSize, std::vector<byte> &payload) {
+  seq++;
+  std::vector<byte> frame = buildFrame(type, seq, addr, data, size);
+
+  for (nat tries = 0; tries < maxTries; tries++) {
+    //Whatever is left from an earlier answer is of no use now
+    byte junk[64];
+    while (port.read(junk, sizeof(junk)) > 0) {}
+
+    if (!port.write(&frame[0], frame.size()) || !port.flush()) {
+      errorMsg = "Failed to write to the port";
+      return false;
+    }
+    if (awaitReply(payloadSize, payload)) return true;
+  }
+
+  std::ostringstream oss;
+  oss << "No good answer to frame type " << nat(type) << " after " << maxTries << " tries";
+  errorMsg = oss.str();
+  return false;
+}
+
+bool Monitor::awaitReply(nat payloadSize, std::vector<byte> &payload) {
+  //The payload comes at line rate, give it twice the time it needs
+  double bytes = payloadSize + 4;
+  double deadline = Port::now() + 2 * bytes * 10 * 1000 / port.getBaud() + 100;
+
+  byte reply[2];
+  while (true) {
+    if (!readBytes(reply, 1, deadline)) return false;
+    if (reply[0] != FRAME_ACK && reply[0] != FRAME_NAK) continue;
+    if (!readBytes(reply + 1, 1, deadline)) return false;
+    if (reply[1] == seq) break;
+  }
+  if (reply[0] == FRAME_NAK) return false;
+  if (payloadSize == 0) return true;
+
+  payload.resize(payloadSize + 2);
+  if (!readBytes(&payload[0], payload.size(), deadline)) return false;
+
+  nat crc = 0xFFFF;
+  for (nat i = 0; i < payloadSize; i++) crc = crc16(crc, payload[i]);
+  nat got = payload[payloadSize] | (payload[payloadSize + 1] << 8);
+  payload.resize(payloadSize);
+  return crc == got;
+}
+
+bool Monitor::readBytes(byte *to, nat size, double deadline) {
+  nat got = 0;
+  while (got < size) {
+    got += port.read(to + got, size - got);
+    if (got == size) break;
+    double left = deadline - Port::now();
+    if (left <= 0) return false;
+    port.waitForData(nat(std::min(left, 100.0)) + 1);
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "port.h"
+#include "protocol.h"
+
+#include <vector>
+
+//Talks to the debug monitor in serial.vhd, which can stall the cpu and
+//read and write anything on its bus. Every call waits for the answer and
+//sends the frame again if it gets lost or garbled.
+//
+//Reading and writing stall the cpu for as long as they take, so they can
+//be used while a game runs. Writes to IF (0xFF0F), IE (0xFFFF) and DMA
+//(0xFF46) are not seen by the cpu, it keeps its own copy of those.
+class Monitor {
+public:
+  Monitor(Port &port);
+
+  //Stalls the cpu before its next instruction, pc is the address of it.
+  bool halt(nat &pc);
+  bool resume();
+  //Runs one instruction of a halted cpu. If the answer is lost, the frame
+  //is sent again and the cpu takes one more step.
+  bool step(nat &pc);
+
+  bool peek(nat addr, byte &value);
+  bool poke(nat addr, byte value);
+
+  //Reads size bytes starting at addr. The address wraps at 0xFFFF.
+  bool read(nat addr, nat size, std::vector<byte> &to);
+  bool write(nat addr, const byte *data, nat size);
+  //Writes size bytes of value, in one frame for every 64K.
+  bool fill(nat addr, nat size, byte value);
+
+  //Give up when a frame has been sent this many times.
+  void setMaxTries(nat tries) { maxTries = tries; }
+
+  //Picks the fastest rate in BAUD_RATES that works both ways. The adapter
+  //has to accept it, and after a break and the sync byte the FPGA has to
+  //answer a read, otherwise the next lower rate is tried. The port is
+  //left at the rate, with the FPGA synced to it. Returns the rate, or 0
+  //if the board did not answer at any of them.
+  int negotiateBaud();
+
+  const String &error() const { return errorMsg; }
+
+private:
+  Port &port;
+  byte seq;
+  nat maxTries;
+  String errorMsg;
+
+  //Sends a frame and waits for the ACK and payloadSize bytes of payload.
+  bool transact(byte type, nat addr, const byte *data, nat size,
+		nat payloadSize, std::vector<byte> &payload);
+  //Waits for the answer to the frame with sequence number seq. Returns
+  //false if it has to be sent again.
+  bool awaitReply(nat payloadSize, std::vector<byte> &payload);
+  //Reads exactly size bytes, or returns false when the deadline passes.
+  bool readBytes(byte *to, nat size, double deadline);
+};
+
+//Bytes asked for in one FRAME_READ. Smaller reads make a garbled answer
+//cheaper to get again, larger ones wait less for the round trips.
+const nat MONITOR_READ_CHUNK = 16384;
+//Tries of the read that confirms a baud rate, a rate the FPGA gets
+//wrong garbles every one of them.
+const nat BAUD_CONFIRM_TRIES = 2;
@@ -2,16 +2,44 @@
 
 #include "port.h"
 
+bool Port::write(const byte *buffer, nat size) {
+  if (startTime < 0) startTime = now();
+
+  pending.insert(pending.end(), buffer, buffer + size);
+  while (pending.size() - pendingStart >= PORT_BUFFER_SIZE) {
+    if (!pump(true)) return false;
+  }
+
+  //Give the driver what it wants right now, the rest stays buffered.
+  return pump(false);
+}
+
+const PortStats &Port::stats() {
+  if (startTime >= 0) portStats.seconds = (now() - startTime) / 1000.0;
+  return portStats;
+}
+
+void Port::compact() {
+  if (pendingStart == pending.size()) {
+    pending.clear();
+    pendingStart = 0;
+  } else if (pendingStart >= PORT_BUFFER_SIZE) {
+    pending.erase(pending.begin(), pending.begin() + pendingStart);
+    pendingStart = 0;
+  }
+}
+
 #ifdef _WIN32
 
 #include <sstream>
 
-Port::Port(const String &port, int baud) {
+Port::Port(const String &port, int baud) : pendingStart(0), writeTimeout(1000), currentBaud(0), startTime(-1) {
   handle = INVALID_HANDLE_VALUE;
   openPort(port, baud);
 }
 
 Port::~Port() {
+  if (isOpen()) flush();
   close();
 }
 
@@ -19,16 +47,47 @@ bool Port::isOpen() const {
   return handle != INVALID_HANDLE_VALUE;
 }
 
-void Port::write(byte *buffer, nat size) {
-  while (size > 0) {
+//The handle is blocking, WriteFile waits as long as the timeouts
+//set in openPort allow, and returns 0 bytes when they expire.
+bool Port::pump(bool wait) {
+  while (pendingStart < pending.size()) {
     DWORD ret;
-    if (WriteFile(handle, buffer, size, &ret, 0) == FALSE) {
-      //ERROR!
-      break;
+    if (WriteFile(handle, &pending[pendingStart], pending.size() - pendingStart, &ret, 0) == FALSE) {
+      DEBUG("Failed to write: " << int(GetLastError()));
+      return false;
     }
-    buffer += ret;
-    size -= ret;
+    if (ret == 0) {
+      portStats.stalls++;
+      if (!wait) break;
+      DEBUG("Timeout while writing, the port does not accept any data");
+      return false;
+    }
+    pendingStart += ret;
+    portStats.bytesSent += ret;
   }
+  compact();
+  return true;
+}
+
+bool Port::flush() {
+  if (!pump(true)) return false;
+  return FlushFileBuffers(handle) != FALSE;
+}
+
+double Port::now() {
+  return GetTickCount();
+}
+
+bool Port::sendBreak() {
+  if (!flush()) return false;
+  if (!SetCommBreak(handle)) return false;
+  Sleep(20);
+  return ClearCommBreak(handle) != FALSE;
+}
+
+//Reads already wait for the timeout set in openPort.
+bool Port::waitForData(nat ms) {
+  return true;
 }
 
 nat Port::read(byte *buffer, nat size) {
@@ -77,6 +136,19 @@ void Port::openPort(const String &port, int baud) {
   timeout.WriteTotalTimeoutMultiplier = 20;
 
   SetCommTimeouts(handle, &timeout);
+  currentBaud = baud;
+}
+
+bool Port::setBaud(int baud) {
+  DCB dcb;
+  FillMemory(&dcb, sizeof(dcb), 0);
+  dcb.DCBlength = sizeof(dcb);
+  if (!GetCommState(handle, &dcb)) return false;
+  dcb.BaudRate = baud;
+  if (!SetCommState(handle, &dcb)) return false;
+  if (!GetCommState(handle, &dcb) || dcb.BaudRate != DWORD(baud)) return false;
+  currentBaud = baud;
+  return true;
 }
 
 void Port::close() {
@@ -92,8 +164,51 @@ void Port::close() {
 #include <errno.h>
 #include <unistd.h>
 #include <termios.h>
+#include <poll.h>
+#include <time.h>
+#include <cstring>
 #include <sys/ioctl.h>
 
+#ifdef __linux__
+//The kernel's asm/termbits.h clashes with termios.h, so struct termios2
+//is declared here instead. It is used for rates without a Bxxx constant.
+struct PortTermios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+#define PORT_TCGETS2 _IOR('T', 0x2A, PortTermios2)
+#define PORT_TCSETS2 _IOW('T', 0x2B, PortTermios2)
+
+bool setCustomBaud(int fd, int baud) {
+  PortTermios2 options;
+  if (ioctl(fd, PORT_TCGETS2, &options) != 0) return false;
+  options.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+  options.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  options.c_ispeed = baud;
+  options.c_ospeed = baud;
+  if (ioctl(fd, PORT_TCSETS2, &options) != 0) return false;
+
+  //The driver rounds to what the adapter can do, 3% off is still fine
+  if (ioctl(fd, PORT_TCGETS2, &options) != 0) return false;
+  int diff = int(options.c_ospeed) - baud;
+  if (diff < 0) diff = -diff;
+  return diff * 100 <= baud * 3;
+}
+#endif
+
 bool Port::isOpen() const {
   return portFd != -1;
 }
@@ -123,7 +238,7 @@ void setdtr (int fd, int on) {
   ioctl(fd, (on ? TIOCMBIS : TIOCMBIC), &controlbits);
 }
 
-Port::Port(const String &port, int baud) {
+Port::Port(const String &port, int baud) : pendingStart(0), writeTimeout(1000), currentBaud(0), startTime(-1) {
   portFd = -1;
 
   openPort(port, baud);
@@ -131,6 +246,7 @@ Port::Port(const String &port, int baud) {
 
 Port::~Port() {
   if (portFd != -1) {
+    flush();
     close(portFd);
   }
 }
@@ -141,8 +257,67 @@ nat Port::read(byte *buffer, nat size) {
   return nat(r);
 }
 
-void Port::write(byte *buffer, nat size) {
-  ::write(portFd, buffer, size);
+//The port is opened with O_NDELAY, so the driver takes what fits in
+//its buffer and we poll() for room when it is full.
+bool Port::pump(bool wait) {
+  while (pendingStart < pending.size()) {
+    ssize_t r = ::write(portFd, &pending[pendingStart], pending.size() - pendingStart);
+    if (r > 0) {
+      pendingStart += r;
+      portStats.bytesSent += r;
+      continue;
+    }
+
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      DEBUG("Failed to write: " << strerror(errno));
+      return false;
+    }
+
+    portStats.stalls++;
+    if (!wait) break;
+
+    struct pollfd fd;
+    fd.fd = portFd;
+    fd.events = POLLOUT;
+    fd.revents = 0;
+    int ready = poll(&fd, 1, writeTimeout);
+    if (ready == 0) {
+      DEBUG("Timeout while writing, the port has not accepted any data for " << writeTimeout << " ms");
+      return false;
+    } else if (ready < 0 && errno != EINTR) {
+      DEBUG("Failed to wait for the port: " << strerror(errno));
+      return false;
+    }
+  }
+  compact();
+  return true;
+}
+
+bool Port::flush() {
+  if (!pump(true)) return false;
+  return tcdrain(portFd) == 0;
+}
+
+double Port::now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+bool Port::sendBreak() {
+  if (!flush()) return false;
+  if (ioctl(portFd, TIOCSBRK) != 0) return false;
+  usleep(20000);
+  return ioctl(portFd, TIOCCBRK) == 0;
+}
+
+bool Port::waitForData(nat ms) {
+  struct pollfd fd;
+  fd.fd = portFd;
+  fd.events = POLLIN;
+  fd.revents = 0;
+  return poll(&fd, 1, ms) > 0;
 }
 
 
@@ -184,8 +359,24 @@ tcflag_t getBaudrate(int rate) {
     return B115200;
   case 230400:
     return B230400;
+#ifdef B460800
+  case 460800:
+    return B460800;
+#endif
+#ifdef B921600
+  case 921600:
+    return B921600;
+#endif
+#ifdef B2000000
+  case 2000000:
+    return B2000000;
+#endif
+#ifdef B3000000
+  case 3000000:
+    return B3000000;
+#endif
   default:
-    std::cerr << "Invalid baudrate specified!" << std::endl;
+    //Not a standard rate, see setBaud
     return B0;
   }
 }
@@ -200,8 +391,6 @@ void Port::openPort(const String &port, int baud) {
 
   struct termios options;
   tcgetattr(portFd, &options);
-  cfsetispeed(&options, getBaudrate(baud));
-  cfsetospeed(&options, getBaudrate(baud));
   options.c_cflag |= (CLOCAL | CREAD);
   options.c_cflag &= ~PARENB;
   options.c_cflag &= ~CSTOPB;
@@ -219,6 +408,34 @@ void Port::openPort(const String &port, int baud) {
 
   setrts(portFd, false);
   setdtr(portFd, false);
+
+  if (!setBaud(baud)) {
+    std::cerr << "Invalid baudrate specified!" << std::endl;
+  }
+}
+
+bool Port::setBaud(int baud) {
+  speed_t speed = getBaudrate(baud);
+  if (speed == B0) {
+#ifdef __linux__
+    if (!setCustomBaud(portFd, baud)) return false;
+    currentBaud = baud;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  struct termios options;
+  if (tcgetattr(portFd, &options) != 0) return false;
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+  if (tcsetattr(portFd, TCSANOW, &options) != 0) return false;
+
+  //tcsetattr succeeds if anything at all was changed, so check
+  if (tcgetattr(portFd, &options) != 0 || cfgetospeed(&options) != speed) return false;
+  currentBaud = baud;
+  return true;
 }
 
 #endif
@@ -6,6 +6,23 @@
 #undef max
 #endif
 
+#include <vector>
+
+//Live numbers for what has been written so far.
+struct PortStats {
+  PortStats() : bytesSent(0), stalls(0), seconds(0) {}
+
+  //Bytes the driver has accepted.
+  nat bytesSent;
+  //How many times we had to wait for the driver to accept more data.
+  nat stalls;
+  //Time since the first write.
+  double seconds;
+
+  //Bits per second actually achieved, assuming 8N1 (10 bits per byte).
+  double baud() const { return seconds > 0 ? bytesSent * 10 / seconds : 0; }
+};
+
 class Port {
 public:
   Port(const String &port, int baud);
@@ -13,10 +30,45 @@ public:
 
   bool isOpen() const;
 
-  void write(byte *buffer, nat size);
+  //Changes the baud rate. Returns false if the adapter does not accept
+  //it (or rounds it off by more than a UART tolerates).
+  bool setBaud(int baud);
+  int getBaud() const { return currentBaud; }
+
+  //Buffered write. Blocks (at most the timeout at a time) while the
+  //buffer is full. Returns false if the port stopped accepting data.
+  bool write(const byte *buffer, nat size);
+
+  //Writes everything buffered and waits until it has been transmitted.
+  bool flush();
+
+  //How long to wait for the port to accept more data before giving up.
+  void setTimeout(nat ms) { writeTimeout = ms; }
+
+  const PortStats &stats();
+
+  //Hands buffered data to the driver without waiting. Returns false on errors.
+  bool sendPending() { return pump(false); }
+  //True while there is buffered data the driver has not taken yet.
+  bool hasPending() const { return pendingStart < pending.size(); }
+
+  //Holds the line low for a while, after flushing what is buffered.
+  //serial.vhd starts over from the sync byte after a break.
+  bool sendBreak();
+
+  //Waits at most ms for something to read. Returns true if there is.
+  bool waitForData(nat ms);
+
+  //Milliseconds from a monotonic clock.
+  static double now();
 
   //Set as nonblocking. Returns the number of bytes actually read.
   nat read(byte *buffer, nat size);
+
+#ifndef _WIN32
+  //To wait for several ports at once.
+  int fd() const { return portFd; }
+#endif
 private:
 #ifdef _WIN32
   HANDLE handle;
@@ -27,4 +79,28 @@ private:
 #endif
 
   void openPort(const String &port, int baud);
+
+  //Data not yet accepted by the driver, starting at pendingStart.
+  std::vector<byte> pending;
+  nat pendingStart;
+  nat writeTimeout;
+  int currentBaud;
+
+  PortStats portStats;
+  //Time of the first write, in ms.
+  double startTime;
+
+  //Tries to hand the pending data to the driver. If wait is set, waits
+  //for the driver when it is full. Returns false on timeout or error.
+  bool pump(bool wait);
+  //Drops what has been written from the front of pending.
+  void compact();
 };
+
+//Writes are buffered until there is this much data.
+const nat PORT_BUFFER_SIZE = 4096;
+
+//Rates tried by Monitor::negotiateBaud, fastest first. serial.vhd can handle
+//all of them at 100 MHz (3M baud is 33 clock cycles per bit).
+const int BAUD_RATES[] = { 3000000, 2000000, 921600, 460800, 230400, 115200 };
+const nat BAUD_RATES_COUNT = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "protocol.h"
+
+#include <algorithm>
+
+nat crc16(nat crc, byte data) {
+  crc ^= nat(data) << 8;
+  for (int i = 0; i < 8; i++) {
+    if (crc & 0x8000) {
+      crc = (crc << 1) ^ 0x1021;
+    } else {
+      crc = crc << 1;
+    }
+  }
+  return crc & 0xFFFF;
+}
+
+std::vector<byte> buildFrame(byte type, byte seq, nat addr, const byte *data, nat size) {
+  std::vector<byte> frame;
+  frame.reserve(size + FRAME_OVERHEAD);
+  frame.push_back(FRAME_SOF);
+  frame.push_back(type);
+  frame.push_back(seq);
+  frame.push_back(byte(size));
+  frame.push_back(byte(addr & 0xFF));
+  frame.push_back(byte((addr >> 8) & 0xFF));
+  frame.push_back(byte((addr >> 16) & 0xFF));
+  frame.insert(frame.end(), data, data + size);
+
+  nat crc = 0xFFFF;
+  for (nat i = 1; i < frame.size(); i++) {
+    crc = crc16(crc, frame[i]);
+  }
+  frame.push_back(byte(crc & 0xFF));
+  frame.push_back(byte(crc >> 8));
+  return frame;
+}
+
+//Longest run of the same byte at the start of data.
+static nat runLength(const byte *data, nat size) {
+  nat len = 1;
+  while (len < size && data[len] == data[0]) len++;
+  return len;
+}
+
+//Longest match for data[pos...] within the 256 bytes before it.
+static nat matchLength(const byte *data, nat pos, nat size, nat &distance) {
+  nat best = 0;
+  nat first = pos > 256 ? pos - 256 : 0;
+  for (nat from = first; from < pos; from++) {
+    nat len = 0;
+    while (len < 66 && pos + len < size && data[from + len] == data[pos + len]) len++;
+    if (len > best) {
+      best = len;
+      distance = pos - from;
+    }
+  }
+  return best;
+}
+
+nat packFrame(const byte *data, nat size, std::vector<byte> &out) {
+  out.clear();
+  size = std::min(size, FRAME_MAX_UNPACKED);
+
+  nat pos = 0;
+  //Where the control byte of the current literal token is
+  nat literal = 0;
+  bool inLiteral = false;
+
+  while (pos < size) {
+    nat run = runLength(data + pos, size - pos);
+    nat distance = 0;
+    nat match = matchLength(data, pos, size, distance);
+
+    if (run >= 3 && run >= match) {
+      if (out.size() + 3 > FRAME_MAX_DATA) break;
+      run = std::min(run, nat(0x3FFF + 3));
+      out.push_back(byte(0x80 | ((run - 3) >> 8)));
+      out.push_back(byte((run - 3) & 0xFF));
+      out.push_back(data[pos]);
+      pos += run;
+      inLiteral = false;
+    } else if (match >= 3) {
+      if (out.size() + 2 > FRAME_MAX_DATA) break;
+      out.push_back(byte(0xC0 | (match - 3)));
+      out.push_back(byte(distance - 1));
+      pos += match;
+      inLiteral = false;
+    } else {
+      if (!inLiteral || out[literal] == 0x7F) {
+        if (out.size() + 2 > FRAME_MAX_DATA) break;
+        literal = out.size();
+        out.push_back(0x00);
+        inLiteral = true;
+      } else {
+        if (out.size() + 1 > FRAME_MAX_DATA) break;
+        out[literal]++;
+      }
+      out.push_back(data[pos++]);
+    }
+  }
+  return pos;
+}
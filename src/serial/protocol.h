@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+//The upload protocol understood by serial.vhd. Everything is sent in frames:
+//
+//  SOF, type, sequence number, length, address (3 bytes, LSB first),
+//  length bytes of data, CRC-16 of everything after SOF (LSB first)
+//
+//The FPGA answers every frame with ACK or NAK followed by the sequence
+//number of the frame. Frames only write to the address they carry, so they
+//may be resent in any order.
+
+const byte FRAME_SOF = 0xA5;
+const byte FRAME_ACK = 0x06;
+const byte FRAME_NAK = 0x15;
+
+//Write the data to the rom at the address.
+const byte FRAME_DATA = 0x01;
+//Hold the cpu in reset.
+const byte FRAME_START = 0x02;
+//Release the cpu, the upload is done.
+const byte FRAME_END = 0x03;
+//Unpack the data to the rom, starting at the address. The data is a list
+//of tokens, the first byte tells what it is:
+//  0xxxxxxx             x + 1 literal bytes follow
+//  10xxxxxx y v         (x << 8 | y) + 3 bytes of v
+//  11xxxxxx d           x + 3 bytes copied from d + 1 bytes back
+//Matches never reach outside the frame, so frames can still be resent
+//in any order.
+const byte FRAME_PACKED = 0x04;
+
+//The debug monitor, see Monitor in monitor.h. The ACK to these is followed
+//by a payload and a CRC-16 of the payload (LSB first), if there is one.
+//Stall the cpu before its next instruction. Payload: the PC (LSB first).
+const byte FRAME_HALT = 0x05;
+//Let the cpu run again.
+const byte FRAME_RESUME = 0x06;
+//Run one instruction. Payload: the PC of the next one.
+const byte FRAME_STEP = 0x07;
+//Data: the number of bytes - 1, 16 bits. Payload: that many bytes from
+//the bus, starting at the address.
+const byte FRAME_READ = 0x08;
+//Write the data to the bus, starting at the address.
+const byte FRAME_WRITE = 0x09;
+//Data: the number of bytes - 1, 16 bits, and a value. Write that many
+//bytes of the value to the bus, starting at the address.
+const byte FRAME_FILL = 0x0A;
+
+//The FPGA collects a frame before it checks it, this is its buffer size.
+const nat FRAME_MAX_DATA = 255;
+//SOF, type, sequence number, length, address and CRC.
+const nat FRAME_OVERHEAD = 9;
+//The address is the offset in the rom file. bus_controller.vhd maps it
+//in 16K banks, up to 8MB like the MBC5.
+const nat MAX_ROM_SIZE = 1 << 23;
+//serial.vhd unpacks a frame while the next one arrives, one byte per
+//clock cycle. The shortest frame takes 2640 cycles at 3M baud.
+const nat FRAME_MAX_UNPACKED = 2048;
+
+//Sent before the first frame after a break, serial.vhd measures the baud
+//rate from it (see Auto_Baud there).
+const byte SYNC_BYTE = 0x55;
+
+//CRC-16-CCITT (polynomial 0x1021), start with 0xFFFF.
+nat crc16(nat crc, byte data);
+
+std::vector<byte> buildFrame(byte type, byte seq, nat addr, const byte *data, nat size);
+
+//Packs as much of data as fits in one FRAME_PACKED frame into out.
+//Returns the number of bytes of data used.
+nat packFrame(const byte *data, nat size, std::vector<byte> &out);
@@ -1,26 +1,296 @@
 #include "stdafx.h"
 #include "port.h"
+#include "uploader.h"
+#include "monitor.h"
 
 #include <algorithm>
 #include <fstream>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <iterator>
+#include <iomanip>
+#include <sstream>
 
-const nat FILE_SIZE_BYTES = 2;
-const nat MAX_FILE_SIZE = 1 << (FILE_SIZE_BYTES * 8) - 1;
-const nat CHUNK = 1024;
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 void printHelp(char *name) {
-  DEBUG(name << " [port] [-b baud] [file]");
+  DEBUG(name << " [port] [-b baud|auto] [-n] [-u] [-f] [file]");
+  DEBUG("  port     One port, or several separated by commas to upload to all");
+  DEBUG("           those boards at the same time");
+  DEBUG("  -b auto  Use the fastest rate the serial adapter and the board both get right");
+  DEBUG("  -n       Do not send the sync byte, for Serial built with Auto_Baud = false");
+  DEBUG("  -u       Do not pack the data");
+  DEBUG("  -f       Send everything, not only what changed since the last upload.");
+  DEBUG("           Without it the start of the rom is read back first, and");
+  DEBUG("           everything is sent if the board no longer has the last upload.");
+  DEBUG(name << " [port] [-b baud|auto] [-n] -m command");
+  DEBUG("  Talks to the debug monitor instead, the command is one of:");
+  DEBUG("  halt                   Stall the cpu");
+  DEBUG("  resume                 Let it run again");
+  DEBUG("  step [count]           Run count instructions (1) of a halted cpu");
+  DEBUG("  peek addr              Read a byte from the bus");
+  DEBUG("  poke addr value        Write a byte to the bus");
+  DEBUG("  dump from to file      Write the bytes from-to (including to) to file");
+  DEBUG("  fill from to value     Write value to the bytes from-to (including to)");
+  DEBUG("  Addresses and values are in hex.");
+}
+
+//The start of the rom, the restart and interrupt vectors and the header
+//with the title and checksums, is read back to see if the cache is right.
+const nat CACHE_CHECK_SIZE = 0x150;
+
+//Whether the board still has last, what the cache says was uploaded. It
+//loses it when the FPGA is reprogrammed or turned off. Leaves the FPGA
+//synced if sync is set.
+bool boardHasCache(Port &port, bool sync, const std::vector<byte> &last) {
+  if (sync && (!port.sendBreak() || !port.write(&SYNC_BYTE, 1))) return false;
+
+  Monitor monitor(port);
+  monitor.setMaxTries(3);
+  std::vector<byte> rom;
+  nat size = std::min(nat(last.size()), CACHE_CHECK_SIZE);
+  if (!monitor.read(0, size, rom)) return false;
+  return std::equal(rom.begin(), rom.end(), last.begin()) && rom.size() == size;
+}
+
+//Reads what was uploaded to port last time into last, if the board
+//still has it
+bool readDelta(Port &port, const String &name, bool sync, std::vector<byte> &last) {
+  if (!readCache(name, last)) return false;
+  if (boardHasCache(port, sync, last)) return true;
+
+  DEBUG(name << " no longer has the last upload, sending everything");
+  last.clear();
+  return false;
+}
+
+nat hex(const String &s) {
+  return nat(strtoul(s.c_str(), 0, 16));
+}
+
+String hexString(nat value, nat digits) {
+  std::ostringstream oss;
+  oss << std::hex << std::uppercase << std::setfill('0') << std::setw(digits) << value;
+  return oss.str();
+}
+
+int runMonitor(Port &p, const std::vector<String> &args) {
+  Monitor monitor(p);
+  const String &cmd = args[0];
+  bool ok = false;
+
+  if (cmd == "halt" && args.size() == 1) {
+    nat pc;
+    if ((ok = monitor.halt(pc))) DEBUG("Halted at " << hexString(pc, 4));
+  } else if (cmd == "resume" && args.size() == 1) {
+    if ((ok = monitor.resume())) DEBUG("Running");
+  } else if (cmd == "step" && args.size() <= 2) {
+    nat count = args.size() == 2 ? atoi(args[1].c_str()) : 1;
+    nat pc = 0;
+    ok = true;
+    for (nat i = 0; ok && i < count; i++) ok = monitor.step(pc);
+    if (ok) DEBUG("Stopped at " << hexString(pc, 4));
+  } else if (cmd == "peek" && args.size() == 2) {
+    byte value;
+    if ((ok = monitor.peek(hex(args[1]), value))) DEBUG(hexString(hex(args[1]), 4) << ": " << hexString(value, 2));
+  } else if (cmd == "poke" && args.size() == 3) {
+    ok = monitor.poke(hex(args[1]), byte(hex(args[2])));
+  } else if (cmd == "dump" && args.size() == 4) {
+    nat from = hex(args[1]), to = hex(args[2]);
+    if (from > to || to > 0xFFFF) {
+      DEBUG("Error: Expected from <= to <= FFFF");
+      return 2;
+    }
+    std::vector<byte> data;
+    double start = Port::now();
+    if ((ok = monitor.read(from, to - from + 1, data))) {
+      std::ofstream f(args[3].c_str(), std::ios::binary);
+      f.write((const char *)&data[0], data.size());
+      DEBUG("Read " << data.size() << " bytes in " << (Port::now() - start) / 1000.0 << " s");
+    }
+  } else if (cmd == "fill" && args.size() == 4) {
+    nat from = hex(args[1]), to = hex(args[2]);
+    if (from > to || to > 0xFFFF) {
+      DEBUG("Error: Expected from <= to <= FFFF");
+      return 2;
+    }
+    ok = monitor.fill(from, to - from + 1, byte(hex(args[3])));
+  } else {
+    DEBUG("Error: Unknown monitor command");
+    return 2;
+  }
+
+  if (!ok) {
+    DEBUG("Error: " << monitor.error());
+    return 5;
+  }
+  return 0;
+}
+
+//One board of an upload to several of them.
+class Target {
+public:
+  Target(const String &name, int baud) : name(name), port(name, baud), upload(0), doneAt(0), baud(0) {}
+  ~Target() { delete upload; }
+
+  String name;
+  Port port;
+  //What the rom contained before, if we know
+  std::vector<byte> last;
+  Uploader *upload;
+  double doneAt;
+  //What the port achieved, when it was done
+  double baud;
+};
+
+//Uploads image to all ports at the same time, an Uploader for each. One
+//loop waits for answers (or room to write) on any of the ports and steps
+//the uploads, so it takes about as long as the slowest board alone.
+int uploadRack(const std::vector<String> &ports, const std::vector<byte> &image,
+	       int baud, bool autoBaud, bool sync, bool pack, bool full) {
+  std::vector<Target *> targets;
+  int result = 0;
+  for (nat i = 0; i < ports.size() && result == 0; i++) {
+    Target *t = new Target(ports[i], baud);
+    targets.push_back(t);
+    if (!t->port.isOpen()) {
+      DEBUG("Failed to open port: " << ports[i]);
+      result = 3;
+    } else if (autoBaud ? Monitor(t->port).negotiateBaud() == 0 : t->port.getBaud() != baud) {
+      DEBUG("Error: " << ports[i] << (autoBaud ? " does not answer at any baud rate" : " does not accept the baud rate"));
+      result = 3;
+    }
+  }
+  if (result != 0) {
+    for (nat i = 0; i < targets.size(); i++) delete targets[i];
+    return result;
+  }
+
+  for (nat i = 0; i < targets.size(); i++) {
+    Target *t = targets[i];
+    bool delta = !full && readDelta(t->port, t->name, sync, t->last);
+    remove(cachePath(t->name).c_str());
+    t->upload = new Uploader(t->port, image, sync, pack, delta ? &t->last : 0);
+    DEBUG("Sending " << t->upload->bytesTotal() << " bytes to " << t->name << " at " << t->port.getBaud() << " baud"
+	  << (delta ? ", what changed since the last upload" : ""));
+  }
+
+#ifdef __linux__
+  int ep = epoll_create1(0);
+  std::vector<bool> watchWrite(targets.size(), false);
+  for (nat i = 0; i < targets.size(); i++) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(ep, EPOLL_CTL_ADD, targets[i]->port.fd(), &ev);
+  }
+#endif
+
+  double start = Port::now(), lastReport = 0;
+  nat running = targets.size();
+  while (running > 0) {
+#ifdef __linux__
+    struct epoll_event events[16];
+    epoll_wait(ep, events, 16, 5);
+#else
+    for (nat i = 0; i < targets.size(); i++) {
+      if (targets[i]->doneAt == 0) {
+	targets[i]->port.waitForData(5);
+	break;
+      }
+    }
+#endif
+
+    //Stepping is cheap, and the quiet ones may have frames to resend
+    for (nat i = 0; i < targets.size(); i++) {
+      Target *t = targets[i];
+      if (t->doneAt != 0) continue;
+      if (!t->upload->step()) {
+	t->doneAt = Port::now();
+	t->baud = t->port.stats().baud();
+	running--;
+      }
+#ifdef __linux__
+      //Only wake up for room to write while something waits for it
+      bool pending = t->doneAt == 0 && t->port.hasPending();
+      if (pending != watchWrite[i]) {
+	struct epoll_event ev;
+	ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+	ev.data.u32 = i;
+	epoll_ctl(ep, EPOLL_CTL_MOD, t->port.fd(), &ev);
+	watchWrite[i] = pending;
+      }
+#endif
+    }
+
+    if (Port::now() - lastReport > 250 || running == 0) {
+      lastReport = Port::now();
+      std::cout << "\rSending...";
+      for (nat i = 0; i < targets.size(); i++) {
+	const Uploader &u = *targets[i]->upload;
+	std::cout << " " << targets[i]->name << ": " << u.bytesAcked() * 100 / std::max(u.bytesTotal(), nat(1)) << "%";
+      }
+      std::cout << std::flush;
+    }
+  }
+  std::cout << std::endl;
+#ifdef __linux__
+  close(ep);
+#endif
+
+  nat crc = 0xFFFF;
+  for (nat i = 0; i < image.size(); i++) crc = crc16(crc, image[i]);
+
+  nat ok = 0;
+  for (nat i = 0; i < targets.size(); i++) {
+    Target *t = targets[i];
+    const Uploader &u = *t->upload;
+    if (u.failed()) {
+      DEBUG(t->name << ": Error: " << u.error() << ", " << u.bytesAcked() << " bytes got through");
+    } else {
+      ok++;
+      writeCache(t->name, image);
+      DEBUG(t->name << ": all " << u.framesTotal() << " frames acked in " << (t->doneAt - start) / 1000.0 << " s, "
+	    << nat(t->baud) << " baud, " << u.retransmits() << " resent");
+    }
+  }
+  DEBUG(ok << " of " << targets.size() << " boards have the image, CRC-16 " << hexString(crc, 4));
+
+  for (nat i = 0; i < targets.size(); i++) delete targets[i];
+  return ok == targets.size() ? 0 : 5;
 }
 
 int main(int argc, char **argv) {
   String port, file;
   int baud = 115200;
+  bool autoBaud = false;
+  bool sync = true;
+  bool pack = true;
+  bool full = false;
+  std::vector<String> monitorArgs;
 
   for (int i = 1; i < argc; i++) {
-    if (strcmp(argv[i], "-b") == 0) {
-      baud = atoi(argv[++i]);
+    if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "auto") == 0) {
+        autoBaud = true;
+      } else {
+        baud = atoi(argv[i]);
+      }
+    } else if (strcmp(argv[i], "-n") == 0) {
+      sync = false;
+    } else if (strcmp(argv[i], "-u") == 0) {
+      pack = false;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      full = true;
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      monitorArgs.assign(argv + i + 1, argv + argc);
+      break;
     } else if (port == "") {
       port = argv[i];
     } else if (file == "") {
@@ -31,65 +301,113 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (port == "" || file == "") {
+  if (port == "" || (file == "") == monitorArgs.empty()) {
     printHelp(argv[0]);
     return 2;
   }
 
+  std::vector<String> ports;
+  std::stringstream list(port);
+  for (String name; std::getline(list, name, ',');) {
+    if (!name.empty()) ports.push_back(name);
+  }
+  if (ports.size() > 1 && !monitorArgs.empty()) {
+    DEBUG("Error: The monitor talks to one board at a time");
+    return 2;
+  }
+  if (autoBaud && !sync) {
+    DEBUG("Error: -b auto needs the sync byte");
+    return 2;
+  }
+
+  std::vector<byte> image;
+  if (monitorArgs.empty()) {
+    std::ifstream f(file.c_str(), std::ios::binary);
+    if (!f.is_open()) {
+      DEBUG("Error: Failed to open: " << file);
+      return 6;
+    }
+    f.seekg(0, std::ios::end);
+    nat size = f.tellg();
+    f.seekg(0);
+
+    //Some checks here....
+    if (size > MAX_ROM_SIZE) {
+      DEBUG("Error: The file is too large: " << size << ", max is: " << MAX_ROM_SIZE);
+      return 4;
+    }
+
+    image.resize(size);
+    if (size > 0) f.read((char *)&image[0], size);
+  }
+
+  if (ports.size() > 1) return uploadRack(ports, image, baud, autoBaud, sync, pack, full);
+
   Port p(port, baud);
   if (!p.isOpen()) {
     DEBUG("Failed to open port: " << port);
     return 3;
   }
 
-  std::ifstream f(file.c_str(), std::ios::binary);
-  if (!f.is_open()) {
-    DEBUG("Error: Failed to open: " << file);
-    return 6;
+  if (autoBaud) {
+    baud = Monitor(p).negotiateBaud();
+    if (baud == 0) {
+      DEBUG("Error: The board does not answer at any of the usual rates");
+      return 3;
+    }
+  } else if (p.getBaud() != baud) {
+    DEBUG("Error: The adapter does not accept " << baud << " baud");
+    return 3;
   }
-  f.seekg(0, std::ios::end);
-  nat size = f.tellg();
-  f.seekg(0);
-  nat sent = 0;
 
-  //Some checks here....
-  if (size > MAX_FILE_SIZE) {
-    DEBUG("Error: The file is too large: " << size << ", max is: " << MAX_FILE_SIZE);
-    return 4;
+  if (!monitorArgs.empty()) {
+    //Let the FPGA measure the baud rate, the cpu keeps running meanwhile
+    if (sync && (!p.sendBreak() || !p.write(&SYNC_BYTE, 1))) {
+      DEBUG("Error: Failed to send the sync byte");
+      return 3;
+    }
+    return runMonitor(p, monitorArgs);
   }
 
   DEBUG("Sending " << file << " to " << port << " at " << baud << " baud...");
 
-  //Calculate a simple checksum
-  byte checksum = 0;
+  std::vector<byte> last;
+  bool delta = !full && readDelta(p, port, sync, last);
+  //If this one fails we don't know what the rom contains
+  remove(cachePath(port).c_str());
 
-  //Send size. LSB first.
-  nat s = size;
-  byte buffer[CHUNK];
-  for (int i = 0; i < FILE_SIZE_BYTES; i++) {
-    byte b = s & 0xFF;
-    s = s >> 8;
-    p.write(&b, 1);
+  Uploader upload(p, image, sync, pack, delta ? &last : 0);
+  if (delta) {
+    DEBUG("Only sending what changed since the last upload, " << upload.bytesTotal() << " bytes");
   }
+  if (pack) {
+    nat plain = upload.plainWireBytes(), packed = upload.wireBytes();
+    DEBUG("Packed to " << packed << " of " << plain << " bytes (" << (packed * 100 / std::max(plain, nat(1)))
+	  << "%), saves about " << double(plain - packed) * 10 / baud << " s");
+  }
+  double start = Port::now();
+  nat lastAcked = nat(-1);
+  while (upload.step()) {
+    p.waitForData(5);
 
-  //Send the actual data.
-  std::cout << "Sending..." << std::flush;
-  while (sent < size) {
-    nat toSend = std::min(size - sent, CHUNK);
-    f.read((char *)buffer, toSend);
-    p.write(buffer, toSend);
-    sent += toSend;
-
-    for (nat i = 0; i < toSend; i++) {
-      checksum += buffer[i];
+    if (upload.framesAcked() != lastAcked) {
+      lastAcked = upload.framesAcked();
+      const PortStats &stats = p.stats();
+      std::cout << "\rSending..." << upload.bytesAcked() << "/" << upload.bytesTotal() << " bytes, "
+		<< nat(stats.baud()) << " baud, " << upload.retransmits() << " resent" << std::flush;
     }
-
-    std::cout << "\rSending..." << sent << "/" << size << " bytes" << std::flush;
   }
   std::cout << std::endl;
 
-  //Send checksum
-  p.write(&checksum, 1);
+  if (upload.failed()) {
+    DEBUG("Error: " << upload.error() << ", " << upload.bytesAcked() << " bytes got through");
+    return 5;
+  }
+  writeCache(port, image);
+
+  const PortStats &stats = p.stats();
+  DEBUG(upload.framesTotal() << " frames in " << (Port::now() - start) / 1000.0 << " s, "
+	<< upload.retransmits() << " resent, " << stats.stalls << " stalls");
 
   DEBUG("Done!");
 
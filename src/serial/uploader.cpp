@@ -0,0 +1,230 @@
+#include "stdafx.h"
+#include "uploader.h"
+
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <cctype>
+
+//Changes closer than this are sent in the same frame, a new frame costs
+//FRAME_OVERHEAD bytes anyway.
+const nat DELTA_GAP = 2 * FRAME_OVERHEAD;
+//Frames in flight must have different sequence numbers, so no frame is
+//sent this far ahead of one that has not been acked yet.
+const nat SEQ_SPAN = 128;
+
+Uploader::Uploader(Port &port, const std::vector<byte> &image, bool sync, bool pack,
+		   const std::vector<byte> *last)
+  : port(port), state(Syncing), sync(sync), next(0), oldest(0), inFlight(0),
+    window(8), maxTries(10), dataTotal(0), acked(0), dataAcked(0), resent(0),
+    frameBytes(0), plainBytes(0) {
+
+  addFrame(buildFrame(FRAME_START, 0, 0, 0, 0), 0);
+
+  if (!last) {
+    addRange(image, 0, image.size(), pack);
+  } else {
+    //Find the ranges that changed
+    nat from = 0;
+    while (from < image.size()) {
+      while (from < image.size() && from < last->size() && image[from] == (*last)[from]) from++;
+      if (from == image.size()) break;
+
+      nat to = from + 1, same = 0;
+      while (to < image.size() && same <= DELTA_GAP) {
+        if (to < last->size() && image[to] == (*last)[to]) {
+          same++;
+        } else {
+          same = 0;
+        }
+        to++;
+      }
+      to -= same;
+      addRange(image, from, to, pack);
+      from = to;
+    }
+  }
+
+  addFrame(buildFrame(FRAME_END, byte(frames.size()), 0, 0, 0), 0);
+  //The start and end frames are the same either way
+  plainBytes += 2 * FRAME_OVERHEAD;
+}
+
+void Uploader::addRange(const std::vector<byte> &image, nat from, nat to, bool pack) {
+  //What the range would take in plain frames, so a delta is compared with
+  //sending the same delta unpacked
+  plainBytes += (to - from) + FRAME_OVERHEAD * ((to - from + FRAME_MAX_DATA - 1) / FRAME_MAX_DATA);
+
+  std::vector<byte> packed;
+  for (nat addr = from; addr < to; ) {
+    nat size = std::min(to - addr, FRAME_MAX_DATA);
+    nat used = pack ? packFrame(&image[addr], to - addr, packed) : 0;
+
+    //Packing only pays off if it covers more than a plain frame would
+    if (used > packed.size() && used > size) {
+      addFrame(buildFrame(FRAME_PACKED, byte(frames.size()), addr, &packed[0], packed.size()), used);
+      addr += used;
+    } else {
+      addFrame(buildFrame(FRAME_DATA, byte(frames.size()), addr, &image[addr], size), size);
+      addr += size;
+    }
+  }
+}
+
+void Uploader::addFrame(const std::vector<byte> &bytes, nat payload) {
+  Frame f = { bytes, payload, false, false, 0, 0 };
+  frames.push_back(f);
+  frameBytes += bytes.size();
+  dataTotal += payload;
+}
+
+bool Uploader::step() {
+  if (state == Done || state == Failed) return false;
+
+  if (state == Syncing) {
+    if (sync && (!port.sendBreak() || !port.write(&SYNC_BYTE, 1))) {
+      fail("Failed to send the sync byte");
+      return false;
+    }
+    state = Sending;
+  }
+
+  readReplies();
+  if (state == Failed) return false;
+
+  if (acked == frames.size()) {
+    state = Done;
+    return false;
+  }
+
+  //Resend what has not been answered in time. Nothing before oldest is
+  //in flight, and at most SEQ_SPAN frames are after it.
+  double now = Port::now();
+  for (nat i = oldest; i < next; i++) {
+    Frame &f = frames[i];
+    if (!f.inFlight || now - f.sentAt < ackTimeout()) continue;
+    if (f.tries >= maxTries) {
+      std::ostringstream oss;
+      oss << "No answer for frame " << i << " after " << f.tries << " tries";
+      fail(oss.str());
+      return false;
+    }
+    resent++;
+    send(i);
+  }
+
+  //Fill the window. The last frame starts the cpu, so everything
+  //before it has to be in place first.
+  while (next < frames.size() && inFlight < window && next - oldest < SEQ_SPAN) {
+    if (next == frames.size() - 1 && acked < next) break;
+    send(next++);
+  }
+
+  if (!port.sendPending()) {
+    fail("Failed to write to the port");
+    return false;
+  }
+  return true;
+}
+
+void Uploader::send(nat id) {
+  Frame &f = frames[id];
+  if (!f.inFlight) inFlight++;
+  f.inFlight = true;
+  f.sentAt = Port::now();
+  f.tries++;
+  if (!port.write(&f.bytes[0], f.bytes.size())) {
+    fail("Failed to write to the port");
+  }
+}
+
+void Uploader::readReplies() {
+  byte buffer[64];
+  nat r;
+  while ((r = port.read(buffer, sizeof(buffer))) > 0) {
+    replies.insert(replies.end(), buffer, buffer + r);
+  }
+
+  nat pos = 0;
+  while (pos + 1 < replies.size()) {
+    byte kind = replies[pos];
+    if (kind != FRAME_ACK && kind != FRAME_NAK) {
+      //Noise, look for the next reply
+      pos++;
+      continue;
+    }
+    reply(kind, replies[pos + 1]);
+    pos += 2;
+  }
+  replies.erase(replies.begin(), replies.begin() + pos);
+}
+
+void Uploader::reply(byte kind, byte seq) {
+  nat id = findInFlight(seq);
+  if (id == frames.size()) return;
+
+  Frame &f = frames[id];
+  if (kind == FRAME_ACK) {
+    f.inFlight = false;
+    f.acked = true;
+    inFlight--;
+    acked++;
+    dataAcked += f.payload;
+    while (oldest < frames.size() && frames[oldest].acked) oldest++;
+  } else {
+    //The FPGA got it garbled, only this one has to be sent again
+    resent++;
+    if (f.tries >= maxTries) {
+      std::ostringstream oss;
+      oss << "Frame " << id << " was garbled " << f.tries << " times";
+      fail(oss.str());
+      return;
+    }
+    send(id);
+  }
+}
+
+nat Uploader::findInFlight(byte seq) const {
+  //Less than SEQ_SPAN frames from oldest on, so seq is unique there
+  for (nat i = oldest; i < next; i++) {
+    if (frames[i].inFlight && byte(i) == seq) return i;
+  }
+  return frames.size();
+}
+
+double Uploader::ackTimeout() const {
+  //Time to send the whole window and get the answers, twice over
+  double bits = double(window) * (FRAME_MAX_DATA + FRAME_OVERHEAD + 2) * 10;
+  return 2 * bits * 1000 / port.getBaud() + 50;
+}
+
+void Uploader::fail(const String &msg) {
+  state = Failed;
+  errorMsg = msg;
+}
+
+String cachePath(const String &port) {
+  const char *dir = getenv("TMPDIR");
+  if (!dir) dir = getenv("TEMP");
+  if (!dir) dir = "/tmp";
+
+  String name = port;
+  for (nat i = 0; i < name.size(); i++) {
+    if (!isalnum(name[i])) name[i] = '_';
+  }
+  return String(dir) + "/gameboy-serial-" + name + ".bin";
+}
+
+bool readCache(const String &port, std::vector<byte> &to) {
+  std::ifstream f(cachePath(port).c_str(), std::ios::binary);
+  if (!f.is_open()) return false;
+  to.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  return true;
+}
+
+void writeCache(const String &port, const std::vector<byte> &image) {
+  std::ofstream f(cachePath(port).c_str(), std::ios::binary);
+  if (!image.empty()) f.write((const char *)&image[0], image.size());
+}
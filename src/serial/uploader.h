@@ -0,0 +1,104 @@
+#pragma once
+
+#include "port.h"
+#include "protocol.h"
+
+#include <vector>
+
+//Uploads an image through a Port with the framed protocol in protocol.h.
+//It never blocks (apart from the break at the start), call step() whenever
+//the port has something to read or every few ms, until it returns false.
+//This way several uploads can run at the same time.
+class Uploader {
+public:
+  //Writes image to the rom, starting at address 0. If sync is false, no
+  //break and sync byte is sent (for Serial built with Auto_Baud = false).
+  //If pack is set, frames are packed whenever that makes them smaller.
+  //If last is given it should be what the rom contains now, then only
+  //the parts of image that differ from it are sent.
+  Uploader(Port &port, const std::vector<byte> &image, bool sync = true, bool pack = true,
+	   const std::vector<byte> *last = 0);
+
+  //Does what can be done right now. Returns false when the upload is done
+  //or has failed.
+  bool step();
+
+  bool failed() const { return state == Failed; }
+  const String &error() const { return errorMsg; }
+
+  //Progress
+  nat framesTotal() const { return frames.size(); }
+  nat framesAcked() const { return acked; }
+  //Bytes of the image that are sent, all of it unless last was given.
+  nat bytesTotal() const { return dataTotal; }
+  nat bytesAcked() const { return dataAcked; }
+  nat retransmits() const { return resent; }
+
+  //Bytes in all frames, and how many the same ranges would have taken
+  //without packing.
+  nat wireBytes() const { return frameBytes; }
+  nat plainWireBytes() const { return plainBytes; }
+
+  //Frames sent before waiting for an answer, at most 128 since the
+  //sequence numbers are 8 bits.
+  void setWindow(nat frames) { window = frames; }
+  //Give up when a frame has been sent this many times.
+  void setMaxTries(nat tries) { maxTries = tries; }
+
+private:
+  enum State { Syncing, Sending, Done, Failed };
+
+  struct Frame {
+    std::vector<byte> bytes;
+    nat payload;
+    bool acked;
+    bool inFlight;
+    double sentAt;
+    nat tries;
+  };
+
+  Port &port;
+  State state;
+  bool sync;
+  String errorMsg;
+
+  std::vector<Frame> frames;
+  //First frame not sent yet.
+  nat next;
+  //First frame not acked yet.
+  nat oldest;
+  nat inFlight;
+  std::vector<byte> replies;
+
+  nat window;
+  nat maxTries;
+  nat dataTotal;
+  nat acked;
+  nat dataAcked;
+  nat resent;
+  nat frameBytes;
+  nat plainBytes;
+
+  void addFrame(const std::vector<byte> &bytes, nat payload);
+  //Adds frames that write image[from, to).
+  void addRange(const std::vector<byte> &image, nat from, nat to, bool pack);
+
+  void send(nat id);
+  void readReplies();
+  void reply(byte kind, byte seq);
+  void fail(const String &msg);
+
+  //How long to wait for an answer, in ms.
+  double ackTimeout() const;
+
+  //The in-flight frame with this sequence number, or frames.size().
+  nat findInFlight(byte seq) const;
+};
+
+//Where we remember what was uploaded to port last time, so the next upload
+//only has to send what changed. It lives in the temp dir, which is cleared
+//on reboot, about when the board is turned off. Anything else that writes
+//the rom of the board has to remove or rewrite it.
+String cachePath(const String &port);
+bool readCache(const String &port, std::vector<byte> &to);
+void writeCache(const String &port, const std::vector<byte> &image);
@@ -21,7 +21,6 @@
 --INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
 --STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
 --OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
 library ieee;
 use ieee.std_logic_1164.all;
 use ieee.std_logic_textio.all;
@@ -30,13 +29,38 @@ use ieee.numeric_std.all;
 library std;
 use std.textio.all;
 
-entity loops_Test is
-end loops_Test;
+-- The testbench of every test suite in tests/, see tester/. The tester
+-- sets the generics with -gName=Value, so one elaborated design serves all
+-- suites, and several tests can run at once with their own files.
+entity Suite_Test is
+  generic (-- The rom and ram from address 0, one binary byte per line
+           Feed_File : string := "tests/sample_test/stimulus/feed.txt";
+           -- The ram from 0xC000 up to Dump_End, one binary byte per line
+           Result_File : string := "tests/sample_test/results/results.txt";
+           -- Bytes sent through the serial port, see rom_test.vhd. Empty
+           -- to not capture anything.
+           Serial_File : string := "";
+           -- How many cycles the cpu runs before the ram is read back
+           Cycles : integer := 600;
+           -- The last address that is read back. Reading takes two cycles
+           -- per byte, so the tester only asks for what it checks.
+           Dump_End : integer := 16#FFFE#;
+           -- See bus_controller.vhd
+           Sim_Memory : boolean := true;
+           -- The opcodes the cpu executes, see cpu.vhd. Empty to not
+           -- write them.
+           Trace_File : string := "";
+           -- How many clocks the cpu ran from reset until it halted, 0 if
+           -- it didn't within Cycles. Empty to not write it.
+           Clocks_File : string := "");
+end Suite_Test;
 
-architecture Behavior of loops_Test is
+architecture Behavior of Suite_Test is
 -- Component Decalaration
-  
+
   component Bus_Controller
+    generic (Rom_Banks : integer;
+             Sim_Memory : boolean);
     port(Clk, Reset : in std_logic;
          Mem_Write : in std_logic_vector(7 downto 0);
          Mem_Read : out std_logic_vector(7 downto 0);
@@ -47,17 +71,25 @@ architecture Behavior of loops_Test is
          Gpu_Addr : out std_logic_vector(15 downto 0);
          Gpu_Write_Enable : out std_logic;
          Rom_Write_Enable : in std_logic;
-         Rom_Addr : in std_logic_vector(15 downto 0);
-         Rom_Write : in std_logic_vector(7 downto 0));
+         Rom_Addr : in std_logic_vector(22 downto 0);
+         Rom_Write : in std_logic_vector(7 downto 0);
+         Timer_Interrupt : out std_logic;
+         Pulse, Latch  : out std_logic;
+         Data : in std_logic;
+         Current_Interrupts : in std_logic_vector(7 downto 0));
   end component;
 
   component Cpu
+    generic (Trace_File : string);
     port(Clk, Reset : in std_logic;
          Mem_Write_External : out std_logic_vector(7 downto 0);
          Mem_Read : in std_logic_vector(7 downto 0);
          Mem_Addr_External : out std_logic_vector(15 downto 0);
          Mem_Write_Enable_External : out std_logic;
-         Interrupt_Requests : in std_logic_vector(7 downto 0));
+         Interrupt_Requests : in std_logic_vector(7 downto 0);
+         Current_Interrupts : out std_logic_vector(7 downto 0);
+         Stall : in std_logic;
+         Is_Halted : out std_logic);
   end component;
   
   signal Clk, Reset, Bus_Reset : std_logic;
@@ -66,24 +98,35 @@ architecture Behavior of loops_Test is
   signal Mem_Addr, Cpu_Mem_Addr : std_logic_vector(15 downto 0) := X"0000";
   signal Mem_Write_Enable, Cpu_Mem_Write_Enable : std_logic := '0';
   signal Rom_Write_Enable : std_logic := '0';
-  signal Rom_Addr : std_logic_vector(15 downto 0);
+  signal Rom_Addr : std_logic_vector(22 downto 0);
   signal Rom_Write : std_logic_vector(7 downto 0);
   
   signal Cpu_Allowed : std_logic;
+  -- Keeps the cpu from starting new instructions while the bus is ours,
+  -- it would only execute what the dump reads
+  signal Cpu_Stall : std_logic;
+  signal Cpu_Halted : std_logic;
   signal Internal_Mem_Addr : std_logic_vector(15 downto 0);
   signal Internal_Mem_Write : std_logic_vector(7 downto 0);
   signal Internal_Mem_Write_Enable : std_logic := '0';
   
   --Dummy signals, these arent used
   signal Gpu_Write : std_logic_vector(7 downto 0);
-  signal Gpu_Read : std_logic_vector(7 downto 0);
+  signal Gpu_Read : std_logic_vector(7 downto 0) := X"00";
   signal Gpu_Addr : std_logic_vector(15 downto 0);
   signal Gpu_Write_Enable : std_logic;
-  signal Interrupt_Requests : std_logic_vector(7 downto 0);
+  signal Pulse, Latch : std_logic;
+  signal Interrupt_Requests : std_logic_vector(7 downto 0) := X"00";
+  signal Current_Interrupts : std_logic_vector(7 downto 0);
+
+  type Char_File is file of character;
+
+  -- Stops the clock, and with it the simulation, when the ram is dumped
+  signal Sim_Done : std_logic := '0';
   
 begin
 -- compnent instantiation
-  Bus_Ports : Bus_Controller port map(
+  Bus_Ports : Bus_Controller generic map (Rom_Banks => 2, Sim_Memory => Sim_Memory) port map(
     Clk => Clk,
     Reset => Bus_Reset,
     Mem_Write => Mem_Write,
@@ -91,32 +134,69 @@ begin
     Mem_Addr => Mem_Addr,
     Mem_Write_Enable => Mem_Write_Enable,
     Gpu_Write => Gpu_Write,
-    Gpu_Write_Enable => Gpu_Write_Enable,
-    Gpu_Addr => Gpu_Addr,
     Gpu_Read => Gpu_Read,
+    Gpu_Addr => Gpu_Addr,
+    Gpu_Write_Enable => Gpu_Write_Enable,
     Rom_Write_Enable => Rom_Write_Enable,
     Rom_Addr => Rom_Addr,
-    Rom_Write => Rom_Write);
+    Rom_Write => Rom_Write,
+    Timer_Interrupt => Interrupt_Requests(2),
+    Pulse => Pulse,
+    Latch => Latch,
+    Data => '1',
+    Current_Interrupts => Current_Interrupts);
 
-  Cpu_Ports : Cpu port map(
+  Cpu_Ports : Cpu generic map (Trace_File => Trace_File) port map(
     Clk => Clk,
     Reset => Reset,
     Mem_Write_External => Cpu_Mem_Write,
-    --Mem_Write => Mem_Write,
     Mem_Read => Mem_Read,
     Mem_Addr_External => Cpu_Mem_Addr,
     Mem_Write_Enable_External => Cpu_Mem_Write_Enable,
-    Interrupt_Requests => Interrupt_Requests);
-    --Mem_Write_Enable => Mem_Write_Enable);
+    Interrupt_Requests => Interrupt_Requests,
+    Current_Interrupts => Current_Interrupts,
+    Stall => Cpu_Stall,
+    Is_Halted => Cpu_Halted);
+  Cpu_Stall <= not Cpu_Allowed;
   
   Clk_Gen : process
   begin
-    while (true) loop
+    while Sim_Done = '0' loop
       Clk <= '0';
       wait for 5 ns;
       Clk <= '1';
       wait for 5 ns;
     end loop;
+    wait;
+  end process;
+
+  -- Writes every byte the cpu sends through the serial port. The file is
+  -- opened and closed for each byte so that it can be read while the
+  -- simulation is still running.
+  Serial_Capture : process (Clk)
+    variable Cleared : boolean := false;
+    variable Status : file_open_status;
+    variable Serial_Data : std_logic_vector(7 downto 0) := X"00";
+    file Serial_Out : Char_File;
+  begin
+    if rising_edge(Clk) and Serial_File /= "" then
+      if not Cleared then
+        file_open(Status, Serial_Out, Serial_File, write_mode);
+        assert Status = open_ok report "Couldn't open " & Serial_File severity failure;
+        file_close(Serial_Out);
+        Cleared := true;
+      end if;
+
+      if Reset = '0' and Cpu_Allowed = '1' and Mem_Write_Enable = '1' then
+        if Mem_Addr = X"FF01" then
+          Serial_Data := Mem_Write;
+        elsif Mem_Addr = X"FF02" and Mem_Write = X"81" then
+          file_open(Status, Serial_Out, Serial_File, append_mode);
+          write(Serial_Out, character'val(to_integer(unsigned(Serial_Data))));
+          file_close(Serial_Out);
+        end if;
+      end if;
+    end if;
   end process;
   
   Mem_Addr <= Cpu_Mem_Addr when Cpu_Allowed = '1' else
@@ -133,19 +213,17 @@ begin
     variable In_Line, Out_Line : line;
     variable Curr_Addr : std_logic_vector(15 downto 0) := X"0000";
     variable Data_Byte : std_logic_vector(7 downto 0);
-    file In_File : text open read_mode is "tests/loops_test/stimulus/feed.txt";
-    file Out_File : text open write_mode is "tests/loops_test/results/results.txt";
+    variable Halt_Clocks : natural := 0;
+    file In_File : text open read_mode is Feed_File;
+    file Clocks_Out : text;
+    file Out_File : text open write_mode is Result_File;
   begin
     Cpu_Allowed <= '1';
   --writes one byte at a time to the memory
     
     Reset <= '1';
-    --Bus_Reset <= '1';
     wait for 50 ns;
     
-    --Bus_Reset <= '0';
-    --wait until rising_edge(Clk);
-    
     wait until rising_edge(Clk);  
     
     Cpu_Allowed <= '0';
@@ -158,7 +236,7 @@ begin
 
       if Curr_Addr < X"8000" then
         Rom_Write <= std_logic_vector(Data_Byte(7 downto 0));
-        Rom_Addr <= Curr_Addr;
+        Rom_Addr <= "0000000" & Curr_Addr;
         Curr_Addr := std_logic_vector(unsigned(Curr_Addr) + 1);
         Rom_Write_Enable <= '1';
       else
@@ -179,30 +257,36 @@ begin
     Cpu_Allowed <= '1';
     wait until rising_edge(Clk);
     
-    for I in 1 to 1200 loop
+    -- The cpu got its first clock without reset on the edge above. If it
+    -- shows Is_Halted on the I:th edge below, it halted within I clocks.
+    for I in 1 to Cycles loop
       wait until rising_edge(Clk);
+      if Halt_Clocks = 0 and Cpu_Halted = '1' then
+        Halt_Clocks := I;
+      end if;
     end loop; 
+
+    if Clocks_File /= "" then
+      file_open(Clocks_Out, Clocks_File, write_mode);
+      write(Out_Line, Halt_Clocks);
+      writeline(Clocks_Out, Out_Line);
+      file_close(Clocks_Out);
+    end if;
     
     Cpu_Allowed <= '0';
     wait until rising_edge(Clk);
     
-    Curr_Addr := X"C000";
-    loop
-      exit when Curr_Addr = X"FFFF";
-      
-      Internal_Mem_Addr <= std_logic_vector(Curr_Addr);
+    for Addr in 16#C000# to Dump_End loop
+      Internal_Mem_Addr <= std_logic_vector(to_unsigned(Addr, 16));
       
       wait until rising_edge(Clk);
       wait until rising_edge(Clk);
       
       Data_Byte(7 downto 0) := Mem_Read(7 downto 0);
-      Curr_Addr := std_logic_vector(unsigned(Curr_Addr) + 1);
-
-      --wait until rising_edge(Clk);
-      
       write(Out_Line, Data_Byte);
       writeline(Out_File, Out_Line);
-    end  loop;        
+    end loop;
+    Sim_Done <= '1';
     wait;      
   end process;
   
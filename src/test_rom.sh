@@ -5,6 +5,7 @@ then
     echo "Specify the rom file to be tested (no extension)."
     echo "Usage: [rom file] [r]"
     echo "R is optional and starts gtkwave."
+    echo "To run all roms in roms/manifest.txt and check their results, use tester/romrunner."
     exit 0
 fi
 
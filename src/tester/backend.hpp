@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "typedefs.hpp"
+
+class Timing;
+class Coverage;
+
+//Settings shared by all tests in one run, filled in by main
+struct RunOptions
+{
+  RunOptions() : simulation_time(1600), cycles(600), full_vcd(false), wave_window(0), wave_from(-1),
+		 rerun_failed(true), timing(0), coverage(0) {};
+  
+  //Simulate each test for at most this many microseconds
+  int simulation_time;
+  //How many cycles the cpu runs before the ram is read back, from the
+  //suite.txt of the suite
+  int cycles;
+  //Dump a full vcd for every test, not only the failing ones
+  bool full_vcd;
+  //How many microseconds of waveform to capture when a failed
+  //test is re-run, up to where it failed (the cpu halted or ran out
+  //of cycles). 0 means everything up to there.
+  int wave_window;
+  //Capture wave_window microseconds from here instead, -1 to capture
+  //up to where the test failed
+  int wave_from;
+  //Re-run failed tests to capture a waveform
+  bool rerun_failed;
+  //Where the phases of each test are timed, null to not time them
+  Timing* timing;
+  //Where the opcodes each test executed are added, null to not trace
+  //them. Only the sim backend can.
+  Coverage* coverage;
+};
+
+//How often one opcode was executed in a test, and how many clocks it
+//took from its fetch to the fetch of the next instruction
+struct OpcodeCount
+{
+  OpcodeCount() : hits(0), min_clocks(0), max_clocks(0) {};
+
+  //One execution that took clocks
+  void add_clocks(int clocks)
+  {
+    if (min_clocks == 0 || clocks < min_clocks)
+      min_clocks = clocks;
+    if (clocks > max_clocks)
+      max_clocks = clocks;
+  };
+  //Adds the executions of other
+  void merge(const OpcodeCount& other)
+  {
+    hits += other.hits;
+    if (other.max_clocks > 0)
+      {
+	add_clocks(other.min_clocks);
+	add_clocks(other.max_clocks);
+      }
+  };
+
+  int hits;
+  //0 if it was never timed, like HALT that waits for an interrupt
+  int min_clocks, max_clocks;
+};
+
+//What came out of running one test
+struct RunResult
+{
+  RunResult() : halt_clocks(CLOCKS_UNCOUNTED) {};
+
+  //The ram from 0xC000 and up, one binary string per byte like
+  //results.txt. Bytes that weren't read back are empty.
+  std::vector<std::string> ram;
+  //What the test wrote to the serial port, if the backend knows
+  std::string serial;
+  //Where the waveform of the run ended up, empty if none
+  std::string wave_path;
+  //Each opcode that was executed, if options.coverage is set. The two
+  //byte ones are 0xCBxx and 0x10xx.
+  std::map<int, OpcodeCount> opcodes;
+  //How many clocks the cpu ran from reset until it halted, 0 if it
+  //didn't within options.cycles, CLOCKS_UNCOUNTED if the backend can't
+  //tell
+  int halt_clocks;
+
+  const static int CLOCKS_UNCOUNTED = -1;
+};
+
+//Something that can run the image of a test, the simulator or the FPGA
+class Backend
+{
+public:
+  virtual ~Backend() {};
+
+  //How many tests can run at the same time, run is called from that
+  //many threads with worker 0 up to workers() - 1
+  virtual int workers() const { return 1;};
+
+  //Called once before the tests of entity run, to build what they
+  //need. Returns false if they can't be run.
+  virtual bool prepare(const std::string& entity) { return true;};
+
+  //Runs image (the rom and ram from address 0, see TestFile) for
+  //options.simulation_time and reads back at least the checks.
+  //Returns false if the backend itself failed.
+  virtual bool run(int worker, const std::string& entity, int test_num,
+		   const std::vector<byte>& image, const AddrDatas& checks,
+		   const RunOptions& options, RunResult& result) = 0;
+
+  //Called when a test has failed, to leave something to debug it with
+  virtual void failed(int worker, const std::string& entity, int test_num,
+		      const RunOptions& options, RunResult& result) {};
+};
@@ -0,0 +1,317 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+#include "parser.hpp"
+#include "tokenizer.hpp"
+#include "testfile.hpp"
+#include "simbackend.hpp"
+#include "timing.hpp"
+#include "util.hpp"
+
+//Every allocation in the program goes through here, so that we can tell
+//how many each phase makes
+static std::atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+  ++allocations;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+//One line of the output
+struct BenchResult
+{
+  std::string name;
+  long tests;
+  double bytes;
+  double seconds;
+  unsigned long allocs;
+};
+
+//Times the scope it lives in into a BenchResult
+class Measure
+{
+public:
+  Measure(BenchResult& r) : m_r(r), m_start(Timing::now()), m_allocs(allocations) {};
+  ~Measure()
+  {
+    m_r.seconds = (Timing::now() - m_start) / 1000000.0;
+    m_r.allocs = allocations - m_allocs;
+  }
+private:
+  BenchResult& m_r;
+  double m_start;
+  unsigned long m_allocs;
+};
+
+void print_usage(const char* name)
+{
+  using std::cout;
+  using std::endl;
+
+  cout << "Usage: " << name << " options" << endl;
+  cout << "Times the tester front end on generated tests: tokenizing and parsing" << endl;
+  cout << "the .stim file, generating the feed, reading results and checking." << endl;
+  cout << "-n N,N,... How many tests to tokenize and parse, default 1000,10000,100000." << endl;
+  cout << "           10M tests take a few GB of memory." << endl;
+  cout << "-s NUMBER  Tests to generate, feed and check, default 100. These do" << endl;
+  cout << "           not depend on the size of the file." << endl;
+  cout << "-d DIR     Where the generated files go, default /tmp/tester_bench" << endl;
+  cout << "-o FILE    Also write the results as CSV, to compare between commits" << endl;
+  cout << "-r NUMBER  Seed for the generated tests" << endl;
+}
+
+//What the generated checks expect at addr, the generated results.txt
+//has exactly this
+byte expected(int addr)
+{
+  return byte(addr * 7 + 3);
+}
+
+//A .stim file like the ones in tests/: a prepare block and then tests
+//with a few bytes of code and a few checks each
+bool generate_stim(const std::string& path, long tests)
+{
+  std::ofstream file(path.c_str());
+  if (!file.is_open())
+    return false;
+
+  file << std::hex << std::setfill('0') << std::uppercase;
+  file << "#Generated by benchfront" << std::endl
+       << "@prepare {" << std::endl
+       << "# LD HL, C000" << std::endl
+       << "3E C0 67 3E 00 6F" << std::endl
+       << "[C200] 3E 20 77 76 # Jumps end up here" << std::endl
+       << "}" << std::endl << std::endl;
+  for (long t = 0; t < tests; ++t)
+    {
+      file << "#Test " << std::dec << t << std::hex << std::endl
+	   << "@test {" << std::endl << " ";
+      int code = 1 + rand() % 12;
+      for (int i = 0; i < code; ++i)
+	file << " " << std::setw(2) << (rand() & 0xFF);
+      file << " 76" << std::endl
+	   << "  @check {" << std::endl;
+      int checks = 1 + rand() % 3;
+      for (int c = 0; c < checks; ++c)
+	{
+	  int addr = 0xC000 + rand() % 0x1000;
+	  file << "    [" << std::setw(4) << addr << "]";
+	  int bytes = 1 + rand() % 4;
+	  for (int b = 0; b < bytes; ++b)
+	    file << " " << std::setw(2) << int(expected(addr + b));
+	  file << std::endl;
+	}
+      file << "  }" << std::endl
+	   << "}" << std::endl;
+    }
+  return file.good();
+}
+
+bool generate_results(const std::string& path)
+{
+  std::ofstream file(path.c_str());
+  for (int i = 0; i < 0x4000; ++i)
+    file << Util::to_bin(expected(Test::BASE_CHECK_OFFSET + i)) << std::endl;
+  return file.good();
+}
+
+long file_size(const std::string& path)
+{
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  return file.is_open() ? long(file.tellg()) : 0;
+}
+
+void print_result(const BenchResult& r)
+{
+  std::cout << std::left << std::setw(20) << r.name << std::right
+	    << std::setw(10) << r.tests
+	    << std::fixed << std::setprecision(3)
+	    << std::setw(10) << r.seconds
+	    << std::setw(10) << (r.seconds > 0 ? r.bytes / 1000000.0 / r.seconds : 0)
+	    << std::setprecision(0)
+	    << std::setw(12) << (r.seconds > 0 ? r.tests / r.seconds : 0)
+	    << std::setprecision(1)
+	    << std::setw(12) << (r.tests > 0 ? double(r.allocs) / r.tests : 0)
+	    << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<long> sizes;
+  long sample = 100;
+  std::string dir = "/tmp/tester_bench", csv_path;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+	{
+	  std::stringstream ss(argv[++i]);
+	  std::string n;
+	  while (std::getline(ss, n, ','))
+	    sizes.push_back(atol(n.c_str()));
+	}
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+	sample = atol(argv[++i]);
+      else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+	dir = argv[++i];
+      else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+	csv_path = argv[++i];
+      else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+	seed = atoi(argv[++i]);
+      else
+	{
+	  print_usage(argv[0]);
+	  return 2;
+	}
+    }
+  if (sizes.empty())
+    {
+      sizes.push_back(1000);
+      sizes.push_back(10000);
+      sizes.push_back(100000);
+    }
+  std::system(("mkdir -p " + dir).c_str());
+
+  std::vector<BenchResult> results;
+  std::cout << std::left << std::setw(20) << "Benchmark" << std::right
+	    << std::setw(10) << "Tests" << std::setw(10) << "Seconds" << std::setw(10) << "MB/s"
+	    << std::setw(12) << "Tests/s" << std::setw(12) << "Allocs/test" << std::endl;
+
+  Tests sampled;
+  for (size_t s = 0; s < sizes.size(); ++s)
+    {
+      srand(seed);
+      std::stringstream name;
+      name << dir << "/bench_" << sizes[s] << ".stim";
+      if (!generate_stim(name.str(), sizes[s]))
+	{
+	  std::cout << "Error: Couldn't write " << name.str() << std::endl;
+	  return 2;
+	}
+      long bytes = file_size(name.str());
+
+      BenchResult tok = { "tokenize", sizes[s], double(bytes), 0, 0 };
+      {
+	Measure m(tok);
+	Tokenizer t(name.str());
+	while (t.has_token())
+	  t.next();
+      }
+      results.push_back(tok);
+      print_result(tok);
+
+      BenchResult parse = { "parse", sizes[s], double(bytes), 0, 0 };
+      Tests tests;
+      {
+	Measure m(parse);
+	Tokenizer t(name.str());
+	Parser p(t, dir + "/");
+	tests = p.parse();
+      }
+      results.push_back(parse);
+      print_result(parse);
+      if (long(tests.size()) != sizes[s])
+	std::cout << "DEBUG: Parsed " << tests.size() << " tests, expected " << sizes[s] << std::endl;
+
+      if (sampled.empty())
+	{
+	  Tests::iterator end = tests.begin();
+	  std::advance(end, std::min(sample, long(tests.size())));
+	  sampled.splice(sampled.begin(), tests, tests.begin(), end);
+	}
+    }
+
+  //The per test phases, on the sample
+  std::vector<std::vector<byte> > images;
+  BenchResult generate = { "generate", long(sampled.size()), 0, 0, 0 };
+  {
+    Measure m(generate);
+    for (Tests::iterator it = sampled.begin(); it != sampled.end(); ++it)
+      {
+	TestFile tf(&*it);
+	tf.generate_input();
+	images.push_back(tf.image());
+      }
+  }
+  for (size_t i = 0; i < images.size(); ++i)
+    generate.bytes += images[i].size();
+  results.push_back(generate);
+  print_result(generate);
+
+  std::string feed_path = dir + "/feed.txt";
+  BenchResult feed = { "feed", long(sampled.size()), 0, 0, 0 };
+  {
+    Measure m(feed);
+    for (size_t i = 0; i < images.size(); ++i)
+      SimBackend::write_feed(feed_path, images[i]);
+  }
+  feed.bytes = double(file_size(feed_path)) * images.size();
+  results.push_back(feed);
+  print_result(feed);
+
+  std::string results_path = dir + "/results.txt";
+  generate_results(results_path);
+  std::vector<std::string> ram;
+  BenchResult read = { "results", long(sampled.size()), double(file_size(results_path)) * sampled.size(), 0, 0 };
+  {
+    Measure m(read);
+    for (size_t i = 0; i < sampled.size(); ++i)
+      SimBackend::read_results(results_path, ram);
+  }
+  results.push_back(read);
+  print_result(read);
+
+  BenchResult check = { "check", long(sampled.size()), 0, 0, 0 };
+  long failed = 0;
+  {
+    Measure m(check);
+    for (Tests::iterator it = sampled.begin(); it != sampled.end(); ++it)
+      if (!it->check(ram))
+	++failed;
+  }
+  results.push_back(check);
+  print_result(check);
+  if (failed)
+    std::cout << "DEBUG: " << failed << " of the generated tests failed their checks" << std::endl;
+
+  if (!csv_path.empty())
+    {
+      std::ofstream csv(csv_path.c_str());
+      csv << "benchmark,tests,bytes,seconds,mb_per_s,tests_per_s,allocs_per_test" << std::endl;
+      for (size_t i = 0; i < results.size(); ++i)
+	{
+	  const BenchResult& r = results[i];
+	  csv << r.name << "," << r.tests << "," << std::fixed << std::setprecision(0) << r.bytes << ","
+	      << std::setprecision(6) << r.seconds << ","
+	      << (r.seconds > 0 ? r.bytes / 1000000.0 / r.seconds : 0) << ","
+	      << (r.seconds > 0 ? r.tests / r.seconds : 0) << ","
+	      << (r.tests > 0 ? double(r.allocs) / r.tests : 0) << std::endl;
+	}
+      std::cout << "Results in: " << csv_path << std::endl;
+    }
+  return 0;
+}
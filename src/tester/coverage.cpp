@@ -0,0 +1,209 @@
+#include "coverage.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+Coverage::Coverage()
+{}
+
+Coverage::~Coverage()
+{}
+
+bool Coverage::load(const std::string& path)
+{
+  std::ifstream file(path.c_str());
+  if (!file.is_open())
+    return true;
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::string line;
+  int line_num = 0;
+  while (std::getline(file, line))
+    {
+      ++line_num;
+      std::stringstream ss(line.substr(0, line.find('#')));
+      Entry e;
+      if (!(ss >> e.suite))
+	continue;
+      if (!(ss >> e.test_num >> std::hex >> e.opcode >> std::dec >> e.count.hits))
+	{
+	  std::cout << "DEBUG: " << path << ":" << line_num
+		    << ": expected SUITE TEST OPCODE HITS MIN MAX" << std::endl;
+	  return false;
+	}
+      //Files from before the clocks were there
+      ss >> e.count.min_clocks >> e.count.max_clocks;
+      m_entries.push_back(e);
+    }
+  return true;
+}
+
+bool Coverage::save(const std::string& path) const
+{
+  std::ofstream file(path.c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path << " for the coverage" << std::endl;
+      return false;
+    }
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  file << "# Written by tester --coverage, SUITE TEST OPCODE HITS MIN MAX" << std::endl;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    file << it->suite << " " << it->test_num << " " << std::hex << std::uppercase
+	 << it->opcode << std::dec << std::nouppercase << " " << it->count.hits
+	 << " " << it->count.min_clocks << " " << it->count.max_clocks << std::endl;
+  return file.good();
+}
+
+void Coverage::clear_suite(const std::string& suite)
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::vector<Entry> kept;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    if (it->suite != suite)
+      kept.push_back(*it);
+  m_entries.swap(kept);
+}
+
+void Coverage::add(const std::string& suite, int test_num, const std::map<int, OpcodeCount>& opcodes)
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::vector<Entry> kept;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    if (it->suite != suite || it->test_num != test_num)
+      kept.push_back(*it);
+  m_entries.swap(kept);
+  for (std::map<int, OpcodeCount>::const_iterator it = opcodes.begin(); it != opcodes.end(); ++it)
+    {
+      Entry e = { suite, test_num, it->first, it->second };
+      m_entries.push_back(e);
+    }
+}
+
+bool Coverage::test_opcodes(const std::string& suite, int test_num, std::set<int>& opcodes) const
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  bool found = false;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    if (it->suite == suite && it->test_num == test_num)
+      {
+	opcodes.insert(it->opcode);
+	found = true;
+      }
+  return found;
+}
+
+std::map<int, OpcodeCount> Coverage::totals() const
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::map<int, OpcodeCount> total;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    total[it->opcode].merge(it->count);
+  return total;
+}
+
+std::string Coverage::opcode_name(int opcode)
+{
+  std::stringstream ss;
+  ss << std::hex << std::uppercase << std::setfill('0');
+  if (opcode > 0xFF)
+    ss << std::setw(2) << (opcode >> 8) << " ";
+  ss << std::setw(2) << (opcode & 0xFF);
+  return ss.str();
+}
+
+bool Coverage::read_trace(const std::string& path, std::map<int, OpcodeCount>& opcodes)
+{
+  std::ifstream file(path.c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path << std::endl;
+      return false;
+    }
+
+  //Lines are "OPCODE START" or "OPCODE START irq", see cpu.vhd
+  int last_opcode = -1, last_start = 0;
+  bool last_irq = false;
+  std::string line;
+  while (std::getline(file, line))
+    {
+      std::stringstream ss(line);
+      int opcode, start;
+      std::string irq;
+      if (!(ss >> std::hex >> opcode >> std::dec >> start))
+	continue;
+      bool is_irq = (ss >> irq) && irq == "irq";
+
+      ++opcodes[opcode].hits;
+      if (last_opcode != -1 && !last_irq && !is_irq
+	  && last_opcode != HALT && last_opcode != STOP)
+	opcodes[last_opcode].add_clocks(start - last_start);
+      last_opcode = opcode;
+      last_start = start;
+      last_irq = is_irq;
+    }
+  return true;
+}
+
+void Coverage::report_opcodes(std::ostream& os, bool two_byte) const
+{
+  //The tests of each opcode, in the order they were run
+  std::map<int, std::vector<const Entry*> > by_opcode;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    if ((it->opcode > 0xFF) == two_byte)
+      by_opcode[it->opcode].push_back(&*it);
+
+  for (std::map<int, std::vector<const Entry*> >::const_iterator it = by_opcode.begin();
+       it != by_opcode.end();
+       ++it)
+    {
+      const std::vector<const Entry*>& entries = it->second;
+      OpcodeCount total;
+      for (size_t i = 0; i < entries.size(); ++i)
+	total.merge(entries[i]->count);
+      std::stringstream clocks;
+      if (total.max_clocks == 0)
+	clocks << "-";
+      else if (total.min_clocks == total.max_clocks)
+	clocks << total.min_clocks;
+      else
+	clocks << total.min_clocks << "-" << total.max_clocks;
+      os << std::left << std::setw(8) << opcode_name(it->first) << std::right
+	 << std::setw(10) << total.hits << std::setw(9) << clocks.str()
+	 << std::setw(7) << entries.size() << "  ";
+      for (size_t i = 0; i < entries.size() && i < MAX_LISTED_TESTS; ++i)
+	os << (i ? ", " : "") << entries[i]->suite << " " << entries[i]->test_num;
+      if (entries.size() > MAX_LISTED_TESTS)
+	os << " and " << entries.size() - MAX_LISTED_TESTS << " more";
+      os << std::endl;
+    }
+}
+
+void Coverage::report(std::ostream& os) const
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  os << std::left << std::setw(8) << "Opcode" << std::right
+     << std::setw(10) << "Hits" << std::setw(9) << "Clocks" << std::setw(7) << "Tests"
+     << "  Reached by" << std::endl;
+  report_opcodes(os, false);
+  report_opcodes(os, true);
+
+  std::set<int> opcodes;
+  std::set<std::string> suites;
+  std::set<std::pair<std::string, int> > tests;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+      opcodes.insert(it->opcode);
+      suites.insert(it->suite);
+      tests.insert(std::make_pair(it->suite, it->test_num));
+    }
+  int two_byte = 0;
+  for (std::set<int>::const_iterator it = opcodes.begin(); it != opcodes.end(); ++it)
+    if (*it > 0xFF)
+      ++two_byte;
+  os << opcodes.size() - two_byte << " opcodes and " << two_byte << " two byte opcodes executed by "
+     << tests.size() << " tests in " << suites.size() << " suites" << std::endl;
+  os.unsetf(std::ios::adjustfield);
+}
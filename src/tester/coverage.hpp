@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iostream>
+#include <mutex>
+
+#include "backend.hpp"
+
+//Which opcodes the tests of all suites have executed, from the opcode
+//trace of the testbench (Trace_File in cpu.vhd). It is kept in a file,
+//one line "SUITE TEST OPCODE HITS MIN MAX" per opcode a test executed,
+//MIN and MAX being the clocks it took, so that the suites can be run one
+//by one and still add up. Opcodes are like in RunResult::opcodes. Safe
+//to use from the workers of a backend.
+class Coverage
+{
+public:
+  Coverage();
+  virtual ~Coverage();
+
+  //A file that isn't there yet is empty
+  bool load(const std::string& path);
+  bool save(const std::string& path) const;
+
+  //Forgets what the tests of suite executed, before all of it is run
+  //again and tests may have gone
+  void clear_suite(const std::string& suite);
+  //Replaces what test_num of suite executed before, with no opcodes
+  //the test has no record any more
+  void add(const std::string& suite, int test_num, const std::map<int, OpcodeCount>& opcodes);
+
+  //Adds the opcodes test_num of suite executed to opcodes, false if it
+  //hasn't been recorded
+  bool test_opcodes(const std::string& suite, int test_num, std::set<int>& opcodes) const;
+
+  //Each opcode as executed by all suites
+  std::map<int, OpcodeCount> totals() const;
+  //Every opcode with how often, in how many clocks and by which tests
+  //it was executed, CB xx on their own after the others
+  void report(std::ostream& os) const;
+
+  //Like "3E", or "CB 37" for the two byte ones
+  static std::string opcode_name(int opcode);
+  //Reads a trace of the testbench into opcodes, adding to what is there.
+  //An instruction takes the clocks until the next one is fetched, HALT
+  //and STOP (which wait) and those cut short by an interrupt aren't
+  //timed.
+  static bool read_trace(const std::string& path, std::map<int, OpcodeCount>& opcodes);
+
+  //How many tests report lists for each opcode
+  const static size_t MAX_LISTED_TESTS = 6;
+  //The opcodes that wait instead of taking a time of their own
+  const static int HALT = 0x76;
+  const static int STOP = 0x1000;
+
+private:
+  struct Entry
+  {
+    std::string suite;
+    int test_num;
+    int opcode;
+    OpcodeCount count;
+  };
+
+  void report_opcodes(std::ostream& os, bool two_byte) const;
+
+  mutable std::mutex m_lock;
+  std::vector<Entry> m_entries;
+};
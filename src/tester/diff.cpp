@@ -9,6 +9,16 @@ std::ostream& operator<<(std::ostream& os, const Diff& d)
       os << "At addr: " << std::setw(10) << std::hex << it->addr << std::dec 
 	 << " expected: " << it->expected << " got: " << it->found << std::endl;
     }
+  if (d.m_clocks_max > 0)
+    {
+      os << "Clocks to HALT expected: " << d.m_clocks_min;
+      if (d.m_clocks_max != d.m_clocks_min)
+	os << " to " << d.m_clocks_max;
+      if (d.m_clocks_found > 0)
+	os << " got: " << d.m_clocks_found << std::endl;
+      else
+	os << " but it didn't halt" << std::endl;
+    }
   return os;
 }
 
@@ -17,7 +27,15 @@ void Diff::add_diff(DiffInfo diff)
   m_diffs.push_back(diff);
 }
 
+void Diff::add_clocks_diff(int found, int min, int max)
+{
+  m_clocks_found = found;
+  m_clocks_min = min;
+  m_clocks_max = max;
+}
+
 Diff::Diff()
+  : m_clocks_found(0), m_clocks_min(0), m_clocks_max(0)
 {}
 
 Diff::~Diff()
@@ -19,7 +19,12 @@ public:
   virtual ~Diff();
   
   void add_diff(DiffInfo diff);
+  //The cpu took found clocks to HALT instead of min to max, found is 0
+  //if it didn't halt at all
+  void add_clocks_diff(int found, int min, int max);
 private:
   friend std::ostream& operator<<(std::ostream &os, const Diff& d);
   DiffList m_diffs;
+  //0 if the clocks were right
+  int m_clocks_found, m_clocks_min, m_clocks_max;
 };
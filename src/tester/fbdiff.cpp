@@ -0,0 +1,109 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+
+#include "framebuffer.hpp"
+
+void print_usage(const char* name)
+{
+  using std::cout;
+  using std::endl;
+
+  cout << "Usage: " << name << " options FRAMES [GOLDEN]" << endl;
+  cout << "FRAMES is a framebuffer stream from rom_test.vhd (-gFramebuffer_File)." << endl;
+  cout << "Without GOLDEN the hash of every frame is printed. With GOLDEN every" << endl;
+  cout << "frame is compared with the same frame in GOLDEN, or with its only frame" << endl;
+  cout << "if it has just one, and a diff is written for the frames that differ." << endl;
+  cout << "-o DIR     Where to write the ppm images, default is ." << endl;
+  cout << "-p         Write every frame as a ppm image as well" << endl;
+}
+
+std::string image_name(const std::string& dir, const std::string& what, int frame)
+{
+  std::stringstream ss;
+  ss << dir << "/" << what << "_" << frame << ".ppm";
+  return ss.str();
+}
+
+int main(int argc, char** argv)
+{
+  std::string out_dir = ".", frames_file, golden_file;
+  bool write_all = false;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+	out_dir = argv[++i];
+      else if (strcmp(argv[i], "-p") == 0)
+	write_all = true;
+      else if (strcmp(argv[i], "-h") == 0)
+	{
+	  print_usage(argv[0]);
+	  return 0;
+	}
+      else if (frames_file.empty())
+	frames_file = argv[i];
+      else
+	golden_file = argv[i];
+    }
+
+  if (frames_file.empty())
+    {
+      print_usage(argv[0]);
+      return 2;
+    }
+
+  std::vector<Framebuffer> frames, golden;
+  if (!Framebuffer::read_stream(frames_file, frames))
+    {
+      std::cout << "Error: Couldn't read " << frames_file << std::endl;
+      return 2;
+    }
+  if (!golden_file.empty() && !Framebuffer::read_stream(golden_file, golden))
+    {
+      std::cout << "Error: Couldn't read " << golden_file << std::endl;
+      return 2;
+    }
+  if (!golden_file.empty() && golden.empty())
+    {
+      std::cout << "Error: " << golden_file << " has no frames" << std::endl;
+      return 2;
+    }
+
+  int differing = 0;
+  for (unsigned int i = 0; i < frames.size(); ++i)
+    {
+      std::cout << "Frame " << i << ": " << frames[i].hash();
+      if (write_all)
+	frames[i].write_ppm(image_name(out_dir, "frame", i));
+
+      if (!golden.empty())
+	{
+	  if (i >= golden.size() && golden.size() != 1)
+	    {
+	      std::cout << " (no golden frame)" << std::endl;
+	      continue;
+	    }
+	  const Framebuffer& against = golden.size() == 1 ? golden[0] : golden[i];
+	  int diff = Framebuffer::diff_pixels(frames[i], against);
+	  if (diff == 0)
+	    {
+	      std::cout << " OK";
+	    }
+	  else
+	    {
+	      ++differing;
+	      std::string name = image_name(out_dir, "diff", i);
+	      frames[i].write_ppm(name, &against);
+	      std::cout << " " << diff << " pixels differ, see " << name;
+	    }
+	}
+      std::cout << std::endl;
+    }
+
+  if (!golden.empty())
+    std::cout << differing << " of " << frames.size() << " frames differ" << std::endl;
+  return differing == 0 ? 0 : 1;
+}
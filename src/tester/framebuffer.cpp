@@ -0,0 +1,130 @@
+#include "framebuffer.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Same as gpu.vhd, shade 0 is white
+static const byte GREY[4] = { 255, 170, 85, 0 };
+
+Framebuffer::Framebuffer()
+  : m_data(BYTES, 0)
+{}
+
+Framebuffer::~Framebuffer()
+{}
+
+void Framebuffer::set_pixel(int x, int y, int shade)
+{
+  byte& b = m_data[y * ROW_BYTES + x / 4];
+  int shift = 6 - (x % 4) * 2;
+  b = (b & ~(0x3 << shift)) | ((shade & 0x3) << shift);
+}
+
+std::string Framebuffer::hash() const
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for (int i = 0; i < BYTES; ++i)
+    {
+      hash ^= m_data[i];
+      hash *= 1099511628211ULL;
+    }
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+//A pixel differs if any of its two bits differ, so fold the high bit
+//of every pixel onto the low one and count the low bits.
+int Framebuffer::diff_pixels(const Framebuffer& a, const Framebuffer& b)
+{
+  const byte* pa = a.data();
+  const byte* pb = b.data();
+  int count = 0;
+  int i = 0;
+
+#ifdef __SSE2__
+  //16 bytes (64 pixels) at a time. Only SSE2, which every x86-64 cpu
+  //has: the low bits are summed in pairs, then in nibbles, and the
+  //nibbles of each byte added up by sad.
+  const __m128i low_bits = _mm_set1_epi8(0x55);
+  const __m128i pair_bits = _mm_set1_epi8(0x33);
+  const __m128i low_nibble = _mm_set1_epi8(0x0F);
+  __m128i total = _mm_setzero_si128();
+  for (; i + 16 <= BYTES; i += 16)
+    {
+      __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pa + i)),
+				_mm_loadu_si128((const __m128i*)(pb + i)));
+      x = _mm_and_si128(_mm_or_si128(x, _mm_srli_epi16(x, 1)), low_bits);
+      x = _mm_add_epi8(_mm_and_si128(x, pair_bits), _mm_and_si128(_mm_srli_epi16(x, 2), pair_bits));
+      x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), low_nibble);
+      total = _mm_add_epi64(total, _mm_sad_epu8(x, _mm_setzero_si128()));
+    }
+  count += _mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+#endif
+
+  //8 bytes at a time
+  for (; i + 8 <= BYTES; i += 8)
+    {
+      unsigned long long x, y;
+      memcpy(&x, pa + i, 8);
+      memcpy(&y, pb + i, 8);
+      x ^= y;
+      x = (x | (x >> 1)) & 0x5555555555555555ULL;
+      count += __builtin_popcountll(x);
+    }
+
+  for (; i < BYTES; ++i)
+    {
+      int x = pa[i] ^ pb[i];
+      count += __builtin_popcount((x | (x >> 1)) & 0x55);
+    }
+  return count;
+}
+
+bool Framebuffer::write_ppm(const std::string& file_name, const Framebuffer* against) const
+{
+  std::ofstream file(file_name.c_str(), std::ios::binary);
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << file_name << std::endl;
+      return false;
+    }
+  file << "P6\n" << WIDTH << " " << HEIGHT << "\n255\n";
+  for (int y = 0; y < HEIGHT; ++y)
+    {
+      for (int x = 0; x < WIDTH; ++x)
+	{
+	  byte grey = GREY[pixel(x, y)];
+	  if (against && against->pixel(x, y) != pixel(x, y))
+	    {
+	      file.put(char(255));
+	      file.put(char(0));
+	      file.put(char(0));
+	    }
+	  else
+	    {
+	      file.put(char(grey));
+	      file.put(char(grey));
+	      file.put(char(grey));
+	    }
+	}
+    }
+  return true;
+}
+
+bool Framebuffer::read_stream(const std::string& file_name, std::vector<Framebuffer>& to)
+{
+  std::ifstream file(file_name.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  Framebuffer frame;
+  while (file.read((char*)frame.data(), BYTES))
+    to.push_back(frame);
+  return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "typedefs.hpp"
+
+//One frame as written by rom_test.vhd: 160x144 pixels, 2 bits each,
+//four pixels per byte with the leftmost pixel in the high bits.
+class Framebuffer
+{
+public:
+  Framebuffer();
+  virtual ~Framebuffer();
+
+  inline int pixel(int x, int y) const
+  {
+    return (m_data[y * ROW_BYTES + x / 4] >> (6 - (x % 4) * 2)) & 0x3;
+  };
+  void set_pixel(int x, int y, int shade);
+
+  inline byte* data() { return &m_data[0];};
+  inline const byte* data() const { return &m_data[0];};
+
+  //64 bit FNV-1a of the packed pixels, as hex
+  std::string hash() const;
+
+  //Number of pixels that differ between the two frames
+  static int diff_pixels(const Framebuffer& a, const Framebuffer& b);
+
+  //Writes the frame as a greyscale ppm. If against is given,
+  //pixels that differ from it are drawn in red.
+  bool write_ppm(const std::string& file_name, const Framebuffer* against = 0) const;
+
+  //Reads all frames in a stream, returns false if the file could not be read
+  static bool read_stream(const std::string& file_name, std::vector<Framebuffer>& to);
+
+  const static int WIDTH = 160;
+  const static int HEIGHT = 144;
+  const static int ROW_BYTES = WIDTH / 4;
+  const static int BYTES = ROW_BYTES * HEIGHT;
+
+private:
+  std::vector<byte> m_data;
+};
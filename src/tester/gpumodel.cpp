@@ -0,0 +1,184 @@
+#include "gpumodel.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+//Byte p of SPREAD[b] is bit 7 - p of b, byte p of SPREAD_FLIPPED[b]
+//is bit p of b. This way one lookup decodes a bit plane of eight pixels.
+//Assumes a little endian host, like everything else we run on.
+struct SpreadTables
+{
+  SpreadTables()
+  {
+    for (int b = 0; b < 256; ++b)
+      {
+	normal[b] = flipped[b] = 0;
+	for (int p = 0; p < 8; ++p)
+	  {
+	    normal[b] |= (unsigned long long)((b >> (7 - p)) & 1) << (p * 8);
+	    flipped[b] |= (unsigned long long)((b >> p) & 1) << (p * 8);
+	  }
+      }
+  }
+  unsigned long long normal[256];
+  unsigned long long flipped[256];
+};
+
+static const SpreadTables SPREAD;
+
+Scene::Scene()
+  : lcd(0x91), scroll_x(0x00), scroll_y(0x91),
+    bg_palette(0xFC), obj_palette_0(0xFF), obj_palette_1(0xFF)
+{
+  memset(vram, 0, sizeof(vram));
+  memset(oam, 0, sizeof(oam));
+}
+
+bool Scene::read(const std::string& file_name)
+{
+  std::ifstream file(file_name.c_str(), std::ios::binary);
+  byte regs[6];
+  if (!file.read((char*)vram, sizeof(vram))
+      || !file.read((char*)oam, sizeof(oam))
+      || !file.read((char*)regs, sizeof(regs)))
+    return false;
+  lcd = regs[0];
+  scroll_x = regs[1];
+  scroll_y = regs[2];
+  bg_palette = regs[3];
+  obj_palette_0 = regs[4];
+  obj_palette_1 = regs[5];
+  return true;
+}
+
+bool Scene::write(const std::string& file_name) const
+{
+  std::ofstream file(file_name.c_str(), std::ios::binary);
+  byte regs[6] = { lcd, scroll_x, scroll_y, bg_palette, obj_palette_0, obj_palette_1 };
+  file.write((const char*)vram, sizeof(vram));
+  file.write((const char*)oam, sizeof(oam));
+  file.write((const char*)regs, sizeof(regs));
+  return file.good();
+}
+
+GpuModel::GpuModel()
+  : m_max_sprites(10)
+{}
+
+GpuModel::~GpuModel()
+{}
+
+unsigned long long GpuModel::decode(byte low, byte high, bool hflip)
+{
+  const unsigned long long* table = hflip ? SPREAD.flipped : SPREAD.normal;
+  return table[low] | (table[high] << 1);
+}
+
+unsigned long long GpuModel::apply_palette(unsigned long long indices, byte palette)
+{
+#ifdef __SSSE3__
+  __m128i lut = _mm_setr_epi8(palette & 0x3, (palette >> 2) & 0x3,
+			      (palette >> 4) & 0x3, (palette >> 6) & 0x3,
+			      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i shades = _mm_shuffle_epi8(lut, _mm_cvtsi64_si128(indices));
+  return _mm_cvtsi128_si64(shades);
+#else
+  unsigned long long shades = 0;
+  for (int p = 0; p < 8; ++p)
+    {
+      int index = (indices >> (p * 8)) & 0x3;
+      shades |= (unsigned long long)((palette >> (index * 2)) & 0x3) << (p * 8);
+    }
+  return shades;
+#endif
+}
+
+void GpuModel::render_line(const Scene& scene, int line, byte* shades) const
+{
+  //The VHDL reads 21 tiles and then shifts Scroll_X mod 8 pixels out
+  byte bg[21 * 8];
+  int y = (scene.scroll_y + line) & 0xFF;
+  int map = ((scene.lcd & 0x08) ? 0x1C00 : 0x1800) + (y / 8) * 32;
+  int tile_line = y % 8;
+
+  for (int n = 0; n < 21; ++n)
+    {
+      byte tile = scene.vram[map + ((n + scene.scroll_x / 8) % 32)];
+      int addr;
+      if (scene.lcd & 0x10)
+	addr = tile * 16 + tile_line * 2;
+      else
+	addr = 0x1000 + (signed char)tile * 16 + tile_line * 2;
+      unsigned long long indices = decode(scene.vram[addr], scene.vram[addr + 1], false);
+      memcpy(bg + n * 8, &indices, 8);
+    }
+
+  for (int x = 0; x < WIDTH; x += 8)
+    {
+      unsigned long long indices;
+      memcpy(&indices, bg + x + scene.scroll_x % 8, 8);
+      unsigned long long s = apply_palette(indices, scene.bg_palette);
+      memcpy(shades + x, &s, 8);
+    }
+
+  if (!(scene.lcd & 0x02))
+    return;
+
+  int height = (scene.lcd & 0x04) ? 16 : 8;
+  int drawn = 0;
+  for (int i = 0; i < 40; ++i)
+    {
+      const byte* sprite = scene.oam + i * 4;
+      byte options = sprite[3];
+      int sprite_y = (line - sprite[0] + 16) & 0xFF;
+      if (options & 0x40)
+	sprite_y = (7 - sprite_y) & 0xFF;
+      if (sprite_y >= height)
+	continue;
+      if (m_max_sprites > 0 && drawn == m_max_sprites)
+	break;
+      ++drawn;
+
+      int addr = sprite[2] * 16 + sprite_y * 2;
+      unsigned long long indices = decode(scene.vram[addr], scene.vram[addr + 1], options & 0x20);
+      unsigned long long colours = apply_palette(indices, (options & 0x10) ? scene.obj_palette_1 : scene.obj_palette_0);
+
+      for (int p = 0; p < 8; ++p)
+	{
+	  int x = p + sprite[1] - 8;
+	  if (x < 0 || x >= WIDTH)
+	    continue;
+	  byte index = (indices >> (p * 8)) & 0x3;
+	  byte colour = (colours >> (p * 8)) & 0x3;
+	  if (options & 0x80)
+	    {
+	      //Behind the background, but that only looks at the shade
+	      if (shades[x] == 0)
+		shades[x] = colour;
+	    }
+	  else if (index != 0)
+	    {
+	      shades[x] = colour;
+	    }
+	}
+    }
+}
+
+void GpuModel::render_frame(const Scene& scene, Framebuffer& to) const
+{
+  byte shades[WIDTH];
+  byte* out = to.data();
+  memset(out, 0, Framebuffer::ROW_BYTES * 2);
+
+  for (int row = 2; row < HEIGHT; ++row)
+    {
+      render_line(scene, row - 1, shades);
+      byte* packed = out + row * Framebuffer::ROW_BYTES;
+      for (int x = 0; x < WIDTH; x += 4)
+	packed[x / 4] = (shades[x] << 6) | (shades[x + 1] << 4) | (shades[x + 2] << 2) | shades[x + 3];
+    }
+}
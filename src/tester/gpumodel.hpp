@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include "typedefs.hpp"
+#include "framebuffer.hpp"
+
+//Everything the GPU reads while drawing a frame. The registers
+//start out as gpu_logic.vhd sets them on reset.
+struct Scene
+{
+  Scene();
+
+  //0x8000-0x9FFF
+  byte vram[8192];
+  //0xFE00-0xFE9F, 4 bytes per sprite: y, x, tile, options
+  byte oam[160];
+  byte lcd, scroll_x, scroll_y;
+  byte bg_palette, obj_palette_0, obj_palette_1;
+
+  //Binary format: vram, oam and then the six registers in the order above
+  bool read(const std::string& file_name);
+  bool write(const std::string& file_name) const;
+
+  const static int FILE_SIZE = 8192 + 160 + 6;
+};
+
+//A model of the scanline generator in gpu_logic.vhd, made to produce the
+//same frames as rom_test.vhd captures. It follows the VHDL including its
+//quirks, for example that sprites later in OAM are drawn on top, that
+//sprites behind the background are drawn wherever the background has
+//shade 0 (even with transparent pixels), and that vflip of 8x16 sprites
+//only flips the upper tile.
+class GpuModel
+{
+public:
+  GpuModel();
+  virtual ~GpuModel();
+
+  //Renders line (0-143) into shades, which must hold WIDTH values
+  void render_line(const Scene& scene, int line, byte* shades) const;
+
+  //Renders the frame as it is displayed. gpu_logic.vhd renders line
+  //n while row n is displayed and shows it on the next row, and
+  //it never renders line 0, so rows 0 and 1 are always shade 0.
+  void render_frame(const Scene& scene, Framebuffer& to) const;
+
+  //Maximum number of sprites drawn on one line. The real Game Boy draws
+  //the first 10, gpu_logic.vhd currently draws all of them (0).
+  inline void set_max_sprites(int max) { m_max_sprites = max;};
+
+  const static int WIDTH = Framebuffer::WIDTH;
+  const static int HEIGHT = Framebuffer::HEIGHT;
+
+private:
+  //Decodes one row of a 2bpp tile into 8 colour indices, leftmost first
+  static unsigned long long decode(byte low, byte high, bool hflip);
+  //Maps 8 colour indices through a palette
+  static unsigned long long apply_palette(unsigned long long indices, byte palette);
+
+  int m_max_sprites;
+};
@@ -0,0 +1,210 @@
+#include "../serial/stdafx.h"
+#include "../serial/port.h"
+#include "../serial/uploader.h"
+#include "../serial/monitor.h"
+
+#include "hwbackend.hpp"
+#include "addrdata.hpp"
+#include "util.hpp"
+#include "test.hpp"
+#include "timing.hpp"
+
+#include <sstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct Board
+{
+  Board(const std::string& name, int baud) : name(name), port(name, baud), synced(false) {};
+
+  std::string name;
+  Port port;
+  //The FPGA has measured the baud rate from our sync byte
+  bool synced;
+  //What the rom contains, so only the changes have to be uploaded
+  std::vector<byte> rom;
+};
+
+HwBackend::HwBackend(const std::string& ports, int baud)
+  : m_baud(baud)
+{
+  std::stringstream ss(ports);
+  std::string name;
+  while (std::getline(ss, name, ','))
+    if (!name.empty())
+      m_port_names.push_back(name);
+}
+
+HwBackend::~HwBackend()
+{
+  for (std::vector<Board*>::iterator it = m_boards.begin(); it != m_boards.end(); ++it)
+    delete *it;
+}
+
+bool HwBackend::open()
+{
+  for (std::vector<std::string>::const_iterator it = m_port_names.begin();
+       it != m_port_names.end();
+       ++it)
+    {
+      Board* b = new Board(*it, m_baud ? m_baud : 115200);
+      m_boards.push_back(b);
+      if (!b->port.isOpen())
+	{
+	  std::cout << "DEBUG: Couldn't open " << *it << std::endl;
+	  return false;
+	}
+      if (m_baud != 0 && b->port.getBaud() != m_baud)
+	{
+	  std::cout << "DEBUG: " << *it << " doesn't accept the baud rate" << std::endl;
+	  return false;
+	}
+      if (m_baud == 0)
+	{
+	  Monitor monitor(b->port);
+	  if (monitor.negotiateBaud() == 0)
+	    {
+	      std::cout << "DEBUG: The board on " << *it << " doesn't answer at any baud rate" << std::endl;
+	      return false;
+	    }
+	  std::cout << "DEBUG: " << *it << " works at " << b->port.getBaud() << " baud" << std::endl;
+	  b->synced = true;
+	}
+    }
+  return !m_boards.empty();
+}
+
+bool HwBackend::write_ram(Monitor& monitor, const std::vector<byte>& image)
+{
+  size_t end = std::min(image.size(), size_t(RAM_END));
+  size_t at = ROM_SIZE;
+  while (at < end)
+    {
+      while (at < end && image[at] == 0)
+	++at;
+      if (at == end)
+	break;
+      //Runs of zeros shorter than a frame header are cheaper to send
+      size_t to = at + 1, zeros = 0;
+      while (to < end && zeros < FRAME_OVERHEAD)
+	{
+	  zeros = image[to] == 0 ? zeros + 1 : 0;
+	  ++to;
+	}
+      to -= zeros;
+      if (!monitor.write(at, &image[at], to - at))
+	return false;
+      at = to;
+    }
+  return true;
+}
+
+bool HwBackend::run(int worker, const std::string& entity, int test_num,
+		    const std::vector<byte>& image, const AddrDatas& checks,
+		    const RunOptions& options, RunResult& result)
+{
+  Board& b = *m_boards[worker];
+  Monitor monitor(b.port);
+
+  if (!b.synced)
+    {
+      if (!b.port.sendBreak() || !b.port.write(&SYNC_BYTE, 1))
+	{
+	  std::cout << "DEBUG: " << b.name << ": couldn't send the sync byte" << std::endl;
+	  return false;
+	}
+      b.synced = true;
+    }
+
+  //The upload starts the cpu when it is done, it should stay stalled
+  //until the ram is written as well
+  nat pc;
+  if (!monitor.halt(pc))
+    {
+      std::cout << "DEBUG: " << b.name << ": " << monitor.error() << std::endl;
+      b.synced = false;
+      return false;
+    }
+
+  {
+    Timing::Phase phase(options.timing, "load", test_num, worker);
+    std::vector<byte> rom(image.begin(), image.begin() + std::min<size_t>(image.size(), ROM_SIZE));
+    rom.resize(ROM_SIZE, byte(EMPTY_ROM));
+    //serial diffs against what it uploaded last, which is gone now
+    std::remove(cachePath(b.name).c_str());
+    Uploader upload(b.port, rom, false, true, b.rom.empty() ? 0 : &b.rom);
+    while (upload.step())
+      b.port.waitForData(5);
+    if (upload.failed())
+      {
+	std::cout << "DEBUG: " << b.name << ": " << upload.error() << std::endl;
+	b.rom.clear();
+	b.synced = false;
+	return false;
+      }
+    b.rom = rom;
+    writeCache(b.name, rom);
+
+    //Zeros in all the ram and the stack so that nothing is left there
+    //from the last test, the simulation starts with zeros. Then only the
+    //bytes of the rest of the image that aren't zero.
+    if (!monitor.fill(ROM_SIZE, ECHO_START - ROM_SIZE, 0)
+	|| !monitor.fill(HRAM_START, HRAM_END - HRAM_START, 0)
+	|| !write_ram(monitor, image))
+      {
+	std::cout << "DEBUG: " << b.name << ": " << monitor.error() << std::endl;
+	return false;
+      }
+  }
+
+  {
+    Timing::Phase phase(options.timing, "execute", test_num, worker);
+    //A round trip over USB takes longer than most tests, so let it run for
+    //the whole time like the simulation does
+    if (!monitor.resume())
+      {
+	std::cout << "DEBUG: " << b.name << ": " << monitor.error() << std::endl;
+	return false;
+      }
+#ifdef _WIN32
+    Sleep(options.simulation_time / 1000 + 1);
+#else
+    usleep(options.simulation_time);
+#endif
+    byte last_op = 0;
+    if (!monitor.halt(pc) || !monitor.peek((pc - 1) & 0xFFFF, last_op))
+      {
+	std::cout << "DEBUG: " << b.name << ": " << monitor.error() << std::endl;
+	return false;
+      }
+    if (last_op != HALT_OPCODE)
+      {
+	std::cout << "DEBUG: " << entity << " " << test_num << " did not reach HALT, it is at "
+		  << std::hex << pc << std::dec << std::endl;
+	return false;
+      }
+  }
+
+  Timing::Phase phase(options.timing, "read back", test_num, worker);
+  result.ram.assign(0x10000 - Test::BASE_CHECK_OFFSET, "");
+  for (AddrDatas::const_iterator it = checks.begin(); it != checks.end(); ++it)
+    {
+      int addr = it->get_addr();
+      if (addr < Test::BASE_CHECK_OFFSET)
+	continue;
+      std::vector<byte> data;
+      if (!monitor.read(addr, it->get_bytes().size(), data))
+	{
+	  std::cout << "DEBUG: " << b.name << ": " << monitor.error() << std::endl;
+	  return false;
+	}
+      for (size_t i = 0; i < data.size() && addr + i < 0x10000; ++i)
+	result.ram[addr + i - Test::BASE_CHECK_OFFSET] = Util::to_bin(int(data[i]));
+    }
+  return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "backend.hpp"
+
+struct Board;
+class Monitor;
+
+//Runs the tests on FPGA boards, through the upload protocol and the debug
+//monitor in serial.vhd. Each test is uploaded with the cpu stalled, then
+//it runs for options.simulation_time and the checks are read back. The
+//tests are spread over all the boards.
+class HwBackend : public Backend
+{
+public:
+  //ports is a comma separated list of serial ports, one board on each.
+  //A baud of 0 picks the fastest rate each board answers at.
+  HwBackend(const std::string& ports, int baud);
+  virtual ~HwBackend();
+
+  //Opens the ports, returns false if any of them can't be used
+  bool open();
+
+  virtual int workers() const { return m_boards.size();};
+  virtual bool run(int worker, const std::string& entity, int test_num,
+		   const std::vector<byte>& image, const AddrDatas& checks,
+		   const RunOptions& options, RunResult& result);
+
+  //The rom is this large, the rest of the image is written to the bus
+  const static int ROM_SIZE = 0x8000;
+  //What the rom contains before anything is uploaded, see bus_controller.vhd
+  const static byte EMPTY_ROM = 0x76;
+  //Every test should end in it
+  const static byte HALT_OPCODE = 0x76;
+  //Nothing of the image is written from here on, it is the I/O registers
+  const static int RAM_END = 0xFE00;
+  //The bus ignores writes to the echo of the working ram from here on,
+  //so clearing stops here
+  const static int ECHO_START = 0xE000;
+  //The stack ram, FFFF after it is IE
+  const static int HRAM_START = 0xFF80;
+  const static int HRAM_END = 0xFFFF;
+
+private:
+  //Writes the bytes of image from ROM_SIZE up to RAM_END that aren't
+  //zero, the ram has just been cleared
+  bool write_ram(Monitor& monitor, const std::vector<byte>& image);
+
+  std::vector<std::string> m_port_names;
+  int m_baud;
+  std::vector<Board*> m_boards;
+};
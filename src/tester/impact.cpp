@@ -0,0 +1,285 @@
+#include "impact.hpp"
+#include "util.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+//The CPU, the only file whose changes can be narrowed down to opcodes
+static const char* CPU_FILE = "cpu.vhd";
+//Where the suites are, a change in tests/NAME/ only affects suite NAME
+static const char* TESTS_DIR = "tests/";
+
+//Runs git with args, false if it failed
+static bool git(const std::string& args, std::string& out)
+{
+#ifdef _WIN32
+  FILE* pipe = popen(("git " + args + " 2>NUL").c_str(), "r");
+#else
+  FILE* pipe = popen(("git " + args + " 2>/dev/null").c_str(), "r");
+#endif
+  if (!pipe)
+    return false;
+  out.clear();
+  char buffer[256];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    out.append(buffer, read);
+  return pclose(pipe) == 0;
+}
+
+//The line without leading blanks, in lower case like VHDL doesn't care
+static std::string keywords(const std::string& line)
+{
+  size_t start = line.find_first_not_of(" \t\r");
+  if (start == std::string::npos)
+    return "";
+  std::string s = line.substr(start);
+  for (size_t i = 0; i < s.size(); ++i)
+    s[i] = tolower(s[i]);
+  return s;
+}
+
+static bool starts_with(const std::string& s, const std::string& prefix)
+{
+  return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+//Every x"..." in line as keywords() makes it, like the choices of a when
+static std::vector<int> hex_literals(const std::string& line)
+{
+  std::vector<int> values;
+  for (size_t at = line.find("x\""); at != std::string::npos; at = line.find("x\"", at + 2))
+    {
+      size_t end = line.find('"', at + 2);
+      if (end == std::string::npos)
+	break;
+      values.push_back(strtol(line.substr(at + 2, end - at - 2).c_str(), 0, 16));
+    }
+  return values;
+}
+
+CpuSource::CpuSource()
+{}
+
+CpuSource::~CpuSource()
+{}
+
+void CpuSource::parse(const std::string& text)
+{
+  m_lines.clear();
+  m_arms.clear();
+  m_aliases.clear();
+
+  //Depth of the case statements the line is in, and those of the case
+  //on State and the case on the opcode in the state we're in
+  int depth = 0, state_depth = -1, opcode_depth = -1;
+  bool in_exec = false;
+  int arm = -1;
+  std::stringstream ss(text);
+  std::string line;
+  while (std::getline(ss, line))
+    {
+      std::string k = keywords(line);
+      Line l = { LINE_SHARED, -1 };
+      if (k.empty() || starts_with(k, "--"))
+	{
+	  l.kind = LINE_NOTHING;
+	}
+      else if (starts_with(k, "case ") || starts_with(k, "case("))
+	{
+	  ++depth;
+	  if (state_depth == -1 && k.find("(state)") != std::string::npos)
+	    state_depth = depth;
+	  else if (in_exec && depth == state_depth + 1)
+	    opcode_depth = depth;
+	  else if (arm != -1)
+	    l.kind = LINE_OPCODES;
+	}
+      else if (starts_with(k, "end case"))
+	{
+	  if (depth == state_depth)
+	    {
+	      state_depth = -1;
+	      in_exec = false;
+	    }
+	  else if (depth == opcode_depth)
+	    {
+	      opcode_depth = -1;
+	      arm = -1;
+	    }
+	  else if (arm != -1)
+	    l.kind = LINE_OPCODES;
+	  --depth;
+	}
+      else if (starts_with(k, "when ") && depth == state_depth)
+	{
+	  in_exec = starts_with(k, "when exec") || starts_with(k, "when mb_exec");
+	}
+      else if (starts_with(k, "when ") && depth == opcode_depth)
+	{
+	  //others is run by every opcode that has no arm
+	  arm = -1;
+	  if (k.find("others") == std::string::npos)
+	    {
+	      arm = m_arms.size();
+	      m_arms.push_back(hex_literals(k));
+	      l.kind = LINE_OPCODES;
+	    }
+	}
+      else if (arm != -1)
+	{
+	  l.kind = LINE_OPCODES;
+	  if (starts_with(k, "ir <= x\""))
+	    {
+	      std::vector<int> to = hex_literals(k);
+	      for (size_t i = 0; i < m_arms[arm].size() && !to.empty(); ++i)
+		if (m_arms[arm][i] != to[0])
+		  m_aliases.insert(std::make_pair(m_arms[arm][i], to[0]));
+	    }
+	}
+      if (l.kind == LINE_OPCODES)
+	l.arm = arm;
+      m_lines.push_back(l);
+    }
+}
+
+CpuSource::LineKind CpuSource::line_kind(int line, std::set<int>& opcodes) const
+{
+  //Past the end is where lines are added to the end of the file
+  if (line < 1 || line > int(m_lines.size()))
+    return LINE_SHARED;
+  const Line& l = m_lines[line - 1];
+  if (l.kind == LINE_OPCODES)
+    opcodes.insert(m_arms[l.arm].begin(), m_arms[l.arm].end());
+  return l.kind;
+}
+
+Impact::Impact()
+{}
+
+Impact::~Impact()
+{}
+
+bool Impact::diff(const std::string& rev)
+{
+  m_opcodes.clear();
+  m_suites.clear();
+  m_reason.clear();
+
+  std::string changes, untracked, old_cpu;
+  if (!git("diff -U0 --relative " + rev + " -- .", changes)
+      || !git("ls-files --others --exclude-standard -- .", untracked))
+    return false;
+
+  std::stringstream files(untracked);
+  std::string path;
+  while (std::getline(files, path))
+    if (path.size() > 4 && path.substr(path.size() - 4) == ".vhd")
+      {
+	m_reason = path + " is new";
+	return true;
+      }
+
+  CpuSource old_source, new_source;
+  bool cpu_parsed = false;
+  std::stringstream ss(changes);
+  std::string line;
+  path.clear();
+  while (std::getline(ss, line) && m_reason.empty())
+    {
+      if (starts_with(line, "diff --git "))
+	{
+	  //diff --git a/PATH b/PATH
+	  size_t at = line.find(" b/");
+	  path = at == std::string::npos ? "" : line.substr(at + 3);
+	  if (starts_with(path, TESTS_DIR))
+	    {
+	      size_t slash = path.find('/', std::string(TESTS_DIR).size());
+	      if (slash != std::string::npos)
+		m_suites.insert(path.substr(std::string(TESTS_DIR).size(),
+					    slash - std::string(TESTS_DIR).size()));
+	    }
+	  else if (path == CPU_FILE && !cpu_parsed)
+	    {
+	      //Gone or new, every line would count anyway
+	      if (!git("show " + rev + ":./" + CPU_FILE, old_cpu))
+		return false;
+	      old_source.parse(old_cpu);
+	      new_source.parse(Util::read_file(CPU_FILE));
+	      cpu_parsed = true;
+	    }
+	  else if (path != CPU_FILE && !starts_with(path, "cycles/")
+		   && !starts_with(path, "instruction-listing/")
+		   && path.find(".txt") == std::string::npos
+		   && path.find(".md") == std::string::npos)
+	    {
+	      m_reason = path + " changed";
+	    }
+	}
+      else if (starts_with(line, "@@ ") && path == CPU_FILE)
+	{
+	  //@@ -FIRST[,COUNT] +FIRST[,COUNT] @@, COUNT is 1 if left out
+	  int old_first = 0, old_count = 1, new_first = 0, new_count = 1;
+	  std::string old_range, new_range;
+	  std::stringstream hunk(line.substr(3));
+	  hunk >> old_range >> new_range;
+	  std::replace(old_range.begin(), old_range.end(), ',', ' ');
+	  std::replace(new_range.begin(), new_range.end(), ',', ' ');
+	  std::stringstream(old_range.substr(1)) >> old_first >> old_count;
+	  std::stringstream(new_range.substr(1)) >> new_first >> new_count;
+	  add_lines(old_source, old_first, old_count, "was");
+	  add_lines(new_source, new_first, new_count, "is");
+	}
+    }
+  if (!m_reason.empty())
+    return true;
+
+  //The opcodes that go on in the arms of a changed one run it too
+  bool added = true;
+  while (added)
+    {
+      added = false;
+      const std::multimap<int, int>* aliases[] = { &old_source.aliases(), &new_source.aliases() };
+      for (int i = 0; i < 2; ++i)
+	for (std::multimap<int, int>::const_iterator it = aliases[i]->begin(); it != aliases[i]->end(); ++it)
+	  if (m_opcodes.count(it->second) && !m_opcodes.count(it->first))
+	    {
+	      m_opcodes.insert(it->first);
+	      added = true;
+	    }
+    }
+  return true;
+}
+
+void Impact::add_lines(const CpuSource& source, int first, int count, const std::string& side)
+{
+  for (int line = first; line < first + count && m_reason.empty(); ++line)
+    if (source.line_kind(line, m_opcodes) == CpuSource::LINE_SHARED)
+      {
+	std::stringstream reason;
+	reason << "line " << line << " of " << CPU_FILE << " " << side
+	       << " shared by all opcodes";
+	m_reason = reason.str();
+      }
+}
+
+bool Impact::affects(const Coverage& coverage, const std::string& suite, int test_num) const
+{
+  std::set<int> executed;
+  if (everything() || suite_changed(suite) || !coverage.test_opcodes(suite, test_num, executed))
+    return true;
+  for (std::set<int>::const_iterator it = executed.begin(); it != executed.end(); ++it)
+    //The CB and 10 arms in Exec fetch the second byte of theirs
+    if (m_opcodes.count(*it) || (*it > 0xFF && m_opcodes.count(*it >> 8)))
+      return true;
+  return false;
+}
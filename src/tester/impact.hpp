@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include "coverage.hpp"
+
+//The arms of the opcode case statements in cpu.vhd, those of every Exec
+//and Mb_Exec state, like instruction-listing/instructions finds them but
+//with the lines they span
+class CpuSource
+{
+public:
+  CpuSource();
+  virtual ~CpuSource();
+
+  //text is the whole of cpu.vhd
+  void parse(const std::string& text);
+
+  enum LineKind
+    {
+      //Blank or only a comment, changing it changes nothing
+      LINE_NOTHING,
+      //Used by every instruction, like the fetch or the start of a state
+      LINE_SHARED,
+      //In the arms of some opcodes
+      LINE_OPCODES
+    };
+  //What line (from 1) of the file is, the opcodes it belongs to are
+  //added to opcodes. Opcodes are like in RunResult::opcodes, only the
+  //arms of the CB and 10 prefixes in Exec are 0xCB and 0x10.
+  LineKind line_kind(int line, std::set<int>& opcodes) const;
+
+  //Opcodes that go on in the arms of another by setting IR to it, like
+  //the interrupts do with RST, from -> to
+  const std::multimap<int, int>& aliases() const { return m_aliases;};
+
+private:
+  struct Line
+  {
+    LineKind kind;
+    //Index in m_arms when kind is LINE_OPCODES
+    int arm;
+  };
+
+  std::vector<Line> m_lines;
+  std::vector<std::vector<int> > m_arms;
+  std::multimap<int, int> m_aliases;
+};
+
+//Which tests have to run again after a change, from what changed since a
+//git revision and the opcodes each test executed (see Coverage). A test
+//that doesn't execute any changed opcode takes the same path through
+//unchanged code as before, so only changes outside the opcode arms of
+//cpu.vhd, or to anything else the tests run on, need all of them.
+class Impact
+{
+public:
+  Impact();
+  virtual ~Impact();
+
+  //Finds what changed in the working tree since rev, run from src/.
+  //False if git couldn't tell.
+  bool diff(const std::string& rev);
+
+  //Every test has to run, reason() says why
+  bool everything() const { return !m_reason.empty();};
+  const std::string& reason() const { return m_reason;};
+  //The opcodes whose arms changed
+  const std::set<int>& opcodes() const { return m_opcodes;};
+  //Whether the stimuli or settings of suite changed
+  bool suite_changed(const std::string& suite) const { return m_suites.count(suite) > 0;};
+
+  //Whether test_num of suite may behave differently now. Tests that
+  //coverage has no record of always may.
+  bool affects(const Coverage& coverage, const std::string& suite, int test_num) const;
+
+private:
+  //Adds the opcodes of the changed line of source, first..first+count-1
+  void add_lines(const CpuSource& source, int first, int count, const std::string& side);
+
+  std::set<int> m_opcodes;
+  //Suites whose tests changed
+  std::set<std::string> m_suites;
+  std::string m_reason;
+};
@@ -2,19 +2,132 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <iomanip>
 
 #include "parser.hpp"
 #include "tokenizer.hpp"
+#include "simbackend.hpp"
+#include "simulator.hpp"
+#include "hwbackend.hpp"
+#include "timing.hpp"
+#include "coverage.hpp"
+#include "impact.hpp"
 
-void run_test(const std::string& dir_name, const std::string& test_name, int test_num, bool one_test_only, int simulation_time)
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+void print_ok(const Test& t)
+{
+  std::cout << "OK";
+  if (t.cycles_unchecked())
+    std::cout << " (@cycles unchecked, the backend can't count clocks)";
+  std::cout << std::endl;
+}
+
+void print_failure(const Test& t)
+{
+  std::cout << "FAIL, here's some info:" << std::endl;
+  std::cout << t.diff();
+  if (!t.wave_path().empty())
+    std::cout << "Waveform in: " << t.wave_path() << std::endl;
+  if (!t.serial().empty())
+    std::cout << "Serial output: " << t.serial() << std::endl;
+  std::cout << std::endl;
+  std::cout << "Here's the test: " << std::endl;
+  std::cout << t << std::endl;
+}
+
+//Runs the tests numbered (from 1) in numbers on all workers of the
+//backend at the same time, the results are still printed in order
+bool run_parallel(const std::string& test_name, Tests& to_run, const std::vector<int>& numbers,
+		  const RunOptions& options, Backend& backend)
+{
+  std::vector<Test*> all, tests;
+  for (Tests::iterator it = to_run.begin(); it != to_run.end(); ++it)
+    all.push_back(&*it);
+  for (size_t i = 0; i < numbers.size(); ++i)
+    tests.push_back(all[numbers[i] - 1]);
+  std::vector<int> results(tests.size(), -1);
+  size_t next = 0;
+  std::mutex lock;
+  std::condition_variable done;
+
+  std::vector<std::thread> workers;
+  for (int w = 0; w < backend.workers(); ++w)
+    workers.push_back(std::thread([&, w]() {
+	  for (;;)
+	    {
+	      size_t i;
+	      {
+		std::lock_guard<std::mutex> guard(lock);
+		if (next == tests.size())
+		  return;
+		i = next++;
+	      }
+	      bool ok = tests[i]->run(test_name, numbers[i], options, backend, w);
+	      std::lock_guard<std::mutex> guard(lock);
+	      results[i] = ok;
+	      done.notify_all();
+	    }
+	}));
+
+  bool all_ok = true;
+  for (size_t i = 0; i < tests.size(); ++i)
+    {
+      {
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&]() { return results[i] != -1; });
+      }
+      std::cout << "Test " << numbers[i] << " of " << all.size() << ":";
+      if (results[i])
+	{
+	  print_ok(*tests[i]);
+	}
+      else
+	{
+	  all_ok = false;
+	  print_failure(*tests[i]);
+	}
+    }
+  for (size_t w = 0; w < workers.size(); ++w)
+    workers[w].join();
+  return all_ok;
+}
+
+//Tells which tests impact selected and why
+void print_selection(const Impact& impact, const std::string& test_name, int selected, int num_tests)
+{
+  if (impact.everything())
+    {
+      std::cout << "All tests may be affected, " << impact.reason() << std::endl;
+      return;
+    }
+  if (impact.suite_changed(test_name))
+    {
+      std::cout << "All tests may be affected, the suite changed" << std::endl;
+      return;
+    }
+  std::cout << "Changed opcodes:";
+  for (std::set<int>::const_iterator it = impact.opcodes().begin(); it != impact.opcodes().end(); ++it)
+    std::cout << " " << Coverage::opcode_name(*it);
+  if (impact.opcodes().empty())
+    std::cout << " none";
+  std::cout << std::endl << "Skipping the " << num_tests - selected
+	    << " tests that execute none of them and haven't changed" << std::endl;
+}
+
+//With impact only the tests it says are affected are run, the others
+//keep their numbers. Returns true if all that ran passed.
+bool run_test(const std::string& dir_name, const std::string& test_name, int test_num, bool one_test_only,
+	      const RunOptions& options, Backend& backend, const Impact* impact = 0)
 {
   Tokenizer t(dir_name + "/" + test_name + ".stim");
   Parser p(t, dir_name  + "/");
   Tests to_run = p.parse();
-  Tests faulty;
-  bool all_ok = true;
   int i = 1;
   int num_tests = to_run.size();
+  bool all_ok = true;
   //TODO: Fix this kludge..
   if (test_num != -1)
     {
@@ -26,18 +139,14 @@ void run_test(const std::string& dir_name, const std::string& test_name, int tes
 	{
 	  if (i == test_num) 
 	    {
-	      if ((*it).run(test_name, simulation_time))
+	      if ((*it).run(test_name, i, options, backend))
 		{
-		  std::cout << "OK" << std::endl;
+		  print_ok(*it);
 		}
 	      else
 		{
 		  all_ok = false;
-		  std::cout << "FAIL, here's some info:" << std::endl;
-		  faulty.push_back(*it);
-		  std::cout << it->diff() << std::endl;
-		  std::cout << "Here's the test: " << std::endl;
-		  std::cout << *it << std::endl;
+		  print_failure(*it);
 		}
 	    }
 	  else
@@ -47,27 +156,150 @@ void run_test(const std::string& dir_name, const std::string& test_name, int tes
     }
   else
     {
-      std::cout << "Running " << num_tests << " tests for " << test_name << ": " << std::endl;
+      std::vector<int> selected;
+      for (int n = 1; n <= num_tests; ++n)
+	if (!impact || impact->affects(*options.coverage, test_name, n))
+	  selected.push_back(n);
+      if (impact)
+	print_selection(*impact, test_name, selected.size(), num_tests);
+
+      std::cout << "Running " << selected.size();
+      if (int(selected.size()) != num_tests)
+	std::cout << " of " << num_tests;
+      std::cout << " tests for " << test_name;
+      if (backend.workers() > 1)
+	{
+	  std::cout << " on " << backend.workers() << " workers: " << std::endl;
+	  return run_parallel(test_name, to_run, selected, options, backend);
+	}
+      std::cout << ": " << std::endl;
+      std::vector<int>::const_iterator next = selected.begin();
       for (Tests::iterator it = to_run.begin();
-	   it != to_run.end();
+	   it != to_run.end() && next != selected.end();
 	   ++it, ++i) 
 	{
+	  if (i != *next)
+	    continue;
+	  ++next;
 	  std::cout << "Test " << i << " of " << num_tests << ":" << std::flush;
-	  if ((*it).run(test_name, simulation_time))
+	  if ((*it).run(test_name, i, options, backend))
 	    {
-	      std::cout << "OK" << std::endl;
+	      print_ok(*it);
 	    }
 	  else
 	    {
 	      all_ok = false;
-	      std::cout << "FAIL, here's some info:" << std::endl;
-	      faulty.push_back(*it);
-	      std::cout << it->diff() << std::endl;
-	      std::cout << "Here's the test: " << std::endl;
-	      std::cout << *it << std::endl;
+	      print_failure(*it);
 	    }
 	}
     }
+  return all_ok;
+}
+
+//The settings of a suite, from lines like "cycles 1200" in suite.txt in
+//its directory. Without the file the defaults of RunOptions are used.
+void read_suite(const std::string& dir_name, RunOptions& options)
+{
+  std::string path = dir_name + "/suite.txt";
+  std::ifstream file(path.c_str());
+  std::string line;
+  while (std::getline(file, line))
+    {
+      std::stringstream ss(line.substr(0, line.find('#')));
+      std::string key;
+      if (!(ss >> key))
+	continue;
+      if (key == "cycles")
+	ss >> options.cycles;
+      else
+	std::cout << "DEBUG: " << path << ": unknown setting " << key << std::endl;
+    }
+}
+
+//Times the first samples tests on every simulator setup and stores the
+//fastest that works for later runs. A setup works if it builds the test
+//and passes the same tests as the first setup that did.
+bool tune(const std::string& dir_name, const std::string& test_name, int samples, RunOptions options)
+{
+  Tokenizer t(dir_name + "/" + test_name + ".stim");
+  Parser p(t, dir_name  + "/");
+  Tests to_run = p.parse();
+  while (int(to_run.size()) > samples)
+    to_run.pop_back();
+  if (to_run.empty())
+    {
+      std::cout << "Error: No tests to time in " << dir_name << std::endl;
+      return false;
+    }
+  //Only the simulation itself should count
+  options.full_vcd = false;
+  options.rerun_failed = false;
+  options.timing = 0;
+  options.coverage = 0;
+  std::string entity = Test::entity_name(test_name);
+
+  std::cout << "Timing " << to_run.size() << " tests of " << test_name << " on every simulator:" << std::endl;
+  std::vector<Simulator*> setups = Simulator::all();
+  std::vector<bool> reference;
+  std::string reference_name, fastest;
+  double fastest_ms = 0;
+  for (size_t s = 0; s < setups.size(); ++s)
+    {
+      Simulator& sim = *setups[s];
+      std::cout << std::setw(10) << sim.name() << ": " << std::flush;
+      if (!sim.available())
+	{
+	  std::cout << "not installed" << std::endl;
+	  continue;
+	}
+      SimBackend backend(dir_name + "/", sim);
+      double start = Timing::now();
+      if (!backend.prepare(entity))
+	{
+	  std::cout << "doesn't build the test" << std::endl;
+	  continue;
+	}
+      double built = Timing::now();
+      std::vector<bool> verdicts;
+      int i = 1;
+      for (Tests::iterator it = to_run.begin(); it != to_run.end(); ++it, ++i)
+	verdicts.push_back(it->run(test_name, i, options, backend));
+      double ms = (Timing::now() - built) / 1000.0 / verdicts.size();
+
+      std::cout << "built in " << std::fixed << std::setprecision(1) << (built - start) / 1000000.0
+		<< " s, " << ms << " ms per test" << std::endl;
+      std::cout.unsetf(std::ios::fixed);
+      if (reference.empty())
+	{
+	  reference = verdicts;
+	  reference_name = sim.name();
+	}
+      else if (verdicts != reference)
+	{
+	  std::cout << "            but doesn't pass the same tests as " << reference_name << std::endl;
+	  continue;
+	}
+      if (fastest.empty() || ms < fastest_ms)
+	{
+	  fastest = sim.name();
+	  fastest_ms = ms;
+	}
+    }
+  for (size_t s = 0; s < setups.size(); ++s)
+    delete setups[s];
+
+  if (fastest.empty())
+    {
+      std::cout << "Error: No simulator could run the tests" << std::endl;
+      return false;
+    }
+  if (!Simulator::save_choice(fastest))
+    {
+      std::cout << "Error: Couldn't write " << Simulator::CHOICE_FILE << std::endl;
+      return false;
+    }
+  std::cout << "Using " << fastest << " from now on, it is stored in " << Simulator::CHOICE_FILE << std::endl;
+  return true;
 }
 
 void print_usage(const char* name)
@@ -83,6 +315,35 @@ void print_usage(const char* name)
   cout << "           run the tenth test in tests/derp_test/derp_test.stim" << endl;
   cout << "-o         Run only one test, use in conjunction with -n" << endl;
   cout << "-t NUMBER  Simulate each test for NUMBER microseconds, default is 1600" << endl;
+  cout << "-v         Dump a full vcd for every test, by default only failing" << endl;
+  cout << "           tests are re-run with a waveform of the cpu and bus" << endl;
+  cout << "-j NUMBER  Simulate NUMBER tests at the same time" << endl;
+  cout << "-w NUMBER  Only capture the last NUMBER microseconds of waveform before" << endl;
+  cout << "           where a failed test halted or ran out of cycles, as a vcd" << endl;
+  cout << "--wave-from=NUMBER Capture the -w microseconds from NUMBER microseconds" << endl;
+  cout << "           into the run instead, or all from there if there is no -w" << endl;
+  cout << "--backend=sim            Run the tests in ghdl, the default" << endl;
+  cout << "--sim=NAME Simulator for the sim backend: ghdl (what compile.sh uses), ghdl-O2" << endl;
+  cout << "           and ghdl-O3 (ghdl built with llvm or gcc), nvc or nvc-O3. By default" << endl;
+  cout << "           the one --tune picked, or ghdl" << endl;
+  cout << "--tune[=NUMBER] Time the first NUMBER (default 5) tests of -d on every" << endl;
+  cout << "           simulator and use the fastest that works from then on" << endl;
+  cout << "--backend=hw:PORT[,PORT] Run the tests on FPGA boards through the upload" << endl;
+  cout << "           protocol and debug monitor, one board on each serial port." << endl;
+  cout << "           Every test runs for -t microseconds and fails unless it ends in HALT" << endl;
+  cout << "--baud=NUMBER Baud rate for the boards, the fastest that works by default" << endl;
+  cout << "--timing   Time every phase of every test and print p50/p95/max per" << endl;
+  cout << "           phase and the tests per second at the end" << endl;
+  cout << "--trace=FILE Like --timing, and write the phases to FILE as Chrome" << endl;
+  cout << "           trace events, to open in chrome://tracing or Perfetto" << endl;
+  cout << "--coverage=FILE Record which opcodes each test executes in FILE, replacing" << endl;
+  cout << "           what was recorded for the suite before. Only for the sim backend" << endl;
+  cout << "--coverage-report=FILE Print how often, in how many clocks and by which" << endl;
+  cout << "           tests each opcode in FILE was executed, no -d needed" << endl;
+  cout << "--affected=REV Only run the tests that may behave differently since git" << endl;
+  cout << "           revision REV, from which opcodes the cpu.vhd changes are in and" << endl;
+  cout << "           what --coverage recorded for each test at REV. Needs --coverage" << endl;
+  cout << "Exits with 1 if a test failed or the tests couldn't be run" << endl;
 }
 
 std::string find_test_name(std::string& dir_name)
@@ -111,9 +372,14 @@ int main(int argc, char** argv)
       return 0;
     }
   
-  std::string dir_name, test_name;
+  std::string dir_name, test_name, backend_name = "sim", trace_path, sim_name;
+  std::string coverage_path, coverage_report, affected_rev;
+  bool timing = false;
+  int tune_samples = 0, jobs = 1;
+  int baud = 0;
   int test_num = -1, simulation_us = 1600; //1600 us is default
-  bool dir_found = false, num_found = false, only_one_found = false, sim_time_found = false;
+  RunOptions options;
+  bool dir_found = false, num_found = false, only_one_found = false;
   
   for (int i = 1; i < argc; ++i)
     {
@@ -139,38 +405,187 @@ int main(int argc, char** argv)
 	  std::stringstream ss;
 	  ss << argv[++i];
 	  ss >> simulation_us;
-	  if (simulation_us > 0)
-	    sim_time_found = true;
-	  else
+	  if (simulation_us <= 0)
 	    simulation_us = 1600; //Kludge..
 	}
+      else if (strcmp(argv[i], "-v") == 0)
+	{
+	  options.full_vcd = true;
+	}
+      else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+	{
+	  jobs = atoi(argv[++i]);
+	}
+      else if (strcmp(argv[i], "-w") == 0)
+	{
+	  std::stringstream ss;
+	  ss << argv[++i];
+	  ss >> options.wave_window;
+	}
+      else if (strncmp(argv[i], "--wave-from=", 12) == 0)
+	{
+	  options.wave_from = atoi(argv[i] + 12);
+	}
+      else if (strncmp(argv[i], "--backend=", 10) == 0)
+	{
+	  backend_name = argv[i] + 10;
+	}
+      else if (strncmp(argv[i], "--baud=", 7) == 0)
+	{
+	  baud = atoi(argv[i] + 7);
+	}
+      else if (strncmp(argv[i], "--sim=", 6) == 0)
+	{
+	  sim_name = argv[i] + 6;
+	}
+      else if (strcmp(argv[i], "--tune") == 0)
+	{
+	  tune_samples = 5;
+	}
+      else if (strncmp(argv[i], "--tune=", 7) == 0)
+	{
+	  tune_samples = atoi(argv[i] + 7);
+	}
+      else if (strcmp(argv[i], "--timing") == 0)
+	{
+	  timing = true;
+	}
+      else if (strncmp(argv[i], "--trace=", 8) == 0)
+	{
+	  trace_path = argv[i] + 8;
+	  timing = true;
+	}
+      else if (strncmp(argv[i], "--coverage=", 11) == 0)
+	{
+	  coverage_path = argv[i] + 11;
+	}
+      else if (strncmp(argv[i], "--coverage-report=", 18) == 0)
+	{
+	  coverage_report = argv[i] + 18;
+	}
+      else if (strncmp(argv[i], "--affected=", 11) == 0)
+	{
+	  affected_rev = argv[i] + 11;
+	}
     }
   
+  if (!coverage_report.empty())
+    {
+      Coverage coverage;
+      if (!coverage.load(coverage_report))
+	return 1;
+      coverage.report(std::cout);
+      return 0;
+    }
+
   if (!dir_found) 
     {
       std::cout << "Error: You must supply a -d option" << std::endl;
       print_usage(argv[0]);
-      return 0;
+      return 1;
     }
   
   if (num_found && !dir_found)
     {
       std::cout << "Error: You must supply the -d option if using -n" << std::endl;
       print_usage(argv[0]);
-      return 0;
+      return 1;
     }
   
   //Add a check that we are in the src dir and nothing else!
   
   test_name = find_test_name(dir_name);
   if (test_name == "")
-    return 0;
+    return 1;
   
   std::cout << "Running with simulation time of: " << simulation_us << std::endl;
   std::cout << "Dir name is: " << dir_name << std::endl;
   std::cout << "Test name is:" << test_name << std::endl;
   
-  run_test(dir_name, test_name, test_num, only_one_found, simulation_us);
+  options.simulation_time = simulation_us;
+  read_suite(dir_name, options);
+  if (tune_samples > 0)
+    return tune(dir_name, test_name, tune_samples, options) ? 0 : 1;
+
+  Timing timer;
+  if (timing)
+    options.timing = &timer;
+  Coverage coverage;
+  if (!coverage_path.empty())
+    {
+      if (!coverage.load(coverage_path))
+	return 1;
+      //The tests that are skipped keep what they had
+      if (test_num == -1 && affected_rev.empty())
+	coverage.clear_suite(test_name);
+      options.coverage = &coverage;
+    }
+  Impact impact;
+  if (!affected_rev.empty())
+    {
+      if (coverage_path.empty() || test_num != -1)
+	{
+	  std::cout << "Error: --affected needs --coverage and picks the tests itself, leave out -n" << std::endl;
+	  print_usage(argv[0]);
+	  return 1;
+	}
+      if (!impact.diff(affected_rev))
+	{
+	  std::cout << "Error: git couldn't tell what changed since " << affected_rev << std::endl;
+	  return 1;
+	}
+    }
+  const Impact* selection = affected_rev.empty() ? 0 : &impact;
+  //Stays false if the tests couldn't be run at all
+  bool passed = false;
+  if (backend_name == "sim")
+    {
+      if (sim_name.empty())
+	sim_name = Simulator::load_choice();
+      if (sim_name.empty())
+	sim_name = "ghdl";
+      Simulator* sim = Simulator::create(sim_name);
+      if (!sim)
+	{
+	  std::cout << "Error: Unknown simulator " << sim_name << std::endl;
+	  print_usage(argv[0]);
+	  return 1;
+	}
+      SimBackend backend(dir_name + "/", *sim, jobs);
+      if (backend.prepare(Test::entity_name(test_name)))
+	passed = run_test(dir_name, test_name, test_num, only_one_found, options, backend, selection);
+      else
+	std::cout << "Error: Couldn't build the test with " << sim_name << std::endl;
+      delete sim;
+    }
+  else if (backend_name.substr(0, 3) == "hw:")
+    {
+      if (options.coverage)
+	{
+	  std::cout << "Error: The boards can't tell which opcodes they execute, use the sim backend for --coverage" << std::endl;
+	  return 1;
+	}
+      HwBackend backend(backend_name.substr(3), baud);
+      if (!backend.open())
+	{
+	  std::cout << "Error: Couldn't use the boards on " << backend_name.substr(3) << std::endl;
+	  return 1;
+	}
+      passed = run_test(dir_name, test_name, test_num, only_one_found, options, backend, selection);
+    }
+  else
+    {
+      std::cout << "Error: Unknown backend " << backend_name << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+
+  if (timing)
+    timer.report(std::cout);
+  if (!trace_path.empty() && timer.write_trace(trace_path))
+    std::cout << "Trace in: " << trace_path << std::endl;
+  if (!coverage_path.empty() && coverage.save(coverage_path))
+    std::cout << "Coverage in: " << coverage_path << std::endl;
 
-  return 0;
+  return passed ? 0 : 1;
 }
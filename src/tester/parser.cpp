@@ -3,6 +3,7 @@
 const std::string Parser::PREPARE_IDENTIFIER = "prepare";
 const std::string Parser::TEST_IDENTIFIER = "test";
 const std::string Parser::CHECK_IDENTIFIER = "check";
+const std::string Parser::CYCLES_IDENTIFIER = "cycles";
 
 Parser::Parser() 
   : m_block(BLOCK_UNDEFINED),
@@ -65,6 +66,14 @@ Tests Parser::parse()
 	    case BLOCK_PREPARE:
 	      parse_prepare();
 	      break;
+	    case BLOCK_CYCLES:
+	      parse_cycles();
+	      //@check comes next
+	      m_block = BLOCK_TEST;
+	      break;
+	    case BLOCK_UNDEFINED:
+	      //A block without an identifier in front, skip it like before
+	      break;
 	    }
 	}
       m_tokenizer.next();
@@ -162,11 +171,29 @@ void Parser::parse_check()
     }
   add_addr();
   //Now we should find another end block that closes the test
+  m_tokenizer.next();
   while (m_tokenizer.has_token())
     {
       if (m_tokenizer.is_comment())
 	parse_comment();
       
+      if (m_tokenizer.is_identifier())
+	{
+	  m_tokenizer.next();
+	  parse_identifier();
+	  while (m_tokenizer.has_token() && !m_tokenizer.is_start_block())
+	    m_tokenizer.next();
+	  m_tokenizer.next();
+	  if (m_block == BLOCK_CYCLES)
+	    parse_cycles();
+	  else
+	    std::cout << "DEBUG: Only @cycles may follow @check, not @" << m_identifier << std::endl;
+	  m_block = BLOCK_CHECK;
+	  //Past the end of that block
+	  m_tokenizer.next();
+	  continue;
+	}
+
       if (m_tokenizer.is_end_block())
 	break;
       m_tokenizer.next();
@@ -215,6 +242,34 @@ void Parser::parse_prepare()
     }
 }
 
+//Clocks from reset until HALT, "@cycles { 40 60 }" for 40 to 60 of
+//them or "@cycles { 52 }" for exactly 52. They are decimal, unlike the
+//bytes.
+void Parser::parse_cycles()
+{
+  std::stringstream numbers;
+  while (m_tokenizer.has_token() && !m_tokenizer.is_end_block())
+    {
+      if (m_tokenizer.is_comment())
+	parse_comment();
+      
+      numbers << m_tokenizer.current();
+      m_tokenizer.next();
+    }
+  int min = 0, max = 0;
+  if (!(numbers >> min) || min <= 0)
+    {
+      std::cout << "DEBUG: Expected @cycles { MIN MAX } or @cycles { EXACT }, on line "
+		<< m_tokenizer.pos_y() << std::endl;
+      return;
+    }
+  if (!(numbers >> max))
+    max = min;
+  if (max < min)
+    std::swap(min, max);
+  m_current_test.set_cycles(min, max);
+}
+
 std::ostream & operator<<(std::ostream& os, const Parser& p)
 {
   os << "Prepare block (0x150): " << std::endl;
@@ -359,6 +414,8 @@ void Parser::parse_identifier()
     m_block = BLOCK_TEST;
   else if (m_identifier == PREPARE_IDENTIFIER)
     m_block = BLOCK_PREPARE;
+  else if (m_identifier == CYCLES_IDENTIFIER)
+    m_block = BLOCK_CYCLES;
 }
 
 Parser::~Parser()
@@ -23,6 +23,7 @@ enum BlockState
     BLOCK_TEST,
     BLOCK_CHECK,
     BLOCK_PREPARE,
+    BLOCK_CYCLES,
     BLOCK_UNDEFINED
   };
 
@@ -44,6 +45,8 @@ private:
   void parse_test();
   void parse_check();
   void parse_prepare();
+  //@cycles, which goes right before or after @check
+  void parse_cycles();
   //To keep the internal structure going
   void add_test();
   void add_addr();
@@ -57,6 +60,7 @@ private:
   static const std::string PREPARE_IDENTIFIER;
   static const std::string TEST_IDENTIFIER;
   static const std::string CHECK_IDENTIFIER;
+  static const std::string CYCLES_IDENTIFIER;
   
   BlockState m_block, m_prev_block;
   ParserState m_state;
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+
+#include "gpumodel.hpp"
+
+void print_usage(const char* name)
+{
+  using std::cout;
+  using std::endl;
+
+  cout << "Usage: " << name << " options [SCENE]" << endl;
+  cout << "Renders a scene (vram, oam and registers, see gpumodel.hpp) the way" << endl;
+  cout << "gpu_logic.vhd does, to use as golden images." << endl;
+  cout << "-o FILE    Write the frame to FILE, in the same format as rom_test.vhd" << endl;
+  cout << "-p FILE    Write the frame as a ppm image" << endl;
+  cout << "-a         Draw all sprites on a line, like gpu_logic.vhd does now," << endl;
+  cout << "           instead of the first 10" << endl;
+  cout << "-g N DIR   Generate N random scenes with their frames in DIR" << endl;
+  cout << "-b N       Render N random scenes and print how long it took" << endl;
+  cout << "-s NUMBER  Seed for the random scenes" << endl;
+}
+
+void random_scene(Scene& scene)
+{
+  for (unsigned int i = 0; i < sizeof(scene.vram); ++i)
+    scene.vram[i] = byte(rand());
+  for (unsigned int i = 0; i < sizeof(scene.oam); ++i)
+    scene.oam[i] = byte(rand());
+  scene.lcd = byte(rand());
+  scene.scroll_x = byte(rand());
+  scene.scroll_y = byte(rand());
+  scene.bg_palette = byte(rand());
+  scene.obj_palette_0 = byte(rand());
+  scene.obj_palette_1 = byte(rand());
+}
+
+std::string numbered(const std::string& dir, int n, const std::string& suffix)
+{
+  std::stringstream ss;
+  ss << dir << "/scene_" << n << suffix;
+  return ss.str();
+}
+
+int main(int argc, char** argv)
+{
+  std::string scene_file, out_file, ppm_file, gen_dir;
+  int generate = 0, bench = 0;
+  unsigned int seed = 1;
+  GpuModel model;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+	out_file = argv[++i];
+      else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+	ppm_file = argv[++i];
+      else if (strcmp(argv[i], "-a") == 0)
+	model.set_max_sprites(0);
+      else if (strcmp(argv[i], "-g") == 0 && i + 2 < argc)
+	{
+	  generate = atoi(argv[++i]);
+	  gen_dir = argv[++i];
+	}
+      else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+	bench = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+	seed = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-h") == 0)
+	{
+	  print_usage(argv[0]);
+	  return 0;
+	}
+      else
+	scene_file = argv[i];
+    }
+
+  srand(seed);
+  Scene scene;
+  Framebuffer frame;
+
+  if (bench > 0)
+    {
+      std::clock_t total = 0;
+      for (int i = 0; i < bench; ++i)
+	{
+	  random_scene(scene);
+	  std::clock_t start = std::clock();
+	  model.render_frame(scene, frame);
+	  total += std::clock() - start;
+	}
+      double us = double(total) * 1000000.0 / CLOCKS_PER_SEC;
+      std::cout << "Rendered " << bench << " frames in " << us / 1000.0 << " ms, "
+		<< us / bench << " us per frame" << std::endl;
+      return 0;
+    }
+
+  if (generate > 0)
+    {
+      for (int i = 0; i < generate; ++i)
+	{
+	  random_scene(scene);
+	  model.render_frame(scene, frame);
+	  if (!scene.write(numbered(gen_dir, i, ".bin")))
+	    {
+	      std::cout << "Error: Couldn't write " << numbered(gen_dir, i, ".bin") << std::endl;
+	      return 2;
+	    }
+	  std::ofstream out(numbered(gen_dir, i, ".fb").c_str(), std::ios::binary);
+	  out.write((const char*)frame.data(), Framebuffer::BYTES);
+	}
+      std::cout << "Wrote " << generate << " scenes to " << gen_dir << std::endl;
+      return 0;
+    }
+
+  if (scene_file.empty())
+    {
+      print_usage(argv[0]);
+      return 2;
+    }
+  if (!scene.read(scene_file))
+    {
+      std::cout << "Error: Couldn't read " << scene_file << ", it should be "
+		<< Scene::FILE_SIZE << " bytes" << std::endl;
+      return 2;
+    }
+
+  model.render_frame(scene, frame);
+  std::cout << "Frame: " << frame.hash() << std::endl;
+  if (!out_file.empty())
+    {
+      std::ofstream out(out_file.c_str(), std::ios::binary);
+      out.write((const char*)frame.data(), Framebuffer::BYTES);
+    }
+  if (!ppm_file.empty())
+    frame.write_ppm(ppm_file);
+  return 0;
+}
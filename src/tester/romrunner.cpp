@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "romsuite.hpp"
+
+void print_usage(const char* name)
+{
+  using std::cout;
+  using std::endl;
+
+  cout << "Usage: " << name << " options [rom names]" << endl;
+  cout << "Runs the roms in the manifest, or only the named ones, and checks" << endl;
+  cout << "their ram and framebuffer. Run it from the src dir." << endl;
+  cout << "-m FILE    Manifest to use, default is roms/manifest.txt" << endl;
+  cout << "-r DIR     Where the roms are, default is roms" << endl;
+  cout << "-j NUMBER  Number of simulations to run at the same time," << endl;
+  cout << "           default is the number of cpus" << endl;
+}
+
+int main(int argc, char** argv)
+{
+  std::string manifest = "roms/manifest.txt", rom_dir = "roms";
+  std::list<std::string> only;
+  int jobs = 1;
+#ifndef _WIN32
+  jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+	{
+	  manifest = argv[++i];
+	}
+      else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+	{
+	  rom_dir = argv[++i];
+	}
+      else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+	{
+	  std::stringstream ss;
+	  ss << argv[++i];
+	  ss >> jobs;
+	}
+      else if (strcmp(argv[i], "-h") == 0)
+	{
+	  print_usage(argv[0]);
+	  return 0;
+	}
+      else
+	{
+	  only.push_back(argv[i]);
+	}
+    }
+
+  RomSuite suite(rom_dir);
+  if (!suite.load(manifest))
+    return 2;
+
+  if (!only.empty())
+    {
+      RomEntries& entries = suite.entries();
+      for (RomEntries::iterator it = entries.begin(); it != entries.end(); )
+	{
+	  if (std::find(only.begin(), only.end(), it->name) == only.end())
+	    it = entries.erase(it);
+	  else
+	    ++it;
+	}
+    }
+
+  std::cout << "Running " << suite.entries().size() << " roms, "
+	    << jobs << " at a time" << std::endl;
+  return suite.run(jobs) ? 0 : 1;
+}
@@ -0,0 +1,355 @@
+#include "romsuite.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <iomanip>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+RomSuite::RomSuite(const std::string& rom_dir)
+  : m_rom_dir(rom_dir)
+{}
+
+RomSuite::~RomSuite()
+{}
+
+std::string RomSuite::path(const RomEntry& e, const std::string& suffix) const
+{
+  return m_rom_dir + "/" + e.name + suffix;
+}
+
+bool RomSuite::load(const std::string& manifest)
+{
+  std::ifstream file(manifest.c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << manifest << std::endl;
+      return false;
+    }
+
+  std::string line;
+  int line_num = 0;
+  while (std::getline(file, line))
+    {
+      ++line_num;
+      std::string::size_type comment = line.find('#');
+      if (comment != std::string::npos)
+	line = line.substr(0, comment);
+
+      std::stringstream ss(line);
+      std::string key;
+      if (!(ss >> key))
+	continue;
+
+      if (key == "rom")
+	{
+	  RomEntry e;
+	  ss >> e.name >> e.frames;
+	  if (e.name.empty() || e.frames <= 0)
+	    {
+	      std::cout << "DEBUG: " << manifest << ":" << line_num
+			<< ": expected rom NAME FRAMES" << std::endl;
+	      return false;
+	    }
+	  m_entries.push_back(e);
+	  continue;
+	}
+
+      if (m_entries.empty())
+	{
+	  std::cout << "DEBUG: " << manifest << ":" << line_num
+		    << ": " << key << " before any rom" << std::endl;
+	  return false;
+	}
+      RomEntry& e = m_entries.back();
+
+      if (key == "ram")
+	{
+	  AddrData data;
+	  unsigned int value;
+	  ss >> std::hex >> value;
+	  data.set_addr(value);
+	  while (ss >> value)
+	    data.add_byte(byte(value));
+	  if (data.get_addr() < BASE_RESULT_OFFSET || data.empty())
+	    {
+	      std::cout << "DEBUG: " << manifest << ":" << line_num
+			<< ": expected ram ADDR BYTES, with ADDR >= C000" << std::endl;
+	      return false;
+	    }
+	  e.ram.push_back(data);
+	}
+      else if (key == "framebuffer")
+	{
+	  ss >> e.framebuffer_hash;
+	}
+      else if (key == "serial")
+	{
+	  e.serial = true;
+	}
+      else
+	{
+	  std::cout << "DEBUG: " << manifest << ":" << line_num
+		    << ": unknown keyword " << key << std::endl;
+	  return false;
+	}
+    }
+  return true;
+}
+
+//Same format as dump.pl, one byte per line in binary
+bool RomSuite::prepare(const RomEntry& e)
+{
+  std::ifstream in(path(e, ".gb").c_str(), std::ios::binary);
+  if (!in.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path(e, ".gb")
+		<< ", did you run roms/compile.sh?" << std::endl;
+      return false;
+    }
+  //Don't let the output of the last run stop this one
+  std::remove(path(e, ".serial.txt").c_str());
+
+  std::ofstream out(path(e, ".rom.txt").c_str());
+  char c;
+  while (in.get(c))
+    out << Util::to_bin(int(byte(c))) << '\n';
+  out.flush();
+  return out.good();
+}
+
+int RomSuite::rom_banks(const RomEntry& e) const
+{
+  std::ifstream in(path(e, ".gb").c_str(), std::ios::binary | std::ios::ate);
+  long size = in.is_open() ? long(in.tellg()) : 0;
+  int banks = 2;
+  while (banks < MAX_ROM_BANKS && long(banks) * ROM_BANK_SIZE < size)
+    banks *= 2;
+  return banks;
+}
+
+std::string RomSuite::command(const RomEntry& e)
+{
+  //Loading the whole rom (42 ms for 2MB) and dumping C000-FFFF come on
+  //top of the frames, plus a frame to spare. This is only a safety net,
+  //the testbench stops by itself.
+  long load_ns = long(rom_banks(e)) * ROM_BANK_SIZE * BYTE_TIME_NS;
+  long dump_ns = long(0x10000 - BASE_RESULT_OFFSET) * BYTE_TIME_NS;
+  long stop_time = long(e.frames + 1) * FRAME_TIME_US + (load_ns + dump_ns) / 1000 + 1000;
+  std::stringstream arg;
+#ifndef _WIN32
+  //Replace the shell, so that the pid we kill is the simulation
+  arg << "exec ";
+#endif
+  arg << "ghdl --elab-run --ieee=synopsys Rom_Test"
+      << " -gRom_File=" << path(e, ".rom.txt")
+      << " -gResult_File=" << path(e, ".result.txt")
+      << " -gFrames=" << e.frames
+      << " -gFramebuffer_File=" << path(e, ".fb")
+      << " -gSerial_File=" << path(e, ".serial.txt")
+      << " -gRom_Banks=" << rom_banks(e)
+      << " --stop-time=" << stop_time << "us";
+#ifdef _WIN32
+  arg << " > NUL 2>NUL";
+#else
+  arg << " > /dev/null 2>" << path(e, ".errors.txt");
+#endif
+  return arg.str();
+}
+
+int RomSuite::start(const RomEntry& e)
+{
+  std::string cmd = command(e);
+#ifdef _WIN32
+  //No fork here, simply run them one by one
+  std::system(("\"" + cmd + "\"").c_str());
+  return 0;
+#else
+  pid_t pid = fork();
+  if (pid == 0)
+    {
+      execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)NULL);
+      _exit(127);
+    }
+  return pid;
+#endif
+}
+
+std::string RomSuite::serial_verdict(const RomEntry& e) const
+{
+  std::string output = Util::read_file(path(e, ".serial.txt"));
+  if (output.find("Failed") != std::string::npos)
+    return "Failed";
+  if (output.find("Passed") != std::string::npos)
+    return "Passed";
+  return "";
+}
+
+bool RomSuite::check(const RomEntry& e, bool stopped)
+{
+  if (e.serial)
+    {
+      std::string verdict = serial_verdict(e);
+      if (verdict != "Passed")
+	{
+	  std::cout << e.name << ": serial output was:" << std::endl
+		    << Util::read_file(path(e, ".serial.txt")) << std::endl;
+	  return false;
+	}
+      //Nothing else to look at if we didn't let it finish
+      if (stopped)
+	return true;
+    }
+
+  std::ifstream file(path(e, ".result.txt").c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path(e, ".result.txt") << std::endl;
+      return false;
+    }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(file, line))
+    lines.push_back(line);
+
+  bool all_ok = true;
+  for (AddrDatas::const_iterator it = e.ram.begin();
+       it != e.ram.end();
+       ++it)
+    {
+      int addr = it->get_addr();
+      const ByteList& bytes = it->get_bytes();
+      for (ByteList::const_iterator b = bytes.begin();
+	   b != bytes.end();
+	   ++b, ++addr)
+	{
+	  unsigned int index = addr - BASE_RESULT_OFFSET;
+	  std::string found = index < lines.size() ? lines[index] : "";
+	  std::string expected = Util::to_bin(int(*b));
+	  if (found != expected)
+	    {
+	      if (all_ok)
+		std::cout << e.name << ":" << std::endl;
+	      all_ok = false;
+	      std::cout << "At addr: " << std::setw(10) << std::hex << addr << std::dec
+			<< " expected: " << expected << " got: " << found << std::endl;
+	    }
+	}
+    }
+
+  if (!e.framebuffer_hash.empty())
+    {
+      std::vector<Framebuffer> frames;
+      Framebuffer::read_stream(path(e, ".fb"), frames);
+      if (frames.empty())
+	{
+	  std::cout << e.name << ": no framebuffer captured in "
+		    << path(e, ".fb") << std::endl;
+	  return false;
+	}
+      const Framebuffer& last = frames.back();
+      if (last.hash() != e.framebuffer_hash)
+	{
+	  std::cout << e.name << ": framebuffer hash is " << last.hash()
+		    << ", expected " << e.framebuffer_hash << std::endl;
+	  //If there is a golden image around, show where they differ
+	  std::vector<Framebuffer> golden;
+	  if (Framebuffer::read_stream(path(e, ".golden.fb"), golden) && !golden.empty())
+	    {
+	      last.write_ppm(path(e, ".diff.ppm"), &golden.back());
+	      std::cout << Framebuffer::diff_pixels(last, golden.back())
+			<< " pixels differ from " << path(e, ".golden.fb")
+			<< ", see " << path(e, ".diff.ppm") << std::endl;
+	    }
+	  all_ok = false;
+	}
+    }
+  return all_ok;
+}
+
+bool RomSuite::run(int jobs)
+{
+  if (jobs < 1)
+    jobs = 1;
+
+  bool all_ok = true;
+  std::map<int, const RomEntry*> running;
+  RomEntries::const_iterator next = m_entries.begin();
+  int done = 0, total = m_entries.size();
+
+  while (next != m_entries.end() || !running.empty())
+    {
+      //Fill up with new simulations
+      while (next != m_entries.end() && int(running.size()) < jobs)
+	{
+	  const RomEntry& e = *next++;
+	  if (!prepare(e))
+	    {
+	      all_ok = false;
+	      ++done;
+	      continue;
+	    }
+	  int pid = start(e);
+	  if (pid < 0)
+	    {
+	      std::cout << "DEBUG: Couldn't start the simulation of " << e.name << std::endl;
+	      all_ok = false;
+	      ++done;
+	      continue;
+	    }
+	  running[pid] = &e;
+	}
+
+      if (running.empty())
+	break;
+
+      bool stopped = false;
+#ifdef _WIN32
+      int pid = running.begin()->first;
+#else
+      int status;
+      int pid = waitpid(-1, &status, WNOHANG);
+      if (pid < 0)
+	break;
+      if (pid == 0)
+	{
+	  //Nothing has finished, see if any rom has reported its result
+	  for (std::map<int, const RomEntry*>::const_iterator it = running.begin();
+	       it != running.end();
+	       ++it)
+	    {
+	      if (it->second->serial && !serial_verdict(*it->second).empty())
+		{
+		  pid = it->first;
+		  break;
+		}
+	    }
+	  if (pid == 0)
+	    {
+	      usleep(POLL_INTERVAL_US);
+	      continue;
+	    }
+	  kill(pid, SIGTERM);
+	  waitpid(pid, &status, 0);
+	  stopped = true;
+	}
+      if (running.find(pid) == running.end())
+	continue;
+#endif
+      const RomEntry& e = *running[pid];
+      running.erase(pid);
+      ++done;
+
+      bool ok = check(e, stopped);
+      std::cout << "Rom " << done << " of " << total << ", " << e.name << ": "
+		<< (ok ? "OK" : "FAIL") << std::endl;
+      if (!ok)
+	all_ok = false;
+    }
+  return all_ok;
+}
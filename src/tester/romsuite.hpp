@@ -0,0 +1,79 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <list>
+#include <vector>
+#include <map>
+
+#include "addrdata.hpp"
+#include "typedefs.hpp"
+#include "util.hpp"
+#include "framebuffer.hpp"
+
+//One rom from the manifest, see roms/manifest.txt for the format
+struct RomEntry
+{
+  RomEntry() : frames(1), serial(false) {};
+
+  std::string name;
+  //Simulate until this many frames have been drawn
+  int frames;
+  //What the ram should contain after that
+  AddrDatas ram;
+  //Hash of the last frame, empty if we don't care
+  std::string framebuffer_hash;
+  //The rom reports "Passed" or "Failed" through the serial port, like
+  //Blargg's test roms. The simulation is stopped as soon as it does,
+  //frames is then only an upper limit.
+  bool serial;
+};
+
+typedef std::list<RomEntry> RomEntries;
+
+class RomSuite
+{
+public:
+  RomSuite(const std::string& rom_dir);
+  virtual ~RomSuite();
+
+  bool load(const std::string& manifest);
+  inline RomEntries& entries() { return m_entries;};
+
+  //Simulates every rom, at most jobs of them at the same time.
+  //Returns true if all of them passed.
+  bool run(int jobs);
+
+  //The ram dump starts here, see rom_test.vhd
+  const static int BASE_RESULT_OFFSET = 0xC000;
+  //How long a frame is in the simulation, in microseconds
+  const static int FRAME_TIME_US = 16700;
+  //rom_test.vhd loads and dumps a byte every two clocks of 10 ns
+  const static int BYTE_TIME_NS = 20;
+  //How often the serial output of running simulations is checked
+  const static int POLL_INTERVAL_US = 20000;
+  //Banked roms, like bus_controller.vhd. 512 banks is the 8MB of MBC5.
+  const static int ROM_BANK_SIZE = 16384;
+  const static int MAX_ROM_BANKS = 512;
+
+private:
+  bool prepare(const RomEntry& e);
+  std::string command(const RomEntry& e);
+  //The size of the rom in banks, the next power of two and at least 2
+  int rom_banks(const RomEntry& e) const;
+  //stopped is true if the simulation was stopped early because of
+  //the serial output, there is no ram dump then
+  bool check(const RomEntry& e, bool stopped);
+  //"Passed" or "Failed" if the rom has said so on the serial port
+  std::string serial_verdict(const RomEntry& e) const;
+
+  //Starts the simulation for e, returns the pid or -1
+  int start(const RomEntry& e);
+
+  std::string path(const RomEntry& e, const std::string& suffix) const;
+
+  std::string m_rom_dir;
+  RomEntries m_entries;
+};
@@ -0,0 +1,217 @@
+#include "simbackend.hpp"
+#include "addrdata.hpp"
+#include "util.hpp"
+#include "timing.hpp"
+#include "coverage.hpp"
+#include "vcd.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+const char* SimBackend::TESTBENCH = "Suite_Test";
+
+SimBackend::SimBackend(const std::string& base_path, Simulator& simulator, int jobs)
+  : m_base_path(base_path), m_simulator(simulator), m_jobs(jobs < 1 ? 1 : jobs),
+    m_generics(m_jobs), m_image_bytes(m_jobs)
+{}
+
+SimBackend::~SimBackend()
+{}
+
+std::string SimBackend::path(const std::string& dir, const std::string& name, int worker) const
+{
+  std::stringstream ss;
+  ss << m_base_path << dir << "/" << name;
+  //One worker keeps the names the suites have always used
+  if (m_jobs > 1)
+    ss << "_" << worker;
+  ss << ".txt";
+  return ss.str();
+}
+
+bool SimBackend::prepare(const std::string& entity)
+{
+  //Every suite runs on suite_test.vhd, which is one of these
+  std::vector<std::string> files;
+  files.push_back("*.vhd");
+  if (!m_simulator.analyse(files))
+    {
+      std::cout << "DEBUG: " << m_simulator.name() << " couldn't analyse the design" << std::endl;
+      return false;
+    }
+  if (!m_simulator.elaborate(TESTBENCH))
+    {
+      std::cout << "DEBUG: " << m_simulator.name() << " couldn't elaborate " << TESTBENCH << std::endl;
+      return false;
+    }
+  return true;
+}
+
+bool SimBackend::run(int worker, const std::string& entity, int test_num,
+		     const std::vector<byte>& image, const AddrDatas& checks,
+		     const RunOptions& options, RunResult& result)
+{
+  std::string feed = path("stimulus", "feed", worker);
+  std::string results = path("results", "results", worker);
+  std::string serial = path("results", "serial", worker);
+  std::string trace = path("results", "trace", worker);
+  std::string clocks = path("results", "clocks", worker);
+  {
+    Timing::Phase phase(options.timing, "feed", test_num, worker);
+    if (!write_feed(feed, image))
+      return false;
+  }
+  //A simulation that dies mustn't leave the last test's files to be read
+  std::remove(results.c_str());
+  std::remove(serial.c_str());
+  std::remove(clocks.c_str());
+  std::remove(trace.c_str());
+
+  //Only read back as far as the checks go
+  int dump_end = BASE_RESULT_OFFSET;
+  for (AddrDatas::const_iterator it = checks.begin(); it != checks.end(); ++it)
+    dump_end = std::max(dump_end, it->get_addr() + int(it->get_bytes().size()) - 1);
+  std::stringstream generics;
+  generics << " -gFeed_File=" << feed
+	   << " -gResult_File=" << results
+	   << " -gSerial_File=" << serial
+	   << " -gCycles=" << options.cycles
+	   << " -gDump_End=" << std::min(dump_end, MAX_DUMP_END)
+	   << " -gClocks_File=" << clocks;
+  if (options.coverage)
+    generics << " -gTrace_File=" << trace;
+  m_generics[worker] = generics.str();
+  m_image_bytes[worker] = image.size();
+
+  result.wave_path = "";
+  bool simulated;
+  {
+    Timing::Phase phase(options.timing, "simulate", test_num, worker);
+    if (options.full_vcd)
+      {
+	std::stringstream vcd;
+	vcd << entity;
+	if (m_jobs > 1)
+	  vcd << "_" << test_num;
+	vcd << ".vcd";
+	result.wave_path = vcd.str();
+	simulated = m_simulator.run(TESTBENCH, options.simulation_time, m_generics[worker],
+				    m_simulator.vcd_args(result.wave_path));
+      }
+    else
+      {
+	//Most tests pass, so don't pay for a waveform until one doesn't.
+	//A failed assert also makes the simulator fail, so let the
+	//results decide
+	simulated = m_simulator.run(TESTBENCH, options.simulation_time, m_generics[worker], "");
+      }
+  }
+
+  Timing::Phase phase(options.timing, "results", test_num, worker);
+  read_results(results, result.ram);
+
+  result.serial = Util::read_file(serial);
+  //The testbench always writes them when it gets to the end
+  std::stringstream halt(Util::read_file(clocks));
+  if (!(halt >> result.halt_clocks))
+    {
+      std::cout << "DEBUG: The simulation of test " << test_num << " didn't get to the end, "
+		<< m_simulator.name() << (simulated ? " exited normally" : " failed") << std::endl;
+      return false;
+    }
+  //Without a trace the test gets no coverage record, so --affected
+  //always runs it
+  result.opcodes.clear();
+  if (options.coverage)
+    Coverage::read_trace(trace, result.opcodes);
+  return true;
+}
+
+bool SimBackend::write_feed(const std::string& path, const std::vector<byte>& image)
+{
+  std::ofstream file(path.c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path << " for filling" << std::endl;
+      return false;
+    }
+  //One flush at the end, endl would flush every byte
+  for (std::vector<byte>::const_iterator it = image.begin();
+       it != image.end();
+       ++it)
+    file << Util::to_bin(int(*it)) << '\n';
+  file.flush();
+  return file.good();
+}
+
+bool SimBackend::read_results(const std::string& path, std::vector<std::string>& ram)
+{
+  ram.clear();
+  std::ifstream in(path.c_str());
+  if (!in.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path << std::endl;
+      return false;
+    }
+  std::string line;
+  while (std::getline(in, line))
+    ram.push_back(line);
+  return true;
+}
+
+long long SimBackend::clocks_ns(int image_bytes, int clocks)
+{
+  //See Stimuli_Generator in suite_test.vhd: reset until the edge after
+  //50 ns, two clocks for each byte of the image and one more before the
+  //cpu gets its first clock
+  return 55 + (2 * image_bytes + 2 + clocks) * CLOCK_NS;
+}
+
+void SimBackend::failed(int worker, const std::string& entity, int test_num,
+			const RunOptions& options, RunResult& result)
+{
+  if (options.full_vcd)
+    return;
+
+  //Where the test failed, the cpu either halted or ran out of cycles.
+  //A few clocks more show what came right after.
+  int clocks = result.halt_clocks > 0 ? result.halt_clocks : options.cycles;
+  long long fail_ns = clocks_ns(m_image_bytes[worker], clocks + 10);
+  long long from_ns = 0, to_ns = fail_ns;
+  if (options.wave_from >= 0)
+    {
+      from_ns = options.wave_from * 1000LL;
+      to_ns = options.wave_window > 0 ? from_ns + options.wave_window * 1000LL : fail_ns;
+    }
+  else if (options.wave_window > 0)
+    {
+      from_ns = std::max(0LL, fail_ns - options.wave_window * 1000LL);
+    }
+  int stop_us = std::min<long long>(options.simulation_time, (to_ns + 999) / 1000);
+  
+  //Only the signals of the testbench itself (the bus) and the cpu. The
+  //simulators can't leave out the start, so a window that doesn't start
+  //at 0 is dumped as a vcd and cut down afterwards.
+  std::stringstream base;
+  base << entity << "_" << test_num;
+  bool cut = from_ns > 0;
+  std::string args;
+  std::string whole = m_simulator.wave_args(TESTBENCH, base.str() + (cut ? "_whole" : ""), cut, args);
+  if (whole.empty())
+    return;
+  //The feed of the worker is still the one of this test
+  m_simulator.run(TESTBENCH, stop_us, m_generics[worker], args);
+  if (!cut)
+    {
+      result.wave_path = whole;
+      return;
+    }
+  std::string path = base.str() + ".vcd";
+  if (Vcd::cut(whole, path, from_ns, to_ns))
+    result.wave_path = path;
+  std::remove(whole.c_str());
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "backend.hpp"
+#include "simulator.hpp"
+
+//Runs the tests in a simulator, with the testbench in the test directory
+class SimBackend : public Backend
+{
+public:
+  //Runs up to jobs tests at the same time, each worker with its own
+  //feed and results files
+  SimBackend(const std::string& base_path, Simulator& simulator, int jobs = 1);
+  virtual ~SimBackend();
+
+  virtual int workers() const { return m_jobs;};
+  //Analyses the design and elaborates the testbench, the same one
+  //for all suites
+  virtual bool prepare(const std::string& entity);
+
+  virtual bool run(int worker, const std::string& entity, int test_num,
+		   const std::vector<byte>& image, const AddrDatas& checks,
+		   const RunOptions& options, RunResult& result);
+  //Re-runs the test with waveform capture limited to the cpu and bus,
+  //and to the window of options before where the test failed
+  virtual void failed(int worker, const std::string& entity, int test_num,
+		      const RunOptions& options, RunResult& result);
+
+  //The image as the testbench reads it, one binary byte per line
+  static bool write_feed(const std::string& path, const std::vector<byte>& image);
+  //The ram dump of the testbench, one line per byte from 0xC000
+  static bool read_results(const std::string& path, std::vector<std::string>& ram);
+
+  //The testbench, see suite_test.vhd
+  static const char* TESTBENCH;
+  //The ram dump starts here
+  const static int BASE_RESULT_OFFSET = 0xC000;
+  //The end of the address space
+  const static int MAX_DUMP_END = 0xFFFF;
+  //The clock period of the testbench
+  const static int CLOCK_NS = 10;
+  //When the cpu has run clocks clocks after loading image_bytes
+  static long long clocks_ns(int image_bytes, int clocks);
+
+private:
+  //The file name of worker in dir of the suite
+  std::string path(const std::string& dir, const std::string& name, int worker) const;
+
+  std::string m_base_path;
+  Simulator& m_simulator;
+  int m_jobs;
+  //What the last test of each worker was run with
+  std::vector<std::string> m_generics;
+  std::vector<int> m_image_bytes;
+};
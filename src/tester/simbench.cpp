@@ -0,0 +1,369 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+
+#include "typedefs.hpp"
+#include "util.hpp"
+#include "timing.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+
+//A program for the cpu, it starts at 0x150 like in cpu.vhd
+struct Workload
+{
+  const char* name;
+  const char* description;
+  //Needs the gpu, so only the top levels with one make sense
+  bool gpu;
+  std::vector<byte> code;
+};
+
+//How a design is simulated
+struct TopLevel
+{
+  const char* name;
+  const char* entity;
+  bool has_gpu;
+  //Has the Sim_Memory generic, see bus_controller.vhd
+  bool sim_memory;
+};
+
+//ghdl and the options to analyse and run with
+struct SimConfig
+{
+  std::string name;
+  std::string ghdl;
+  std::string analyse_flags;
+  std::string run_flags;
+};
+
+struct SimResult
+{
+  std::string config, top, workload;
+  //Clocks the cpu ran, after the program was loaded
+  long long cycles;
+  double elab_seconds, run_seconds;
+  //How long a run that stops when the program is loaded takes, the
+  //start of ghdl and the feed
+  double load_seconds;
+  long peak_kb;
+  bool ok;
+};
+
+//The testbench of the test suites is the cpu and the bus controller,
+//Rom_Test has the gpu as well, wired like root.vhd
+static const TopLevel TOP_LEVELS[] = {
+  { "cpu+bus", "Suite_Test", false, true },
+  { "cpu+bus+gpu", "Rom_Test", true, true },
+};
+static const int TOP_LEVEL_COUNT = sizeof(TOP_LEVELS) / sizeof(TOP_LEVELS[0]);
+//One cycle is 10 ns in all testbenches
+static const int CYCLE_NS = 10;
+//Both testbenches hold reset for 5 clocks and take 3 more around the
+//load, which takes two clocks per byte
+static const int LOAD_OVERHEAD_CLOCKS = 8;
+
+std::vector<Workload> workloads()
+{
+  std::vector<Workload> w;
+  //LD A, 00; LD (FF40), A turns the lcd off
+  const byte lcd_off[] = { 0x3E, 0x00, 0xEA, 0x40, 0xFF };
+
+  //ADD A, B; XOR B; INC B; DEC C; OR C; CPL; JR -8
+  const byte alu[] = { 0x80, 0xA8, 0x04, 0x0D, 0xB1, 0x2F, 0x18, 0xF8 };
+  Workload a = { "alu", "Arithmetic in a tight loop, lcd off", false, std::vector<byte>() };
+  a.code.assign(lcd_off, lcd_off + sizeof(lcd_off));
+  a.code.insert(a.code.end(), alu, alu + sizeof(alu));
+  w.push_back(a);
+
+  //Copies C000-CFFF to D000 over and over:
+  //LD HL, C000; LD DE, D000; LD BC, 1000
+  //LD A, (HL+); LD (DE), A; INC DE; DEC BC; LD A, B; OR C; JR NZ, -8; JR -19
+  const byte copy[] = { 0x21, 0x00, 0xC0, 0x11, 0x00, 0xD0, 0x01, 0x00, 0x10,
+			0x2A, 0x12, 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8, 0x18, 0xED };
+  Workload m = { "memcpy", "4K memory copy in a loop, lcd off", false, std::vector<byte>() };
+  m.code.assign(lcd_off, lcd_off + sizeof(lcd_off));
+  m.code.insert(m.code.end(), copy, copy + sizeof(copy));
+  w.push_back(m);
+
+  //LD A, 91; LD (FF40), A; LD A, E4; LD (FF47), A; JR -2
+  const byte gpu[] = { 0x3E, 0x91, 0xEA, 0x40, 0xFF, 0x3E, 0xE4, 0xEA, 0x47, 0xFF, 0x18, 0xFE };
+  Workload g = { "frames", "Lcd and background on, the cpu idles", true, std::vector<byte>() };
+  g.code.assign(gpu, gpu + sizeof(gpu));
+  w.push_back(g);
+  return w;
+}
+
+//Clocks from the start until the cpu gets the rom of w
+long long load_clocks(const Workload& w)
+{
+  return 2 * (0x150 + (long long)w.code.size()) + LOAD_OVERHEAD_CLOCKS;
+}
+
+//The rom as the testbenches read it, one binary byte per line
+bool write_rom(const std::string& path, const Workload& w)
+{
+  std::ofstream file(path.c_str());
+  for (int addr = 0; addr < 0x150; ++addr)
+    file << "00000000\n";
+  for (size_t i = 0; i < w.code.size(); ++i)
+    file << Util::to_bin(w.code[i]) << "\n";
+  return file.good();
+}
+
+//Runs cmd in a shell, returns false if it fails. Peak memory of it in
+//peak_kb, 0 where we can't tell.
+bool run_command(const std::string& cmd, long& peak_kb)
+{
+  peak_kb = 0;
+#ifdef _WIN32
+  return std::system(("\"" + cmd + "\"").c_str()) == 0;
+#else
+  pid_t pid = fork();
+  if (pid == 0)
+    {
+      //exec, so that the rusage is the one of ghdl
+      execl("/bin/sh", "sh", "-c", ("exec " + cmd).c_str(), (char*)NULL);
+      _exit(127);
+    }
+  if (pid < 0)
+    return false;
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid)
+    return false;
+  peak_kb = usage.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+bool analyse(const SimConfig& c, const std::string& workdir)
+{
+  std::system(("mkdir -p " + workdir).c_str());
+  std::string cmd = c.ghdl + " -a --ieee=synopsys --workdir=" + workdir + " " + c.analyse_flags
+    + " *.vhd > " + workdir + "/analyse.txt 2>&1";
+  long peak_kb;
+  return run_command(cmd, peak_kb);
+}
+
+//signals runs with the memories as signals instead of shared variables,
+//only for top levels with Sim_Memory
+SimResult simulate(const SimConfig& c, const std::string& workdir, const TopLevel& top,
+		   const Workload& w, long long cycles, bool signals)
+{
+  SimResult r = { c.name, top.name, w.name, cycles, 0, 0, 0, 0, false };
+  std::string rom = workdir + "/rom.txt";
+  if (!write_rom(rom, w))
+    {
+      std::cout << "DEBUG: Couldn't write the rom for " << w.name << std::endl;
+      return r;
+    }
+
+  std::string base = c.ghdl + " --ieee=synopsys --workdir=" + workdir;
+  std::string log = " > " + workdir + "/run.txt 2>&1";
+  long peak_kb;
+  double start = Timing::now();
+  if (!run_command(base + " -e " + top.entity + log, peak_kb))
+    {
+      std::cout << "DEBUG: Couldn't elaborate " << top.entity << ", see " << workdir << "/run.txt" << std::endl;
+      return r;
+    }
+  r.elab_seconds = (Timing::now() - start) / 1000000.0;
+
+  //Rom_Test would stop after its Cycles, let the stop time do it for both.
+  //The cpu gets cycles after the load, and a run that stops when the load
+  //is done tells how long that took.
+  std::stringstream cmd;
+  cmd << base << " -r " << top.entity << " " << c.run_flags;
+  if (top.has_gpu)
+    cmd << " -gRom_File=" << rom << " -gResult_File=" << workdir << "/result.txt"
+	<< " -gCycles=" << cycles * 2;
+  else
+    cmd << " -gFeed_File=" << rom << " -gResult_File=" << workdir << "/result.txt"
+	<< " -gCycles=" << cycles * 2 << " -gDump_End=0";
+  if (signals)
+    {
+      cmd << " -gSim_Memory=false";
+      r.config += "/signals";
+    }
+  std::stringstream load;
+  load << cmd.str() << " --stop-time=" << load_clocks(w) * CYCLE_NS << "ns" << log;
+  cmd << " --stop-time=" << (load_clocks(w) + cycles) * CYCLE_NS << "ns" << log;
+  start = Timing::now();
+  r.ok = run_command(load.str(), peak_kb);
+  r.load_seconds = (Timing::now() - start) / 1000000.0;
+  start = Timing::now();
+  r.ok = r.ok && run_command(cmd.str(), r.peak_kb);
+  r.run_seconds = (Timing::now() - start) / 1000000.0;
+  if (!r.ok)
+    std::cout << "DEBUG: " << top.entity << " failed, see " << workdir << "/run.txt" << std::endl;
+  return r;
+}
+
+//Cycles of the cpu per second, without the time of the load
+double cycles_per_second(const SimResult& r)
+{
+  double seconds = r.run_seconds - r.load_seconds;
+  return seconds > 0 ? r.cycles / seconds : 0;
+}
+
+void print_result(const SimResult& r)
+{
+  std::cout << std::left << std::setw(20) << r.config << std::setw(13) << r.top << std::setw(9) << r.workload
+	    << std::right << std::fixed << std::setprecision(2)
+	    << std::setw(9) << r.elab_seconds << std::setw(9) << r.load_seconds << std::setw(9) << r.run_seconds
+	    << std::setprecision(0) << std::setw(13) << cycles_per_second(r)
+	    << std::setw(10) << r.peak_kb / 1024
+	    << (r.ok ? "" : "  FAILED") << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+}
+
+void print_usage(const char* name)
+{
+  using std::cout;
+  using std::endl;
+
+  cout << "Usage: " << name << " options" << endl;
+  cout << "Measures how fast ghdl simulates the design: fixed programs run on the" << endl;
+  cout << "cpu and bus (Suite_Test) and with the gpu (Rom_Test). Run it from src/." << endl;
+  cout << "-c NAME=GHDL [ANALYSE FLAGS] [-- RUN FLAGS]" << endl;
+  cout << "           A setup to measure, several may be given. The default is" << endl;
+  cout << "           default=ghdl. For example -c \"llvm-O2=/opt/ghdl-llvm/bin/ghdl -O2\"" << endl;
+  cout << "           or -c \"noasserts=ghdl -- --ieee-asserts=disable\"." << endl;
+  cout << "-m         Also run with the memories as signals (-gSim_Memory=false)," << endl;
+  cout << "           to compare with the shared variables it uses by default" << endl;
+  cout << "-n NUMBER  Cycles the cpu runs per run, default 1000000 (10 ms)" << endl;
+  cout << "Load s is a run that stops once the program is loaded, Run s the whole run." << endl;
+  cout << "Cycles/s is the cycles of the cpu over the difference, the speed of the" << endl;
+  cout << "simulation without starting ghdl and loading." << endl;
+  cout << "-w NAME    Only run this workload (alu, memcpy or frames), may be repeated" << endl;
+  cout << "-d DIR     Where the analysed design and logs go, default /tmp/simbench" << endl;
+  cout << "-o FILE    Also write the results as CSV" << endl;
+}
+
+bool parse_config(const std::string& arg, SimConfig& c)
+{
+  std::string::size_type eq = arg.find('=');
+  if (eq == std::string::npos || eq == 0)
+    return false;
+  c.name = arg.substr(0, eq);
+  std::stringstream ss(arg.substr(eq + 1));
+  std::string word;
+  bool run = false;
+  while (ss >> word)
+    {
+      if (c.ghdl.empty())
+	c.ghdl = word;
+      else if (word == "--")
+	run = true;
+      else
+	(run ? c.run_flags : c.analyse_flags) += word + " ";
+    }
+  return !c.ghdl.empty();
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<SimConfig> configs;
+  std::vector<std::string> only;
+  long long cycles = 1000000;
+  bool signals = false;
+  std::string dir = "/tmp/simbench", csv_path;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+	{
+	  SimConfig c;
+	  if (!parse_config(argv[++i], c))
+	    {
+	      std::cout << "Error: Expected NAME=GHDL [FLAGS], got " << argv[i] << std::endl;
+	      return 2;
+	    }
+	  configs.push_back(c);
+	}
+      else if (strcmp(argv[i], "-m") == 0)
+	signals = true;
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+	cycles = atoll(argv[++i]);
+      else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+	only.push_back(argv[++i]);
+      else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+	dir = argv[++i];
+      else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+	csv_path = argv[++i];
+      else
+	{
+	  print_usage(argv[0]);
+	  return 2;
+	}
+    }
+  if (configs.empty())
+    {
+      SimConfig c;
+      parse_config("default=ghdl", c);
+      configs.push_back(c);
+    }
+
+  std::vector<Workload> all = workloads();
+  std::vector<SimResult> results;
+  std::cout << std::left << std::setw(20) << "Config" << std::setw(13) << "Top level" << std::setw(9) << "Workload"
+	    << std::right << std::setw(9) << "Elab s" << std::setw(9) << "Load s" << std::setw(9) << "Run s"
+	    << std::setw(13) << "Cycles/s" << std::setw(10) << "Peak MB" << std::endl;
+  for (size_t c = 0; c < configs.size(); ++c)
+    {
+      std::string workdir = dir + "/" + configs[c].name;
+      if (!analyse(configs[c], workdir))
+	{
+	  std::cout << "Error: Couldn't analyse the design with " << configs[c].name
+		    << ", see " << workdir << "/analyse.txt" << std::endl;
+	  continue;
+	}
+      for (size_t w = 0; w < all.size(); ++w)
+	{
+	  if (!only.empty() && std::find(only.begin(), only.end(), all[w].name) == only.end())
+	    continue;
+	  for (int t = 0; t < TOP_LEVEL_COUNT; ++t)
+	    {
+	      if (all[w].gpu && !TOP_LEVELS[t].has_gpu)
+		continue;
+	      SimResult r = simulate(configs[c], workdir, TOP_LEVELS[t], all[w], cycles, false);
+	      results.push_back(r);
+	      print_result(r);
+	      if (signals && TOP_LEVELS[t].sim_memory)
+		{
+		  r = simulate(configs[c], workdir, TOP_LEVELS[t], all[w], cycles, true);
+		  results.push_back(r);
+		  print_result(r);
+		}
+	    }
+	}
+    }
+
+  if (!csv_path.empty())
+    {
+      std::ofstream csv(csv_path.c_str());
+      csv << "config,top,workload,cycles,elab_seconds,load_seconds,run_seconds,cycles_per_s,peak_kb,ok" << std::endl;
+      for (size_t i = 0; i < results.size(); ++i)
+	{
+	  const SimResult& r = results[i];
+	  csv << r.config << "," << r.top << "," << r.workload << "," << r.cycles << ","
+	      << std::fixed << std::setprecision(3) << r.elab_seconds << "," << r.load_seconds << ","
+	      << r.run_seconds << "," << std::setprecision(0) << cycles_per_second(r) << ","
+	      << r.peak_kb << "," << (r.ok ? 1 : 0) << std::endl;
+	}
+      std::cout << "Results in: " << csv_path << std::endl;
+    }
+  return 0;
+}
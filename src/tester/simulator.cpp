@@ -0,0 +1,268 @@
+#include "simulator.hpp"
+#include "util.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+//Work libraries of the setups that don't use the default one
+static const char* WORK_DIR = "build/sim";
+
+const char* Simulator::CHOICE_FILE = "tester.sim";
+
+Simulator::Simulator(const std::string& name)
+  : m_name(name)
+{}
+
+Simulator::~Simulator()
+{}
+
+std::vector<Simulator*> Simulator::all()
+{
+  std::vector<Simulator*> setups;
+  const char* names[] = { "ghdl", "ghdl-O2", "ghdl-O3", "nvc", "nvc-O3" };
+  for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    setups.push_back(create(names[i]));
+  return setups;
+}
+
+Simulator* Simulator::create(const std::string& name)
+{
+  std::string work_dir = std::string(WORK_DIR) + "/" + name;
+  if (name == "ghdl")
+    return new GhdlSimulator(name, "", "");
+  if (name == "ghdl-O2")
+    return new GhdlSimulator(name, work_dir, "-O2");
+  if (name == "ghdl-O3")
+    return new GhdlSimulator(name, work_dir, "-O3");
+  if (name == "nvc")
+    return new NvcSimulator(name, work_dir, "");
+  if (name == "nvc-O3")
+    return new NvcSimulator(name, work_dir, "-O3");
+  return 0;
+}
+
+std::string Simulator::load_choice()
+{
+  std::stringstream ss(Util::read_file(CHOICE_FILE));
+  std::string name;
+  ss >> name;
+  return name;
+}
+
+bool Simulator::save_choice(const std::string& name)
+{
+  std::ofstream file(CHOICE_FILE);
+  file << name << std::endl;
+  return file.good();
+}
+
+bool Simulator::execute(const std::string& cmd)
+{
+  std::string arg;
+#ifdef _WIN32
+  arg = "\"" + cmd + " > NUL 2>NUL\"";
+#else
+  arg = cmd + " > /dev/null 2>&1";
+#endif
+  return std::system(arg.c_str()) == 0;
+}
+
+std::string Simulator::output(const std::string& cmd)
+{
+#ifdef _WIN32
+  FILE* pipe = popen((cmd + " 2>NUL").c_str(), "r");
+#else
+  FILE* pipe = popen((cmd + " 2>/dev/null").c_str(), "r");
+#endif
+  if (!pipe)
+    return "";
+  std::string out;
+  char buffer[256];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    out.append(buffer, read);
+  if (pclose(pipe) != 0)
+    return "";
+  return out;
+}
+
+bool Simulator::make_dir(const std::string& path)
+{
+#ifdef _WIN32
+  std::string dir = path;
+  std::replace(dir.begin(), dir.end(), '/', '\\');
+  std::system(("if not exist " + dir + " mkdir " + dir).c_str());
+  return true;
+#else
+  return execute("mkdir -p " + path);
+#endif
+}
+
+GhdlSimulator::GhdlSimulator(const std::string& name, const std::string& work_dir, const std::string& optimize)
+  : Simulator(name), m_work_dir(work_dir), m_optimize(optimize)
+{}
+
+GhdlSimulator::~GhdlSimulator()
+{}
+
+std::string GhdlSimulator::options() const
+{
+  std::string opts = " --ieee=synopsys";
+  if (!m_work_dir.empty())
+    opts += " --workdir=" + m_work_dir;
+  return opts;
+}
+
+std::string GhdlSimulator::executable(const std::string& entity) const
+{
+  std::string name = entity;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  return m_work_dir + "/" + name;
+}
+
+bool GhdlSimulator::available() const
+{
+  std::string version = output("ghdl --version");
+  if (version.empty())
+    return false;
+  //mcode runs the design in memory, there is nothing to optimize
+  return m_optimize.empty() || version.find("mcode") == std::string::npos;
+}
+
+bool GhdlSimulator::analyse(const std::vector<std::string>& files)
+{
+  //compile.sh has done that already
+  if (m_work_dir.empty())
+    return true;
+  if (!make_dir(m_work_dir))
+    return false;
+  std::string cmd = "ghdl -a" + options() + " " + m_optimize;
+  for (size_t i = 0; i < files.size(); ++i)
+    cmd += " " + files[i];
+  return execute(cmd);
+}
+
+bool GhdlSimulator::elaborate(const std::string& entity)
+{
+  //mcode elaborates every time it runs
+  if (m_optimize.empty())
+    return true;
+  return execute("ghdl -e" + options() + " " + m_optimize + " -o " + executable(entity) + " " + entity);
+}
+
+bool GhdlSimulator::run(const std::string& entity, int simulation_time, const std::string& generics,
+			const std::string& wave_args)
+{
+  std::stringstream cmd;
+  if (m_optimize.empty())
+    cmd << "ghdl --elab-run" << options() << " " << entity;
+  else
+    cmd << executable(entity);
+  cmd << generics << wave_args << " --stop-time=" << simulation_time << "us";
+  return execute(cmd.str());
+}
+
+std::string GhdlSimulator::vcd_args(const std::string& path) const
+{
+  return " --vcd=" + path;
+}
+
+std::string GhdlSimulator::wave_args(const std::string& entity, const std::string& base, bool vcd,
+				     std::string& args) const
+{
+  //ghdl wants lower case paths in the option file
+  std::string top = entity;
+  std::transform(top.begin(), top.end(), top.begin(), ::tolower);
+
+  std::string opt_path = base + ".opt";
+  std::ofstream opt(opt_path.c_str());
+  if (!opt.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << opt_path << ", no waveform for you" << std::endl;
+      args = "";
+      return "";
+    }
+  opt << "$ version 1.1" << std::endl
+      << "/" << top << "/*" << std::endl
+      << "/" << top << "/cpu_ports/*" << std::endl;
+
+  //The option file filters the vcd too
+  std::string path = base + (vcd ? ".vcd" : ".ghw");
+  args = (vcd ? " --vcd=" : " --wave=") + path + " --read-wave-opt=" + opt_path;
+  return path;
+}
+
+NvcSimulator::NvcSimulator(const std::string& name, const std::string& work_dir, const std::string& optimize)
+  : Simulator(name), m_work_dir(work_dir), m_optimize(optimize)
+{}
+
+NvcSimulator::~NvcSimulator()
+{}
+
+std::string NvcSimulator::options() const
+{
+  return " --std=1993 --work=" + m_work_dir;
+}
+
+bool NvcSimulator::available() const
+{
+  return !output("nvc --version").empty();
+}
+
+bool NvcSimulator::analyse(const std::vector<std::string>& files)
+{
+  if (!make_dir(m_work_dir))
+    return false;
+  //--relaxed lets through the things ghdl -fexplicit would
+  std::string cmd = "nvc" + options() + " -a --relaxed";
+  for (size_t i = 0; i < files.size(); ++i)
+    cmd += " " + files[i];
+  return execute(cmd);
+}
+
+bool NvcSimulator::elaborate(const std::string& entity)
+{
+  //Only to see that it does, run elaborates again with the generics
+  return execute("nvc" + options() + " -e " + m_optimize + " " + entity);
+}
+
+bool NvcSimulator::run(const std::string& entity, int simulation_time, const std::string& generics,
+		       const std::string& wave_args)
+{
+  //nvc only takes generics when elaborating, with --jit that is cheap
+  //enough to do for every run
+  std::stringstream cmd;
+  cmd << "nvc" << options() << " -e --jit " << m_optimize << generics << " " << entity
+      << " -r" << wave_args << " --stop-time=" << simulation_time << "us";
+  return execute(cmd.str());
+}
+
+std::string NvcSimulator::vcd_args(const std::string& path) const
+{
+  return " --wave=" + path + " --format=vcd";
+}
+
+std::string NvcSimulator::wave_args(const std::string& entity, const std::string& base, bool vcd,
+				    std::string& args) const
+{
+  //nvc leaves out arrays of arrays unless asked, so the rams are not
+  //in there anyway
+  if (vcd)
+    {
+      std::string path = base + ".vcd";
+      args = vcd_args(path);
+      return path;
+    }
+  std::string path = base + ".fst";
+  args = " --wave=" + path;
+  return path;
+}
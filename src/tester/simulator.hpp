@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//A VHDL simulator and how to build and run a testbench with it. All
+//paths are relative to src/, where the tester runs.
+class Simulator
+{
+public:
+  Simulator(const std::string& name);
+  virtual ~Simulator();
+
+  const std::string& name() const { return m_name;};
+
+  //Whether the simulator is installed and can do what this setup wants
+  virtual bool available() const = 0;
+  //Analyses files (may be globs) into the work library of this setup
+  virtual bool analyse(const std::vector<std::string>& files) = 0;
+  //Builds entity, after that it can be run any number of times
+  virtual bool elaborate(const std::string& entity) = 0;
+  //Runs entity for simulation_time microseconds. generics are like
+  //" -gName=Value", wave_args come from vcd_args or wave_args. Returns
+  //false if the simulator failed.
+  virtual bool run(const std::string& entity, int simulation_time, const std::string& generics,
+		   const std::string& wave_args) = 0;
+
+  //Arguments that dump every signal to path as a vcd
+  virtual std::string vcd_args(const std::string& path) const = 0;
+  //Arguments that dump only the testbench and the cpu, the ram arrays
+  //are way too large. base is the path without extension, the path of
+  //the waveform is returned. vcd asks for a vcd, which Vcd::cut can
+  //cut down to a window, instead of the smaller format of the simulator.
+  virtual std::string wave_args(const std::string& entity, const std::string& base, bool vcd,
+				std::string& args) const = 0;
+
+  //Every setup we know of, the plain ghdl that compile.sh uses first.
+  //Owned by the caller.
+  static std::vector<Simulator*> all();
+  //The setup called name, null if there is none. Owned by the caller.
+  static Simulator* create(const std::string& name);
+
+  //Where --tune stores the fastest setup
+  static const char* CHOICE_FILE;
+  //The setup stored by --tune, empty if it hasn't been run
+  static std::string load_choice();
+  static bool save_choice(const std::string& name);
+
+protected:
+  //Runs cmd with its output thrown away, true if it exited with 0
+  static bool execute(const std::string& cmd);
+  //What cmd writes to stdout, empty if it couldn't be run
+  static std::string output(const std::string& cmd);
+  static bool make_dir(const std::string& path);
+
+  std::string m_name;
+};
+
+//ghdl, either the mcode build or one built with llvm or gcc, which
+//compiles the design to an executable at the given optimization level
+class GhdlSimulator : public Simulator
+{
+public:
+  //An empty work_dir uses the default work library, which compile.sh
+  //has already analysed everything into. optimize is like "-O2", empty
+  //for mcode.
+  GhdlSimulator(const std::string& name, const std::string& work_dir, const std::string& optimize);
+  virtual ~GhdlSimulator();
+
+  virtual bool available() const;
+  virtual bool analyse(const std::vector<std::string>& files);
+  virtual bool elaborate(const std::string& entity);
+  virtual bool run(const std::string& entity, int simulation_time, const std::string& generics,
+		   const std::string& wave_args);
+  virtual std::string vcd_args(const std::string& path) const;
+  virtual std::string wave_args(const std::string& entity, const std::string& base, bool vcd,
+				std::string& args) const;
+
+private:
+  //--ieee=synopsys has to come first, see compile.sh
+  std::string options() const;
+  std::string executable(const std::string& entity) const;
+
+  std::string m_work_dir, m_optimize;
+};
+
+class NvcSimulator : public Simulator
+{
+public:
+  //optimize is like "-O3", empty for the default of nvc
+  NvcSimulator(const std::string& name, const std::string& work_dir, const std::string& optimize);
+  virtual ~NvcSimulator();
+
+  virtual bool available() const;
+  virtual bool analyse(const std::vector<std::string>& files);
+  virtual bool elaborate(const std::string& entity);
+  virtual bool run(const std::string& entity, int simulation_time, const std::string& generics,
+		   const std::string& wave_args);
+  virtual std::string vcd_args(const std::string& path) const;
+  virtual std::string wave_args(const std::string& entity, const std::string& base, bool vcd,
+				std::string& args) const;
+
+private:
+  //The shared variables in bus_controller.vhd need VHDL-93
+  std::string options() const;
+
+  std::string m_work_dir, m_optimize;
+};
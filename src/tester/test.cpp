@@ -1,10 +1,13 @@
 #include "test.hpp"
+#include "timing.hpp"
+#include "coverage.hpp"
 
 Test::Test()
+  : m_min_cycles(0), m_max_cycles(0), m_cycles_unchecked(false)
 {}
 
 Test::Test(const std::string& base_path)
-  : m_base_path(base_path)
+  : m_base_path(base_path), m_min_cycles(0), m_max_cycles(0), m_cycles_unchecked(false)
 {}  
 
 Test::~Test()
@@ -30,23 +33,72 @@ void Test::set_prep_addrs(AddrDatas data)
   m_prep_addresses = data;
 }
 
+void Test::set_cycles(int min, int max)
+{
+  m_min_cycles = min;
+  m_max_cycles = max;
+}
+
 void Test::reset()
 {
+  m_min_cycles = m_max_cycles = 0;
   m_prepare.clear();
   m_test_addresses.clear();
   m_check_addresses.clear();
   m_prep_addresses.clear();
 }
 
-bool Test::run(const std::string& name, int simulation_time)
+bool Test::run(const std::string& name, int test_num, const RunOptions& options,
+	       Backend& backend, int worker)
 {
-  //Generate a file and give it to the vhdl program
-  TestFile tf(this);
+  Timing::Phase whole(options.timing, "test", test_num, worker);
+
+  //Generate the image and give it to the backend
+  std::vector<byte> image;
+  {
+    Timing::Phase phase(options.timing, "generate", test_num, worker);
+    TestFile tf(this);
+    tf.generate_input();
+    image = tf.image();
+  }
   
-  tf.generate_input();
-  tf.fill(m_base_path + "/stimulus/feed.txt");
+  std::string test_name = entity_name(name);
+  RunResult result;
+  bool ran;
+  {
+    Timing::Phase phase(options.timing, "backend", test_num, worker);
+    ran = backend.run(worker, test_name, test_num, image, m_check_addresses, options, result);
+  }
+  if (!ran)
+    {
+      //What it executed before may not be what it executes now
+      if (options.coverage)
+	options.coverage->add(name, test_num, std::map<int, OpcodeCount>());
+      m_wave_path = "";
+      m_serial = "";
+      return false;
+    }
   
-  //Run the simulation which creates output
+  bool ok;
+  {
+    Timing::Phase phase(options.timing, "check", test_num, worker);
+    ok = check(result.ram);
+    ok = check_cycles(result.halt_clocks) && ok;
+  }
+  if (options.coverage)
+    options.coverage->add(name, test_num, result.opcodes);
+  if (!ok && options.rerun_failed)
+    {
+      Timing::Phase phase(options.timing, "failed", test_num, worker);
+      backend.failed(worker, test_name, test_num, options, result);
+    }
+  m_wave_path = result.wave_path;
+  m_serial = result.serial;
+  return ok;
+}
+
+std::string Test::entity_name(const std::string& name)
+{
   std::string test_name = name;
   std::transform(test_name.begin(), test_name.begin()+1, test_name.begin(), ::toupper);
   for (std::string::iterator it = test_name.begin();
@@ -56,50 +108,13 @@ bool Test::run(const std::string& name, int simulation_time)
       if ((*it) == '_')
 	std::transform(it+1, it+2, it+1, ::toupper);
     }
-  std::stringstream arg;
-#ifdef _WIN32
-  arg << "\"";
-#endif
-  arg << "ghdl --elab-run --ieee=synopsys" 
-      << " " << test_name
-      << " --vcd=" << test_name << ".vcd"
-      << " --stop-time=" << simulation_time << "us";
-#ifdef _WIN32
-  arg << " > NUL 2>NUL\"";
-#else
-  arg << " > /dev/null 2>&1";
-#endif
-  std::system(arg.str().c_str());
-  
-  return check(m_base_path + "/results/results.txt");
-}
-
-
-void Test::read_num_lines(int num_lines, std::ifstream& file, int& curr_line)
-{
-  char read_to[9];
-  // std::cout << "Laser bort " << std::dec << num_lines << " rader" << std::endl;
-  for (int i = 0; i < num_lines; ++i, ++curr_line)
-    {
-      // std::cout << std::dec <<  i;
-      file.getline(&read_to[0], 9);
-    }
-  // std::cout << std::endl;
+  return test_name;
 }
 
-bool Test::check(const std::string& results_path)
+bool Test::check(const std::vector<std::string>& ram)
 {
-  //Open the file
-  std::ifstream file;
-  file.open(results_path.c_str());
-  if (!file.is_open())
-    {
-      std::cout << "DEBUG: Couldn't open " << results_path << std::endl;
-    }
-  
   m_check_addresses.sort();
   
-  int curr_line = 0;
   bool all_ok = true;
   for (AddrDatas::const_iterator it = m_check_addresses.begin();
        it != m_check_addresses.end();
@@ -112,25 +127,15 @@ bool Test::check(const std::string& results_path)
 		    << " of RAM (0xC000). That won't happen lad" << std::endl;
 	  continue;
 	}
-      read_num_lines(addr - BASE_CHECK_OFFSET - curr_line, file, curr_line);
       
-      //next line to read is the one we want to check first
       const ByteList& bytes = it->get_bytes();
       int i = 0;
       for (ByteList::const_iterator it = bytes.begin();
 	   it != bytes.end();
-	   ++it, ++i, ++curr_line)
+	   ++it, ++i)
 	{
-	  // 8 + nul
-	  char read_to[9];
-	  file.getline(&read_to[0], 9);
-	  // std::cout << "Read data (" << std::hex << addr + i << "): " << &read_to[0] << std::endl;
-	  std::string data;
-	  std::copy(read_to, read_to + 9, std::back_inserter(data));
-	  //std::copy(read_to.begin(), read_to.end(), std::back_inserter(data));
-	  data = data.substr(0, data.size() - 1);
-	  // std::cout << "Strangens langd: " << data.size() 
-	  //           << " och innehall:" << data << ":" << std::endl;
+	  unsigned int index = addr + i - BASE_CHECK_OFFSET;
+	  std::string data = index < ram.size() ? ram[index] : "";
 	  //Get the data that we should diff against
 	  if (data != Util::to_bin(int(*it)))
 	    {
@@ -138,12 +143,28 @@ bool Test::check(const std::string& results_path)
 	      DiffInfo d = { data, Util::to_bin(int(*it)), addr + i };
 	      m_diff.add_diff(d);
 	    }
-	  // std::cout << " RAD: " << curr_line << " DATA: " << Util::to_bin(int(*it)) << std::endl;
 	}
     }
   return all_ok;
 }
 
+bool Test::check_cycles(int halt_clocks)
+{
+  m_cycles_unchecked = false;
+  if (m_max_cycles == 0)
+    return true;
+  //The boards can't count them, which is no reason to fail there
+  if (halt_clocks == RunResult::CLOCKS_UNCOUNTED)
+    {
+      m_cycles_unchecked = true;
+      return true;
+    }
+  if (halt_clocks > 0 && halt_clocks >= m_min_cycles && halt_clocks <= m_max_cycles)
+    return true;
+  m_diff.add_clocks_diff(halt_clocks, m_min_cycles, m_max_cycles);
+  return false;
+}
+
 std::ostream & operator<<(std::ostream &os, const Test& t)
 {
   os << "  Test data:" << std::endl;
@@ -160,5 +181,7 @@ std::ostream & operator<<(std::ostream &os, const Test& t)
     {
       os << *it << std::endl;
     }
+  if (t.m_max_cycles > 0)
+    os << "  Cycles: " << t.m_min_cycles << " to " << t.m_max_cycles << std::endl;
   return os;
 }
@@ -12,6 +12,7 @@
 #include "testfile.hpp"
 #include "util.hpp"
 #include "diff.hpp"
+#include "backend.hpp"
 
 class Test
 {
@@ -27,24 +28,44 @@ public:
   void add_check_addr_data(AddrData data);
   inline const AddrDatas& get_check_addr_data() const { return m_check_addresses;};
   void set_prep_addrs(AddrDatas addrs);
+  //The clocks from reset to HALT that @cycles allows
+  void set_cycles(int min, int max);
   inline AddrDatas& get_prep_addr_data_vol() { return m_prep_addresses; };
   inline const AddrDatas& get_prep_addr_data() const { return m_prep_addresses;};
   void reset();
   
   const Diff& diff() const { return m_diff;};
+  //Where the waveform of the last failed run ended up, empty if none
+  const std::string& wave_path() const { return m_wave_path;};
+  //What the test wrote to the serial port during the last run
+  const std::string& serial() const { return m_serial;};
+  //Whether the last run passed without its @cycles being checked,
+  //because the backend couldn't count the clocks
+  bool cycles_unchecked() const { return m_cycles_unchecked;};
   
   inline bool has_data() { 
     return !m_prepare.empty() 
       // && !m_test_addresses.empty()
       && !m_check_addresses.empty();
   };
-  bool run(const std::string& test_name, int simulation_time);
+  //Runs the test on the backend, worker is for backends that can run
+  //several tests at the same time
+  bool run(const std::string& test_name, int test_num, const RunOptions& options,
+	   Backend& backend, int worker = 0);
   
+  //Compares ram (from 0xC000, one binary string per byte like
+  //results.txt) with the checks, the differences end up in diff()
+  bool check(const std::vector<std::string>& ram);
+  //Compares the clocks to HALT from RunResult with @cycles, if the test
+  //has it and the backend could tell
+  bool check_cycles(int halt_clocks);
+  
+  //The entity of the testbench of test_name, like Ld_Op_Test
+  static std::string entity_name(const std::string& test_name);
+
   const static int BASE_CHECK_OFFSET = 0xC000;
   
 private:
-  void read_num_lines(int num_lines, std::ifstream& file, int& curr_line);
-  bool check(const std::string& results_path);
   
   friend std::ostream& operator<<(std::ostream &os, const Test& t);
   
@@ -52,6 +73,11 @@ private:
 
   PrepareStatements m_prepare;
   AddrDatas m_test_addresses, m_check_addresses, m_prep_addresses;
+  //0 without @cycles
+  int m_min_cycles, m_max_cycles;
+  bool m_cycles_unchecked;
   Diff m_diff;
+  std::string m_wave_path;
+  std::string m_serial;
 };
 
@@ -139,60 +139,9 @@ bool TestFile::generate_test_data()
   return true;
 }
 
-//Convert from decimal to binary format
-//This isn't the best but it gets the job done atm
-std::string TestFile::to_bin(int i)
+std::vector<byte> TestFile::image() const
 {
-  std::vector<char> data;
-  while (i > 0)
-    {
-      if (i % 2 == 0)
-	data.push_back('0');
-      else
-	data.push_back('1');
-      i /= 2;
-    }
-  
-  while (data.size() < 8)
-    data.push_back('0');
-  
-  std::reverse(data.begin(), data.end());
-  std::string ret_val;
-  std::copy(data.begin(), data.end(), std::back_inserter(ret_val));
-  return ret_val;
-}
-
-void TestFile::fill(const std::string& file_name)
-{
-  std::ofstream file;
-  file.open(file_name.c_str());
-  if (!file.is_open())
-    {
-      std::cout << "DEBUG: Couldn't open " << file_name << " for filling" << std::endl;
-      return;
-    }
-  
-  for (ByteList::const_iterator it = m_bytes.begin(); 
-       it != m_bytes.end();
-       ++it)
-    {
-      //Doesn't work
-      // file << std::setbase(2) << int(*it) << std::endl;
-      file << to_bin(int(*it)) << std::endl;
-    }
-  file.close();
-  
-  // std::cout << "Data: " << std::endl;
-  // int addr = 0x150;
-  // for (ByteList::const_iterator it = m_bytes.begin(); 
-  //      it != m_bytes.end();
-  //      ++it, ++addr)
-  //   {
-  //     std::cout << std::setw(5) << std::hex << addr << ": " 
-  // 		<< int(*it) << std::endl;
-  //   }
-  // std::cout << std::resetiosflags(std::ios_base::basefield | std::ios_base::adjustfield);
-  // std::cout << "End data" << std::endl;
+  return std::vector<byte>(m_bytes.begin(), m_bytes.end());
 }
 
 TestFile::TestFile()
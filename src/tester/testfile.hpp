@@ -20,7 +20,8 @@ public:
   //This takes care of generating data from 
   //the tests get_test_addr_data()
   bool generate_test_data();
-  void fill(const std::string& file_name);
+  //Everything generated, one byte per address from 0
+  std::vector<byte> image() const;
   
   //Start address where we want to start in ROM
   static const int START_ADDR = 0x150;
@@ -33,8 +34,6 @@ private:
   void add_bytes(AddrDatas::iterator& it);
   void add_bytes(AddrDatas::const_iterator& it);
   
-  std::string to_bin(int i);
-  
   Test* m_test;
   int m_curr_addr;
   //Bytes that we're going to write later
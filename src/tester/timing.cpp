@@ -0,0 +1,125 @@
+#include "timing.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+Timing::Timing()
+{}
+
+Timing::~Timing()
+{}
+
+Timing::Phase::Phase(Timing* timing, const char* name, int test_num, int worker)
+  : m_timing(timing), m_name(name), m_test_num(test_num), m_worker(worker),
+    m_start(timing ? Timing::now() : 0)
+{}
+
+Timing::Phase::~Phase()
+{
+  if (m_timing)
+    m_timing->add(m_name, m_test_num, m_worker, m_start, Timing::now());
+}
+
+double Timing::now()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+void Timing::add(const char* name, int test_num, int worker, double start, double end)
+{
+  Event e = { name, test_num, worker, start, end };
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_events.push_back(e);
+}
+
+//Nearest rank, sorted has to be sorted
+static double percentile(const std::vector<double>& sorted, double p)
+{
+  return sorted[size_t(p * (sorted.size() - 1) + 0.5)];
+}
+
+void Timing::report(std::ostream& os) const
+{
+  std::lock_guard<std::mutex> guard(m_lock);
+  if (m_events.empty())
+    return;
+
+  //The phases in the order they first show up
+  std::vector<const char*> names;
+  double first = m_events.front().start, last = m_events.front().end;
+  int tests = 0;
+  for (std::vector<Event>::const_iterator it = m_events.begin(); it != m_events.end(); ++it)
+    {
+      bool known = false;
+      for (size_t i = 0; i < names.size(); ++i)
+	known = known || strcmp(names[i], it->name) == 0;
+      if (!known)
+	names.push_back(it->name);
+      first = std::min(first, it->start);
+      last = std::max(last, it->end);
+      if (strcmp(it->name, "test") == 0)
+	++tests;
+    }
+
+  os << std::fixed << std::setprecision(2);
+  os << std::left << std::setw(16) << "Phase" << std::right
+     << std::setw(8) << "Count" << std::setw(12) << "Total ms"
+     << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << std::setw(10) << "max ms" << std::endl;
+  for (size_t i = 0; i < names.size(); ++i)
+    {
+      std::vector<double> ms;
+      double total = 0;
+      for (std::vector<Event>::const_iterator it = m_events.begin(); it != m_events.end(); ++it)
+	if (strcmp(it->name, names[i]) == 0)
+	  {
+	    ms.push_back((it->end - it->start) / 1000.0);
+	    total += ms.back();
+	  }
+      std::sort(ms.begin(), ms.end());
+      os << std::left << std::setw(16) << names[i] << std::right
+	 << std::setw(8) << ms.size() << std::setw(12) << total
+	 << std::setw(10) << percentile(ms, 0.5) << std::setw(10) << percentile(ms, 0.95)
+	 << std::setw(10) << ms.back() << std::endl;
+    }
+  double seconds = (last - first) / 1000000.0;
+  os << tests << " tests in " << seconds << " s";
+  if (seconds > 0)
+    os << ", " << tests / seconds << " tests/s";
+  os << std::endl;
+  os.unsetf(std::ios::fixed);
+  os.unsetf(std::ios::adjustfield);
+}
+
+bool Timing::write_trace(const std::string& path) const
+{
+  std::ofstream file(path.c_str());
+  if (!file.is_open())
+    {
+      std::cout << "DEBUG: Couldn't open " << path << " for the trace" << std::endl;
+      return false;
+    }
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  double first = m_events.empty() ? 0 : m_events.front().start;
+  for (std::vector<Event>::const_iterator it = m_events.begin(); it != m_events.end(); ++it)
+    first = std::min(first, it->start);
+
+  //Complete events ("ph": "X"), times in microseconds
+  file << std::fixed << std::setprecision(3);
+  file << "{\"traceEvents\":[" << std::endl;
+  for (std::vector<Event>::const_iterator it = m_events.begin(); it != m_events.end(); ++it)
+    {
+      if (it != m_events.begin())
+	file << "," << std::endl;
+      file << "{\"name\":\"" << it->name << "\",\"cat\":\"tester\",\"ph\":\"X\""
+	   << ",\"ts\":" << it->start - first << ",\"dur\":" << it->end - it->start
+	   << ",\"pid\":1,\"tid\":" << it->worker
+	   << ",\"args\":{\"test\":" << it->test_num << "}}";
+    }
+  file << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+  return file.good();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <mutex>
+
+//Collects how long each phase of each test took, to see where the time
+//of a run goes. Phases may be nested, like the simulation inside the
+//backend. Safe to use from the workers of a backend.
+class Timing
+{
+public:
+  Timing();
+  virtual ~Timing();
+
+  //Times the scope it lives in. Does nothing if timing is null, so the
+  //callers don't have to check.
+  class Phase
+  {
+  public:
+    Phase(Timing* timing, const char* name, int test_num, int worker = 0);
+    ~Phase();
+  private:
+    Timing* m_timing;
+    const char* m_name;
+    int m_test_num, m_worker;
+    double m_start;
+  };
+
+  void add(const char* name, int test_num, int worker, double start, double end);
+
+  //Count, p50, p95 and max of every phase and the tests per second,
+  //taking the "test" phase as one test
+  void report(std::ostream& os) const;
+  //Chrome trace events, for chrome://tracing or Perfetto. Every worker
+  //gets its own row.
+  bool write_trace(const std::string& path) const;
+
+  //Microseconds from a monotonic clock
+  static double now();
+
+private:
+  struct Event
+  {
+    const char* name;
+    int test_num, worker;
+    double start, end;
+  };
+
+  mutable std::mutex m_lock;
+  std::vector<Event> m_events;
+};
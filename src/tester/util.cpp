@@ -1,5 +1,8 @@
 #include "util.hpp"
 
+#include <fstream>
+#include <sstream>
+
 std::string Util::to_bin(int i)
 {
   //Convert from decimal to binary format
@@ -23,3 +26,11 @@ std::string Util::to_bin(int i)
   std::copy(data.begin(), data.end(), std::back_inserter(ret_val));
   return ret_val;
 }
+
+std::string Util::read_file(const std::string& path)
+{
+  std::ifstream file(path.c_str(), std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
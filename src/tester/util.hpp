@@ -8,4 +8,6 @@ class Util
 {
 public:
   static std::string to_bin(int i);
+  //The whole file, empty if it can't be read
+  static std::string read_file(const std::string& path);
 };
@@ -0,0 +1,114 @@
+#include "vcd.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cstdlib>
+
+typedef std::map<std::string, std::string> Values;
+
+//Every value at time, like the $dumpvars at the start of a dump
+static void write_values(std::ostream& output, long long time, const Values& values)
+{
+  output << '#' << time << '\n' << "$dumpvars" << '\n';
+  for (Values::const_iterator it = values.begin(); it != values.end(); ++it)
+    output << it->second << '\n';
+  output << "$end" << '\n';
+}
+
+long long Vcd::timescale_fs(const std::string& timescale)
+{
+  //Like "1 fs", "100ps" or "10 ns", split over lines or not
+  std::stringstream ss(timescale);
+  std::string word, text;
+  while (ss >> word)
+    if (word != "$timescale" && word != "$end")
+      text += word;
+  long long number = atoll(text.c_str());
+  size_t digits = text.find_first_not_of("0123456789");
+  if (digits == std::string::npos)
+    return 0;
+  std::string unit = text.substr(digits);
+  const char* units[] = { "fs", "ps", "ns", "us", "ms", "s" };
+  long long fs = 1;
+  for (int i = 0; i < 6; ++i, fs *= 1000)
+    if (unit == units[i])
+      return number * fs;
+  return 0;
+}
+
+bool Vcd::cut(const std::string& in, const std::string& out, long long from_ns, long long to_ns)
+{
+  std::ifstream input(in.c_str());
+  std::ofstream output(out.c_str());
+  if (!input.is_open() || !output.is_open())
+    {
+      std::cout << "DEBUG: Couldn't cut " << in << " down to " << out << std::endl;
+      return false;
+    }
+
+  //The header goes as it is, only the time unit of it is needed
+  std::string line, timescale;
+  bool in_timescale = false, defined = false;
+  while (!defined && std::getline(input, line))
+    {
+      if (line.find("$timescale") != std::string::npos)
+	in_timescale = true;
+      if (in_timescale)
+	timescale += line + " ";
+      if (line.find("$end") != std::string::npos)
+	in_timescale = false;
+      defined = line.find("$enddefinitions") != std::string::npos;
+      output << line << '\n';
+    }
+  long long unit_fs = timescale_fs(timescale);
+  if (!defined || unit_fs == 0)
+    {
+      std::cout << "DEBUG: " << in << " isn't a vcd that can be cut" << std::endl;
+      return false;
+    }
+  long long from = from_ns * 1000000 / unit_fs, to = to_ns * 1000000 / unit_fs;
+
+  //The last value of every signal before from, by identifier
+  Values values;
+  bool started = false;
+  while (std::getline(input, line))
+    {
+      if (!line.empty() && line[line.size() - 1] == '\r')
+	line.erase(line.size() - 1);
+      if (line.empty())
+	continue;
+      if (line[0] == '#')
+	{
+	  long long time = atoll(line.c_str() + 1);
+	  if (time > to)
+	    break;
+	  if (!started && time >= from)
+	    {
+	      write_values(output, from, values);
+	      started = true;
+	      if (time == from)
+		continue;
+	    }
+	}
+      else if (!started && line[0] != '$')
+	{
+	  //"b0101 ID" and "r1.5 ID" for vectors and reals, "1ID" for bits
+	  size_t space = line.find(' ');
+	  if (line[0] == 'b' || line[0] == 'B' || line[0] == 'r' || line[0] == 'R')
+	    values[space == std::string::npos ? line : line.substr(space + 1)] = line;
+	  else
+	    values[line.substr(1)] = line;
+	}
+      if (started)
+	output << line << '\n';
+    }
+  if (!started)
+    {
+      //Nothing changed after from
+      write_values(output, from, values);
+    }
+  output.flush();
+  return output.good();
+}
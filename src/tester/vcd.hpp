@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+//Value change dumps, as ghdl --vcd and nvc --format=vcd write them
+class Vcd
+{
+public:
+  //Copies the part of in from from_ns up to to_ns to out. out starts
+  //with the value every signal had at from_ns, so the viewer shows
+  //them like in the whole dump. False if in isn't a vcd.
+  static bool cut(const std::string& in, const std::string& out, long long from_ns, long long to_ns);
+
+private:
+  //How many femtoseconds one time unit of the dump is, 0 if the
+  //$timescale can't be read
+  static long long timescale_fs(const std::string& timescale);
+};